@@ -0,0 +1,701 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "Aggregate.hpp"
+#include <SoapySDR/Logger.h>
+#include <SoapySDR/Formats.hpp>
+#include <SoapySDR/Errors.h>
+#include <stdexcept>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <spawn.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+extern char **environ;
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static std::vector<std::string> split(const std::string &value, const char sep)
+{
+    std::vector<std::string> out;
+    std::stringstream ss(value);
+    std::string item;
+    while (std::getline(ss, item, sep))
+    {
+        if (not item.empty()) out.push_back(item);
+    }
+    return out;
+}
+
+static std::string toString(const double value)
+{
+    std::ostringstream ss;
+    ss.precision(12);
+    ss << value;
+    return ss.str();
+}
+
+//"min,max;min,max" as answered by the worker
+static SoapySDR::RangeList toRanges(const std::string &value)
+{
+    SoapySDR::RangeList ranges;
+    for (const auto &range : split(value, ';'))
+    {
+        const auto bounds = split(range, ',');
+        if (bounds.size() == 2) ranges.push_back(SoapySDR::Range(std::stod(bounds[0]), std::stod(bounds[1])));
+    }
+    return ranges;
+}
+
+/*******************************************************************
+ * Worker process
+ ******************************************************************/
+
+SoapySDRPlayWorkerProcess::SoapySDRPlayWorkerProcess(const std::string &path, const std::vector<std::string> &args):
+    _pid(-1),
+    _fd(-1)
+{
+#ifdef _WIN32
+    throw std::runtime_error("device aggregation is not supported on this platform");
+#else
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+    {
+        throw std::runtime_error(std::string("worker socketpair failed: ") + std::strerror(errno));
+    }
+
+    std::vector<char *> argv;
+    argv.push_back((char *)path.c_str());
+    for (const auto &arg : args) argv.push_back((char *)arg.c_str());
+    argv.push_back(nullptr);
+
+    //the worker talks on stdin/stdout, stderr stays with the host for its log
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, sv[1], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, sv[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, sv[0]);
+    posix_spawn_file_actions_addclose(&actions, sv[1]);
+
+    pid_t pid;
+    const int ret = posix_spawnp(&pid, path.c_str(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(sv[1]);
+    if (ret != 0)
+    {
+        close(sv[0]);
+        throw std::runtime_error("cannot start " + path + ": " + std::strerror(ret));
+    }
+    _pid = pid;
+    _fd = sv[0];
+#endif
+}
+
+SoapySDRPlayWorkerProcess::~SoapySDRPlayWorkerProcess(void)
+{
+    stop();
+}
+
+void SoapySDRPlayWorkerProcess::waitReady(void)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    const std::string reply = readLine(SDRPLAY_WORKER_START_MS);
+    if (reply == "ready") return;
+    stop();
+    throw std::runtime_error(reply.compare(0, 6, "error ") == 0 ? reply.substr(6) : "worker failed to start: " + reply);
+}
+
+std::string SoapySDRPlayWorkerProcess::command(const std::string &line)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::string reply;
+#ifndef _WIN32
+    if (_fd < 0) throw std::runtime_error("worker is not running");
+    const std::string out = line + "\n";
+    if (send(_fd, out.data(), out.size(), MSG_NOSIGNAL) != (ssize_t)out.size())
+    {
+        throw std::runtime_error(std::string("worker command failed: ") + std::strerror(errno));
+    }
+    reply = readLine(SDRPLAY_WORKER_START_MS);
+#endif
+    if (reply == "ok") return "";
+    if (reply.compare(0, 3, "ok ") == 0) return reply.substr(3);
+    throw std::runtime_error(reply.compare(0, 6, "error ") == 0 ? reply.substr(6) : "unexpected worker reply: " + reply);
+}
+
+std::string SoapySDRPlayWorkerProcess::readLine(const long timeoutMs)
+{
+#ifndef _WIN32
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (size_t end = _pending.find('\n'); end == std::string::npos; end = _pending.find('\n'))
+    {
+        const long leftMs = (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        struct pollfd pfd = {_fd, POLLIN, 0};
+        const int ret = (leftMs > 0) ? poll(&pfd, 1, (int)leftMs) : 0;
+        if (ret < 0 and errno == EINTR) continue;
+        if (ret <= 0) throw std::runtime_error("worker did not answer");
+
+        char buf[256];
+        const ssize_t n = recv(_fd, buf, sizeof(buf), 0);
+        if (n < 0 and errno == EINTR) continue;
+        if (n <= 0) throw std::runtime_error("worker exited");
+        _pending.append(buf, n);
+    }
+    const size_t end = _pending.find('\n');
+    const std::string line = _pending.substr(0, end);
+    _pending.erase(0, end + 1);
+    return line;
+#else
+    return "";
+#endif
+}
+
+void SoapySDRPlayWorkerProcess::stop(void)
+{
+#ifndef _WIN32
+    if (_fd < 0) return;
+
+    //end of input makes the worker close its device, give it time to
+    //release the hardware before it is killed
+    shutdown(_fd, SHUT_WR);
+    int status;
+    bool exited = false;
+    for (int i = 0; i < 50 and not exited; i++)
+    {
+        exited = waitpid(_pid, &status, WNOHANG) == _pid;
+        if (not exited) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if (not exited)
+    {
+        SoapySDR_logf(SOAPY_SDR_WARNING, "SDRplay worker %d did not exit, killing it", _pid);
+        kill(_pid, SIGKILL);
+        waitpid(_pid, &status, 0);
+    }
+    close(_fd);
+    _fd = -1;
+#endif
+}
+
+/*******************************************************************
+ * Aggregate device
+ ******************************************************************/
+
+SoapySDRPlayAggregateDevice::SoapySDRPlayAggregateDevice(const SoapySDR::Kwargs &args):
+    _useShort(true),
+    _hostTime(false),
+    _active(false),
+    _aligned(false),
+    _alignToleranceNs(DEFAULT_ALIGN_TOLERANCE_US * 1000LL),
+    _realignments(0)
+{
+    const auto serials = split(args.at("aggregate"), ',');
+    if (serials.empty()) throw std::runtime_error("aggregate needs a list of serial numbers");
+
+    const std::string path = args.count("worker") ? args.at("worker") : SDRPLAY_WORKER_PATH;
+    if (args.count("align_tolerance")) _alignToleranceNs = std::stoll(args.at("align_tolerance")) * 1000LL;
+
+    //everything else (fast-open settings, cache_ttl...) goes to every worker
+    std::vector<std::string> common;
+    for (const auto &arg : args)
+    {
+        if (arg.first == "driver" or arg.first == "aggregate" or arg.first == "worker" or
+            arg.first == "align_tolerance" or arg.first == "serial" or arg.first == "label") continue;
+        common.push_back(arg.first + "=" + arg.second);
+    }
+
+    //start all workers first, the devices then open in parallel
+    _channels.resize(serials.size());
+    for (size_t i = 0; i < serials.size(); i++)
+    {
+        Channel &ch = _channels[i];
+        ch.serial = serials[i];
+        ch.slotElems = 0;
+        ch.slotOffset = 0;
+        std::memset(&ch.meta, 0, sizeof(ch.meta));
+
+        std::vector<std::string> workerArgs(common);
+        workerArgs.push_back("serial=" + ch.serial);
+        workerArgs.push_back("shm_name=" + shmNameFor(i));
+        ch.worker.reset(new SoapySDRPlayWorkerProcess(path, workerArgs));
+    }
+    for (size_t i = 0; i < _channels.size(); i++)
+    {
+        Channel &ch = _channels[i];
+        try
+        {
+            ch.worker->waitReady();
+        }
+        catch (const std::exception &ex)
+        {
+            throw std::runtime_error("aggregate channel " + std::to_string(i) + " (" + ch.serial + "): " + ex.what());
+        }
+        ch.reader.reset(new SoapySDRPlayShmReader(shmNameFor(i)));
+        if (ch.reader->getFormat() != "CS16") throw std::runtime_error("aggregate worker stream is not CS16");
+        ch.slot.resize(ch.reader->getSlotBytes() / sizeof(short));
+    }
+}
+
+SoapySDRPlayAggregateDevice::~SoapySDRPlayAggregateDevice(void)
+{
+    //readers first, the workers unlink the segments on their way out
+    for (auto &ch : _channels) ch.reader.reset();
+    for (auto &ch : _channels) ch.worker.reset();
+}
+
+std::string SoapySDRPlayAggregateDevice::shmNameFor(const size_t channel) const
+{
+    //unique per device, several aggregates can run side by side
+    std::string name = "sdrplay_aggregate_";
+#ifndef _WIN32
+    name += std::to_string((long long)getpid()) + "_";
+#endif
+    return name + std::to_string((unsigned long long)(uintptr_t)this) + "_" + std::to_string(channel);
+}
+
+std::string SoapySDRPlayAggregateDevice::command(const size_t channel, const std::string &line) const
+{
+    return _channels.at(channel).worker->command(line);
+}
+
+/*******************************************************************
+ * Identification API
+ ******************************************************************/
+
+std::string SoapySDRPlayAggregateDevice::getDriverKey(void) const
+{
+    return "SDRplay";
+}
+
+std::string SoapySDRPlayAggregateDevice::getHardwareKey(void) const
+{
+    return "Aggregate";
+}
+
+SoapySDR::Kwargs SoapySDRPlayAggregateDevice::getHardwareInfo(void) const
+{
+    SoapySDR::Kwargs hwArgs;
+    std::string serials;
+    for (size_t i = 0; i < _channels.size(); i++)
+    {
+        serials += (i == 0 ? "" : ",") + _channels[i].serial;
+        hwArgs["channel" + std::to_string(i) + "_serial"] = _channels[i].serial;
+    }
+    hwArgs["aggregate"] = serials;
+    return hwArgs;
+}
+
+/*******************************************************************
+ * Channels API
+ ******************************************************************/
+
+size_t SoapySDRPlayAggregateDevice::getNumChannels(const int dir) const
+{
+    return (dir == SOAPY_SDR_RX) ? _channels.size() : 0;
+}
+
+/*******************************************************************
+ * Stream API
+ ******************************************************************/
+
+std::vector<std::string> SoapySDRPlayAggregateDevice::getStreamFormats(const int direction, const size_t channel) const
+{
+    std::vector<std::string> formats;
+
+    formats.push_back("CS16");
+    formats.push_back("CF32");
+
+    return formats;
+}
+
+std::string SoapySDRPlayAggregateDevice::getNativeStreamFormat(const int direction, const size_t channel, double &fullScale) const
+{
+    fullScale = 32767;
+    return "CS16";
+}
+
+SoapySDR::Stream *SoapySDRPlayAggregateDevice::setupStream(const int direction,
+                                                           const std::string &format,
+                                                           const std::vector<size_t> &channels,
+                                                           const SoapySDR::Kwargs &args)
+{
+    if (direction != SOAPY_SDR_RX) throw std::runtime_error("the aggregate device is receive only");
+    if (format != "CS16" and format != "CF32")
+    {
+        throw std::runtime_error("setupStream invalid format '" + format + "' -- Only CS16 or CF32 are supported by the SoapySDRPlay module.");
+    }
+
+    std::vector<size_t> streamChannels(channels);
+    if (streamChannels.empty())
+    {
+        for (size_t i = 0; i < _channels.size(); i++) streamChannels.push_back(i);
+    }
+    for (size_t i = 0; i < streamChannels.size(); i++)
+    {
+        if (streamChannels[i] >= _channels.size() or
+            std::count(streamChannels.begin(), streamChannels.end(), streamChannels[i]) != 1)
+        {
+            throw std::runtime_error("setupStream invalid channel selection");
+        }
+    }
+
+    _streamChannels = streamChannels;
+    _useShort = (format == "CS16");
+    _hostTime = (args.count("host_time") != 0) and (args.at("host_time") == "true");
+    _active = false;
+    return (SoapySDR::Stream *)this;
+}
+
+void SoapySDRPlayAggregateDevice::closeStream(SoapySDR::Stream *stream)
+{
+    _active = false;
+    _streamChannels.clear();
+}
+
+size_t SoapySDRPlayAggregateDevice::getStreamMTU(SoapySDR::Stream *stream) const
+{
+    size_t mtu = SIZE_MAX;
+    for (const auto &ch : _channels) mtu = std::min(mtu, ch.slot.size() / 2);
+    return mtu;
+}
+
+int SoapySDRPlayAggregateDevice::activateStream(SoapySDR::Stream *stream, const int flags, const long long timeNs, const size_t numElems)
+{
+    if (flags != 0) return SOAPY_SDR_NOT_SUPPORTED;
+
+    //sample by sample alignment needs one rate everywhere
+    const uint32_t rate = _channels.at(_streamChannels.at(0)).reader->getSampleRate();
+    for (const size_t i : _streamChannels)
+    {
+        if (_channels[i].reader->getSampleRate() != rate)
+        {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "aggregate channels run at different sample rates (%u, %u)",
+                          rate, _channels[i].reader->getSampleRate());
+            return SOAPY_SDR_STREAM_ERROR;
+        }
+    }
+
+    for (const size_t i : _streamChannels)
+    {
+        Channel &ch = _channels[i];
+        ch.reader->seekLatest();
+        ch.slotElems = 0;
+        ch.slotOffset = 0;
+    }
+    _aligned = false;
+    _active = true;
+    return 0;
+}
+
+int SoapySDRPlayAggregateDevice::deactivateStream(SoapySDR::Stream *stream, const int flags, const long long timeNs)
+{
+    if (flags != 0) return SOAPY_SDR_NOT_SUPPORTED;
+
+    _active = false;
+    return 0;
+}
+
+int SoapySDRPlayAggregateDevice::fillSlot(Channel &ch, const long timeoutUs)
+{
+    const int ret = ch.reader->read(ch.slot.data(), ch.meta, timeoutUs);
+    if (ret < 0)
+    {
+        if (ret == SOAPY_SDR_OVERFLOW) _aligned = false;
+        return ret;
+    }
+    ch.slotElems = ret / (2 * sizeof(short));
+    ch.slotOffset = 0;
+    return 0;
+}
+
+long long SoapySDRPlayAggregateDevice::nextTimeNs(const Channel &ch) const
+{
+    if (ch.meta.sampleRate == 0) return ch.meta.timeNs;
+    return ch.meta.timeNs + (long long)(ch.slotOffset * 1e9 / ch.meta.sampleRate);
+}
+
+int SoapySDRPlayAggregateDevice::align(const long timeoutUs)
+{
+    //the channel that started last sets the common start
+    long long target = LLONG_MIN;
+    for (const size_t i : _streamChannels)
+    {
+        Channel &ch = _channels[i];
+        if (ch.slotOffset == ch.slotElems)
+        {
+            const int ret = fillSlot(ch, timeoutUs);
+            if (ret != 0) return ret;
+        }
+        target = std::max(target, nextTimeNs(ch));
+    }
+
+    //the others skip the samples taken before it, to the nearest sample
+    for (const size_t i : _streamChannels)
+    {
+        Channel &ch = _channels[i];
+        for (;;)
+        {
+            if (ch.slotOffset == ch.slotElems)
+            {
+                const int ret = fillSlot(ch, timeoutUs);
+                if (ret != 0) return ret;
+            }
+            const long long ahead = target - nextTimeNs(ch);
+            const size_t skip = (ahead > 0) ? (size_t)(ahead * 1e-9 * ch.meta.sampleRate + 0.5) : 0;
+            if (skip == 0) break;
+            ch.slotOffset += std::min(skip, ch.slotElems - ch.slotOffset);
+        }
+    }
+
+    _aligned = true;
+    return 0;
+}
+
+int SoapySDRPlayAggregateDevice::readStream(SoapySDR::Stream *stream,
+                                            void * const *buffs,
+                                            const size_t numElems,
+                                            int &flags,
+                                            long long &timeNs,
+                                            const long timeoutUs)
+{
+    if (not _active) return 0;
+
+    if (not _aligned)
+    {
+        const int ret = align(timeoutUs);
+        if (ret != 0) return ret;
+    }
+
+    //as many samples as every channel has in its current slot,
+    //a timeout keeps the slots already read for the next call
+    size_t n = numElems;
+    for (const size_t i : _streamChannels)
+    {
+        Channel &ch = _channels[i];
+        if (ch.slotOffset == ch.slotElems)
+        {
+            const int ret = fillSlot(ch, timeoutUs);
+            if (ret != 0) return ret;
+        }
+        n = std::min(n, ch.slotElems - ch.slotOffset);
+    }
+
+    //oscillators drift and slots can be lost upstream, start over when
+    //the channels no longer sample together
+    const long long startNs = nextTimeNs(_channels[_streamChannels[0]]);
+    for (const size_t i : _streamChannels)
+    {
+        if (std::abs(nextTimeNs(_channels[i]) - startNs) > _alignToleranceNs)
+        {
+            _aligned = false;
+            _realignments++;
+            SoapySDR_log(SOAPY_SDR_SSI, "A");
+            return SOAPY_SDR_OVERFLOW;
+        }
+    }
+
+    for (size_t k = 0; k < _streamChannels.size(); k++)
+    {
+        Channel &ch = _channels[_streamChannels[k]];
+        const short *src = ch.slot.data() + 2 * ch.slotOffset;
+        if (_useShort) std::memcpy(buffs[k], src, n * 2 * sizeof(short));
+        else
+        {
+            float *dst = (float *)buffs[k];
+            for (size_t j = 0; j < 2 * n; j++) dst[j] = src[j] / 32768.0f;
+        }
+        ch.slotOffset += n;
+    }
+
+    flags = _hostTime ? SOAPY_SDR_HAS_TIME : 0;
+    timeNs = startNs;
+    return (int)n;
+}
+
+/*******************************************************************
+ * Antenna API
+ ******************************************************************/
+
+std::vector<std::string> SoapySDRPlayAggregateDevice::listAntennas(const int direction, const size_t channel) const
+{
+    return split(command(channel, "antennas"), ',');
+}
+
+void SoapySDRPlayAggregateDevice::setAntenna(const int direction, const size_t channel, const std::string &name)
+{
+    command(channel, "antenna " + name);
+}
+
+std::string SoapySDRPlayAggregateDevice::getAntenna(const int direction, const size_t channel) const
+{
+    return command(channel, "antenna");
+}
+
+/*******************************************************************
+ * Gain API
+ ******************************************************************/
+
+bool SoapySDRPlayAggregateDevice::hasGainMode(const int direction, const size_t channel) const
+{
+    return true;
+}
+
+void SoapySDRPlayAggregateDevice::setGainMode(const int direction, const size_t channel, const bool automatic)
+{
+    command(channel, std::string("gain_mode ") + (automatic ? "true" : "false"));
+}
+
+bool SoapySDRPlayAggregateDevice::getGainMode(const int direction, const size_t channel) const
+{
+    return command(channel, "gain_mode") == "true";
+}
+
+std::vector<std::string> SoapySDRPlayAggregateDevice::listGains(const int direction, const size_t channel) const
+{
+    return split(command(channel, "gains"), ',');
+}
+
+void SoapySDRPlayAggregateDevice::setGain(const int direction, const size_t channel, const double value)
+{
+    command(channel, "gain " + toString(value));
+}
+
+double SoapySDRPlayAggregateDevice::getGain(const int direction, const size_t channel) const
+{
+    return std::stod(command(channel, "gain"));
+}
+
+void SoapySDRPlayAggregateDevice::setGain(const int direction, const size_t channel, const std::string &name, const double value)
+{
+    command(channel, "gain_element " + name + " " + toString(value));
+}
+
+double SoapySDRPlayAggregateDevice::getGain(const int direction, const size_t channel, const std::string &name) const
+{
+    return std::stod(command(channel, "gain_element " + name));
+}
+
+SoapySDR::Range SoapySDRPlayAggregateDevice::getGainRange(const int direction, const size_t channel, const std::string &name) const
+{
+    const auto ranges = toRanges(command(channel, "gain_range " + name));
+    return ranges.empty() ? SoapySDR::Range() : ranges.front();
+}
+
+/*******************************************************************
+ * Frequency API
+ ******************************************************************/
+
+void SoapySDRPlayAggregateDevice::setFrequency(const int direction,
+                                               const size_t channel,
+                                               const double frequency,
+                                               const SoapySDR::Kwargs &args)
+{
+    command(channel, "frequency " + toString(frequency));
+}
+
+double SoapySDRPlayAggregateDevice::getFrequency(const int direction, const size_t channel) const
+{
+    return std::stod(command(channel, "frequency"));
+}
+
+SoapySDR::RangeList SoapySDRPlayAggregateDevice::getFrequencyRange(const int direction, const size_t channel) const
+{
+    return toRanges(command(channel, "frequency_range"));
+}
+
+/*******************************************************************
+ * Sample Rate API
+ ******************************************************************/
+
+void SoapySDRPlayAggregateDevice::setSampleRate(const int direction, const size_t channel, const double rate)
+{
+    command(channel, "rate " + toString(rate));
+}
+
+double SoapySDRPlayAggregateDevice::getSampleRate(const int direction, const size_t channel) const
+{
+    return std::stod(command(channel, "rate"));
+}
+
+std::vector<double> SoapySDRPlayAggregateDevice::listSampleRates(const int direction, const size_t channel) const
+{
+    std::vector<double> rates;
+    for (const auto &rate : split(command(channel, "rates"), ',')) rates.push_back(std::stod(rate));
+    return rates;
+}
+
+void SoapySDRPlayAggregateDevice::setBandwidth(const int direction, const size_t channel, const double bw)
+{
+    command(channel, "bandwidth " + toString(bw));
+}
+
+double SoapySDRPlayAggregateDevice::getBandwidth(const int direction, const size_t channel) const
+{
+    return std::stod(command(channel, "bandwidth"));
+}
+
+/*******************************************************************
+ * Settings API
+ ******************************************************************/
+
+void SoapySDRPlayAggregateDevice::writeSetting(const std::string &key, const std::string &value)
+{
+    for (size_t i = 0; i < _channels.size(); i++) command(i, "setting " + key + " " + value);
+}
+
+std::string SoapySDRPlayAggregateDevice::readSetting(const std::string &key) const
+{
+    if (key == "aggregate_status")
+    {
+        std::stringstream ss;
+        ss << "channels=" << _channels.size() << ", aligned=" << (_aligned ? "true" : "false")
+           << ", realignments=" << _realignments;
+        return ss.str();
+    }
+    return command(0, "setting " + key);
+}
+
+void SoapySDRPlayAggregateDevice::writeSetting(const int direction, const size_t channel, const std::string &key, const std::string &value)
+{
+    command(channel, "setting " + key + " " + value);
+}
+
+std::string SoapySDRPlayAggregateDevice::readSetting(const int direction, const size_t channel, const std::string &key) const
+{
+    return command(channel, "setting " + key);
+}
@@ -0,0 +1,240 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "SharedMemory.hpp"
+#include <SoapySDR/Device.hpp>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//Several RSPs as one multi-channel device, opened with aggregate=<serial>,...
+//mir_sdr API v2 streams a single device per process, so each RSP runs in a
+//worker process (SoapySDRPlayWorker) that broadcasts its samples into a
+//shared memory ring; this device reads the rings and forwards control to
+//the workers over a pipe. The channels are aligned on the host clock time
+//of their samples, the RSPs are not locked to a common reference, so the
+//alignment is only as good as the USB callback timing and the channels
+//drift apart with their oscillators until align_tolerance forces a realign.
+
+//installed next to the module unless the build says otherwise
+#ifndef SDRPLAY_WORKER_PATH
+#define SDRPLAY_WORKER_PATH "SoapySDRPlayWorker"
+#endif
+
+//time a worker gets to open its device and start streaming
+#define SDRPLAY_WORKER_START_MS  (10000)
+
+//allowed skew between the channels before they are realigned
+#define DEFAULT_ALIGN_TOLERANCE_US  (5000)
+
+class SoapySDRPlayWorkerProcess
+{
+public:
+    //starts the worker, it opens its device in the background
+    SoapySDRPlayWorkerProcess(const std::string &path, const std::vector<std::string> &args);
+
+    //closes its stdin, the worker stops the stream and exits
+    ~SoapySDRPlayWorkerProcess(void);
+
+    //until the worker streams, throws with its error
+    void waitReady(void);
+
+    //one command line, returns the value of "ok <value>", throws on "error"
+    std::string command(const std::string &line);
+
+private:
+    std::string readLine(const long timeoutMs);
+
+    void stop(void);
+
+    std::mutex _mutex;
+    int _pid;
+    //socket pair end, the worker has the other one as stdin and stdout
+    int _fd;
+    std::string _pending;
+};
+
+class SoapySDRPlayAggregateDevice : public SoapySDR::Device
+{
+public:
+    SoapySDRPlayAggregateDevice(const SoapySDR::Kwargs &args);
+
+    ~SoapySDRPlayAggregateDevice(void);
+
+    /*******************************************************************
+     * Identification API
+     ******************************************************************/
+
+    std::string getDriverKey(void) const;
+
+    std::string getHardwareKey(void) const;
+
+    SoapySDR::Kwargs getHardwareInfo(void) const;
+
+    /*******************************************************************
+     * Channels API
+     ******************************************************************/
+
+    size_t getNumChannels(const int dir) const;
+
+    /*******************************************************************
+     * Stream API
+     ******************************************************************/
+
+    std::vector<std::string> getStreamFormats(const int direction, const size_t channel) const;
+
+    std::string getNativeStreamFormat(const int direction, const size_t channel, double &fullScale) const;
+
+    SoapySDR::Stream *setupStream(const int direction,
+                                  const std::string &format,
+                                  const std::vector<size_t> &channels = std::vector<size_t>(),
+                                  const SoapySDR::Kwargs &args = SoapySDR::Kwargs());
+
+    void closeStream(SoapySDR::Stream *stream);
+
+    size_t getStreamMTU(SoapySDR::Stream *stream) const;
+
+    int activateStream(SoapySDR::Stream *stream,
+                       const int flags = 0,
+                       const long long timeNs = 0,
+                       const size_t numElems = 0);
+
+    int deactivateStream(SoapySDR::Stream *stream, const int flags = 0, const long long timeNs = 0);
+
+    int readStream(SoapySDR::Stream *stream,
+                   void * const *buffs,
+                   const size_t numElems,
+                   int &flags,
+                   long long &timeNs,
+                   const long timeoutUs = 200000);
+
+    /*******************************************************************
+     * Antenna API
+     ******************************************************************/
+
+    std::vector<std::string> listAntennas(const int direction, const size_t channel) const;
+
+    void setAntenna(const int direction, const size_t channel, const std::string &name);
+
+    std::string getAntenna(const int direction, const size_t channel) const;
+
+    /*******************************************************************
+     * Gain API
+     ******************************************************************/
+
+    bool hasGainMode(const int direction, const size_t channel) const;
+
+    void setGainMode(const int direction, const size_t channel, const bool automatic);
+
+    bool getGainMode(const int direction, const size_t channel) const;
+
+    std::vector<std::string> listGains(const int direction, const size_t channel) const;
+
+    void setGain(const int direction, const size_t channel, const double value);
+
+    double getGain(const int direction, const size_t channel) const;
+
+    void setGain(const int direction, const size_t channel, const std::string &name, const double value);
+
+    double getGain(const int direction, const size_t channel, const std::string &name) const;
+
+    SoapySDR::Range getGainRange(const int direction, const size_t channel, const std::string &name) const;
+
+    /*******************************************************************
+     * Frequency API
+     ******************************************************************/
+
+    void setFrequency(const int direction,
+                      const size_t channel,
+                      const double frequency,
+                      const SoapySDR::Kwargs &args = SoapySDR::Kwargs());
+
+    double getFrequency(const int direction, const size_t channel) const;
+
+    SoapySDR::RangeList getFrequencyRange(const int direction, const size_t channel) const;
+
+    /*******************************************************************
+     * Sample Rate API
+     ******************************************************************/
+
+    void setSampleRate(const int direction, const size_t channel, const double rate);
+
+    double getSampleRate(const int direction, const size_t channel) const;
+
+    std::vector<double> listSampleRates(const int direction, const size_t channel) const;
+
+    void setBandwidth(const int direction, const size_t channel, const double bw);
+
+    double getBandwidth(const int direction, const size_t channel) const;
+
+    /*******************************************************************
+     * Settings API
+     ******************************************************************/
+
+    void writeSetting(const std::string &key, const std::string &value);
+
+    std::string readSetting(const std::string &key) const;
+
+    void writeSetting(const int direction, const size_t channel, const std::string &key, const std::string &value);
+
+    std::string readSetting(const int direction, const size_t channel, const std::string &key) const;
+
+private:
+    struct Channel
+    {
+        std::string serial;
+        std::unique_ptr<SoapySDRPlayWorkerProcess> worker;
+        std::unique_ptr<SoapySDRPlayShmReader> reader;
+        std::vector<short> slot;
+        size_t slotElems;
+        size_t slotOffset;
+        SoapySDRPlayShmMeta meta;
+    };
+
+    std::string shmNameFor(const size_t channel) const;
+
+    std::string command(const size_t channel, const std::string &line) const;
+
+    //the next slot of a channel, returns 0 or a stream error
+    int fillSlot(Channel &ch, const long timeoutUs);
+
+    //host time of the next sample to be read from a channel
+    long long nextTimeNs(const Channel &ch) const;
+
+    //drop samples on the leading channels until all start together
+    int align(const long timeoutUs);
+
+    std::vector<Channel> _channels;
+    std::vector<size_t> _streamChannels;
+    bool _useShort;
+    //SOAPY_SDR_HAS_TIME on the source host's clock, opt-in by host_time=true
+    bool _hostTime;
+    bool _active;
+    bool _aligned;
+    long long _alignToleranceNs;
+    unsigned long long _realignments;
+};
@@ -0,0 +1,205 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "SoapySDRPlay.hpp"
+#include <cerrno>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+
+#define SDRPLAY_USB_DEV_PATH  "/dev/bus/usb"
+
+SoapySDRPlayDeviceCache &SoapySDRPlayDeviceCache::instance(void)
+{
+    static SoapySDRPlayDeviceCache cache;
+    return cache;
+}
+
+SoapySDRPlayDeviceCache::SoapySDRPlayDeviceCache(void):
+    _valid(false),
+    _hotplugRunning(false),
+    _wakeFd(-1)
+{
+}
+
+SoapySDRPlayDeviceCache::~SoapySDRPlayDeviceCache(void)
+{
+    if (not _hotplugThread.joinable()) return;
+
+    _hotplugRunning = false;
+#ifdef __linux__
+    const uint64_t one = 1;
+    if (write(_wakeFd, &one, sizeof(one)) < 0) {}
+#endif
+    _hotplugThread.join();
+#ifdef __linux__
+    close(_wakeFd);
+#endif
+}
+
+void SoapySDRPlayDeviceCache::scan(void)
+{
+    unsigned int nDevs = 0;
+    mir_sdr_DeviceT rspDevs[MAX_RSP_DEVICES];
+    if (mir_sdr_GetDevices(&rspDevs[0], &nDevs, MAX_RSP_DEVICES) != mir_sdr_Success) nDevs = 0;
+
+    _devices.clear();
+    for (unsigned int i = 0; i < nDevs; i++)
+    {
+        SoapySDRPlayDeviceInfo info;
+        info.serial = rspDevs[i].SerNo;
+        info.hwVer = rspDevs[i].hwVer;
+        info.devIdx = i;
+        info.devAvail = rspDevs[i].devAvail != 0;
+        _devices.push_back(info);
+    }
+    _scanTime = std::chrono::steady_clock::now();
+    _valid = true;
+}
+
+bool SoapySDRPlayDeviceCache::fresh(const double ttl) const
+{
+    if (not _valid or ttl <= 0.0) return false;
+    return std::chrono::steady_clock::now() - _scanTime < std::chrono::duration<double>(ttl);
+}
+
+std::vector<SoapySDRPlayDeviceInfo> SoapySDRPlayDeviceCache::getDevices(const double ttl)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (not fresh(ttl)) scan();
+    return _devices;
+}
+
+bool SoapySDRPlayDeviceCache::findDevice(const std::string &serial, const double ttl, SoapySDRPlayDeviceInfo &info)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    bool scanned = not fresh(ttl);
+    if (scanned) scan();
+
+    while (true)
+    {
+        for (const auto &dev : _devices)
+        {
+            if (dev.devAvail and dev.serial == serial)
+            {
+                info = dev;
+                return true;
+            }
+        }
+        // the device may have come up since the cached scan
+        if (scanned) return false;
+        scan();
+        scanned = true;
+    }
+}
+
+void SoapySDRPlayDeviceCache::invalidate(void)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _valid = false;
+}
+
+void SoapySDRPlayDeviceCache::startHotplug(void)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_hotplugThread.joinable()) return;
+
+#ifdef __linux__
+    _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wakeFd < 0)
+    {
+        SoapySDR_logf(SOAPY_SDR_WARNING, "Hotplug watcher unavailable: %s", strerror(errno));
+        return;
+    }
+    _hotplugRunning = true;
+    _hotplugThread = std::thread(&SoapySDRPlayDeviceCache::hotplug_loop, this);
+#else
+    SoapySDR_log(SOAPY_SDR_WARNING, "Hotplug watcher is only supported on Linux, the cache relies on cache_ttl");
+#endif
+}
+
+void SoapySDRPlayDeviceCache::hotplug_loop(void)
+{
+#ifdef __linux__
+    const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+    {
+        SoapySDR_logf(SOAPY_SDR_WARNING, "Hotplug watcher unavailable: %s", strerror(errno));
+        return;
+    }
+
+    // device nodes live one level down, in a directory per bus
+    const uint32_t mask = IN_CREATE | IN_DELETE;
+    inotify_add_watch(fd, SDRPLAY_USB_DEV_PATH, mask | IN_ONLYDIR);
+    if (DIR *dir = opendir(SDRPLAY_USB_DEV_PATH))
+    {
+        while (struct dirent *entry = readdir(dir))
+        {
+            if (entry->d_name[0] == '.') continue;
+            inotify_add_watch(fd, (std::string(SDRPLAY_USB_DEV_PATH "/") + entry->d_name).c_str(), mask);
+        }
+        closedir(dir);
+    }
+
+    struct pollfd fds[2];
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = _wakeFd;
+    fds[1].events = POLLIN;
+
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (_hotplugRunning)
+    {
+        const int ret = poll(fds, 2, -1);
+        if (ret < 0 and errno != EINTR) break;
+        if (not _hotplugRunning) break;
+
+        if (ret > 0 and (fds[0].revents & POLLIN))
+        {
+            ssize_t len;
+            while ((len = read(fd, events, sizeof(events))) > 0)
+            {
+                for (char *p = events; p < events + len; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len)
+                {
+                    const struct inotify_event *event = (const struct inotify_event *)p;
+                    // a new bus directory gets watched as well
+                    if ((event->mask & IN_ISDIR) and (event->mask & IN_CREATE) and event->len > 0)
+                    {
+                        inotify_add_watch(fd, (std::string(SDRPLAY_USB_DEV_PATH "/") + event->name).c_str(), mask);
+                    }
+                }
+            }
+            // the next getDevices()/findDevice() rescans on its own thread
+            SoapySDR_log(SOAPY_SDR_DEBUG, "USB devices changed, cache invalidated");
+            invalidate();
+        }
+    }
+    close(fd);
+#endif
+}
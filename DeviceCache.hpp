@@ -0,0 +1,90 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+//Process wide cache of the mir_sdr_GetDevices() list:
+//enumeration and device construction are served from the last scan
+//while it is younger than the caller's TTL, opening or closing a device
+//and the optional hotplug watcher (USB device nodes, Linux only)
+//invalidate it. The rescan always runs on the caller's thread: the
+//mir_sdr v2 API keeps per-process state that a background
+//mir_sdr_GetDevices() could disturb in the middle of a Reinit.
+
+//seconds a scan is reused for, "cache_ttl" enumeration argument
+#define DEFAULT_ENUM_CACHE_TTL  (1.0)
+
+struct SoapySDRPlayDeviceInfo
+{
+    std::string serial;
+    unsigned char hwVer;
+    unsigned int devIdx;
+    bool devAvail;
+};
+
+class SoapySDRPlayDeviceCache
+{
+public:
+    static SoapySDRPlayDeviceCache &instance(void);
+
+    ~SoapySDRPlayDeviceCache(void);
+
+    //the devices found by a scan no older than ttl seconds, ttl <= 0 always rescans
+    std::vector<SoapySDRPlayDeviceInfo> getDevices(const double ttl);
+
+    //an available device by serial, rescans once before giving up on a stale list
+    bool findDevice(const std::string &serial, const double ttl, SoapySDRPlayDeviceInfo &info);
+
+    //the next lookup scans again
+    void invalidate(void);
+
+    //watch the USB bus for device changes, idempotent
+    void startHotplug(void);
+
+private:
+    SoapySDRPlayDeviceCache(void);
+
+    //requires _mutex
+    void scan(void);
+
+    bool fresh(const double ttl) const;
+
+    void hotplug_loop(void);
+
+    std::mutex _mutex;
+    std::vector<SoapySDRPlayDeviceInfo> _devices;
+    std::chrono::steady_clock::time_point _scanTime;
+    bool _valid;
+
+    std::thread _hotplugThread;
+    std::atomic<bool> _hotplugRunning;
+    int _wakeFd;
+};
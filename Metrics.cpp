@@ -0,0 +1,487 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "Metrics.hpp"
+#include <SoapySDR/Logger.h>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+//most significant set bit of a non-zero value
+static inline int highestBit(const unsigned long long value)
+{
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while (value >> (bit + 1)) bit++;
+    return bit;
+#endif
+}
+
+//0..3 are exact, from then on four buckets per power of two
+static inline size_t bucketIndex(const unsigned long long value)
+{
+    if (value < 4) return (size_t)value;
+    const int bit = highestBit(value);
+    return bit * 4 + ((value >> (bit - 2)) & 3);
+}
+
+static inline double bucketUpperBound(const size_t index)
+{
+    if (index < 8) return (double)index;
+    const int bit = (int)(index / 4);
+    return std::ldexp((double)(5 + index % 4), bit - 2);
+}
+
+/*******************************************************************
+ * Histogram
+ ******************************************************************/
+
+SoapySDRPlayHistogram::SoapySDRPlayHistogram(void):
+    _count(0),
+    _sumNs(0)
+{
+    for (auto &count : _counts) count = 0;
+}
+
+void SoapySDRPlayHistogram::record(const long long valueNs)
+{
+    const unsigned long long value = (valueNs > 0) ? (unsigned long long)valueNs : 0;
+    _counts[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sumNs.fetch_add(value, std::memory_order_relaxed);
+}
+
+void SoapySDRPlayHistogram::snapshot(std::vector<unsigned long long> &counts, unsigned long long &count, unsigned long long &sumNs) const
+{
+    counts.resize(SDRPLAY_HISTOGRAM_BUCKETS);
+    for (size_t i = 0; i < SDRPLAY_HISTOGRAM_BUCKETS; i++) counts[i] = _counts[i].load(std::memory_order_relaxed);
+    count = _count.load(std::memory_order_relaxed);
+    sumNs = _sumNs.load(std::memory_order_relaxed);
+}
+
+double SoapySDRPlayHistogram::quantile(const std::vector<unsigned long long> &counts, const double q)
+{
+    unsigned long long total = 0;
+    for (const auto count : counts) total += count;
+    if (total == 0) return NAN;
+
+    const double rank = q * total;
+    unsigned long long seen = 0;
+    for (size_t i = 0; i < counts.size(); i++)
+    {
+        seen += counts[i];
+        if (seen >= rank and counts[i] != 0) return bucketUpperBound(i);
+    }
+    return bucketUpperBound(counts.size() - 1);
+}
+
+SoapySDRPlayMetrics::SoapySDRPlayMetrics(void):
+    publishedSamples(0),
+    droppedSamples(0),
+    droppedBuffers(0),
+    retunes(0),
+    overloads(0),
+    queuedBuffers(0),
+    ringBuffers(0),
+    retuneStartNs(0)
+{
+    return;
+}
+
+/*******************************************************************
+ * Text format
+ ******************************************************************/
+
+static std::string formatValue(const double value)
+{
+    if (std::isnan(value)) return "NaN";
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.9g", value);
+    return buf;
+}
+
+static void addFamily(std::string &text, const char *name, const char *type, const char *help)
+{
+    text += std::string("# TYPE ") + name + " " + type + "\n";
+    text += std::string("# HELP ") + name + " " + help + "\n";
+}
+
+static void addSample(std::string &text, const std::string &name, const std::string &labels, const double value)
+{
+    text += name + "{" + labels + "} " + formatValue(value) + "\n";
+}
+
+static void addSummary(std::string &text, const char *name, const char *help, const std::string &labels,
+                       const std::vector<unsigned long long> &delta, const unsigned long long count, const unsigned long long sumNs)
+{
+    addFamily(text, name, "summary", help);
+    for (const double q : {0.5, 0.9, 0.99})
+    {
+        char quantile[32];
+        std::snprintf(quantile, sizeof(quantile), ",quantile=\"%g\"", q);
+        addSample(text, name, labels + quantile, SoapySDRPlayHistogram::quantile(delta, q) / 1e9);
+    }
+    addSample(text, std::string(name) + "_sum", labels, sumNs / 1e9);
+    addSample(text, std::string(name) + "_count", labels, (double)count);
+}
+
+std::string SoapySDRPlayMetricsExporter::makeLabels(const std::string &serial, const std::string &hardware)
+{
+    const auto escape = [](const std::string &value) {
+        std::string out;
+        for (const char c : value)
+        {
+            if (c == '\\' or c == '"') out += '\\';
+            if (c == '\n') out += "\\n";
+            else out += c;
+        }
+        return out;
+    };
+    return "serial=\"" + escape(serial) + "\",hardware=\"" + escape(hardware) + "\"";
+}
+
+/*******************************************************************
+ * Exporter
+ ******************************************************************/
+
+SoapySDRPlayMetricsExporter::SoapySDRPlayMetricsExporter(const SoapySDRPlayMetrics &metrics, const GaugeFn &gauges,
+                                                         const std::string &labels, const std::string &endpoint,
+                                                         const std::string &path, const double interval):
+    _metrics(metrics),
+    _gauges(gauges),
+    _labels(labels),
+    _endpoint(endpoint),
+    _path(path),
+    _interval(std::max(interval, 0.1)),
+    _start(std::chrono::steady_clock::now()),
+    _listenFd(-1),
+    _scrapes(0),
+    _running(true)
+{
+    _prev.seconds = 0.0;
+    _prev.receivedSamples = _gauges().receivedSamples;
+    _prev.publishedSamples = _metrics.publishedSamples;
+    _prev.droppedSamples = _metrics.droppedSamples;
+    _prev.overloads = _metrics.overloads;
+    unsigned long long count, sumNs;
+    _metrics.callbackNs.snapshot(_prev.callbackCounts, count, sumNs);
+    _metrics.retuneNs.snapshot(_prev.retuneCounts, count, sumNs);
+
+    if (not endpoint.empty())
+    {
+#ifdef _WIN32
+        throw std::runtime_error("the metrics server is not supported on this platform");
+#else
+        int fd = -1;
+        if (endpoint.compare(0, 5, "unix:") == 0)
+        {
+            struct sockaddr_un addr;
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            const std::string unixPath = endpoint.substr(5);
+            if (unixPath.empty() or unixPath.size() >= sizeof(addr.sun_path)) throw std::runtime_error("bad socket path '" + unixPath + "'");
+            std::strncpy(addr.sun_path, unixPath.c_str(), sizeof(addr.sun_path) - 1);
+
+            // a socket left behind by an earlier run is replaced
+            unlink(unixPath.c_str());
+            fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0 or bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 or listen(fd, 8) != 0)
+            {
+                const int err = errno;
+                if (fd >= 0) close(fd);
+                throw std::runtime_error(endpoint + ": " + std::strerror(err));
+            }
+            _unixPath = unixPath;
+        }
+        else
+        {
+            const size_t colon = endpoint.rfind(':');
+            std::string host = (colon == std::string::npos) ? "" : endpoint.substr(0, colon);
+            const std::string port = (colon == std::string::npos) ? endpoint : endpoint.substr(colon + 1);
+            if (host.size() > 1 and host.front() == '[' and host.back() == ']') host = host.substr(1, host.size() - 2);
+
+            struct addrinfo hints;
+            std::memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            hints.ai_flags = AI_PASSIVE;
+            struct addrinfo *result = nullptr;
+            const int ret = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result);
+            if (ret != 0) throw std::runtime_error(endpoint + ": " + gai_strerror(ret));
+
+            int err = 0;
+            for (struct addrinfo *ai = result; ai != nullptr and fd < 0; ai = ai->ai_next)
+            {
+                fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+                if (fd < 0) { err = errno; continue; }
+                const int one = 1;
+                setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+                if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 and listen(fd, 8) == 0) break;
+                err = errno;
+                close(fd);
+                fd = -1;
+            }
+            freeaddrinfo(result);
+            if (fd < 0) throw std::runtime_error(endpoint + ": " + std::strerror(err));
+        }
+        _listenFd = fd;
+#endif
+    }
+
+    aggregate();
+    _thread = std::thread(&SoapySDRPlayMetricsExporter::exporter_loop, this);
+    SoapySDR_logf(SOAPY_SDR_INFO, "Metrics exporter%s%s%s%s every %gs",
+        endpoint.empty() ? "" : " on ", endpoint.c_str(), path.empty() ? "" : " to ", path.c_str(), _interval);
+}
+
+SoapySDRPlayMetricsExporter::~SoapySDRPlayMetricsExporter(void)
+{
+    {
+        std::lock_guard <std::mutex> lock(_mutex);
+        _running = false;
+    }
+    _cond.notify_one();
+    if (_thread.joinable()) _thread.join();
+
+#ifndef _WIN32
+    if (_listenFd >= 0) close(_listenFd);
+    if (not _unixPath.empty()) unlink(_unixPath.c_str());
+#endif
+}
+
+std::string SoapySDRPlayMetricsExporter::getText(void) const
+{
+    std::lock_guard <std::mutex> lock(_mutex);
+    return _text;
+}
+
+std::string SoapySDRPlayMetricsExporter::getStatus(void) const
+{
+    std::lock_guard <std::mutex> lock(_mutex);
+    char interval[32];
+    std::snprintf(interval, sizeof(interval), "%g", _interval);
+    return "endpoint=" + _endpoint +
+           ", file=" + _path +
+           ", interval=" + interval +
+           ", scrapes=" + std::to_string(_scrapes);
+}
+
+void SoapySDRPlayMetricsExporter::exporter_loop(void)
+{
+    auto next = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(_interval));
+
+    std::unique_lock <std::mutex> lock(_mutex);
+    while (_running)
+    {
+        if (std::chrono::steady_clock::now() >= next)
+        {
+            lock.unlock();
+            aggregate();
+            lock.lock();
+            next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(_interval));
+            continue;
+        }
+
+        if (_listenFd < 0)
+        {
+            _cond.wait_until(lock, next, [this]{ return not _running; });
+            continue;
+        }
+
+#ifndef _WIN32
+        // scrapes are served in between, checking for shutdown every 100ms
+        lock.unlock();
+        const long long untilNext = std::chrono::duration_cast<std::chrono::milliseconds>(next - std::chrono::steady_clock::now()).count();
+        struct pollfd pfd;
+        pfd.fd = _listenFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, (int)std::max(std::min(untilNext, 100LL), 0LL)) > 0)
+        {
+            const int fd = accept(_listenFd, nullptr, nullptr);
+            if (fd >= 0)
+            {
+                serveClient(fd);
+                close(fd);
+            }
+        }
+        lock.lock();
+#endif
+    }
+}
+
+void SoapySDRPlayMetricsExporter::aggregate(void)
+{
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+    const SoapySDRPlayMetricsGauges gauges = _gauges();
+    const unsigned long long published = _metrics.publishedSamples.load(std::memory_order_relaxed);
+    const unsigned long long dropped = _metrics.droppedSamples.load(std::memory_order_relaxed);
+    const unsigned long long overloads = _metrics.overloads.load(std::memory_order_relaxed);
+    const unsigned int queued = _metrics.queuedBuffers.load(std::memory_order_relaxed);
+    const unsigned int ring = _metrics.ringBuffers.load(std::memory_order_relaxed);
+
+    std::vector<unsigned long long> callbackCounts, retuneCounts;
+    unsigned long long callbackCount, callbackSumNs, retuneCount, retuneSumNs;
+    _metrics.callbackNs.snapshot(callbackCounts, callbackCount, callbackSumNs);
+    _metrics.retuneNs.snapshot(retuneCounts, retuneCount, retuneSumNs);
+
+    // rates and quantiles cover the last interval only
+    const double elapsed = seconds - _prev.seconds;
+    const unsigned long long received = gauges.receivedSamples - _prev.receivedSamples;
+    std::vector<unsigned long long> callbackDelta(callbackCounts), retuneDelta(retuneCounts);
+    for (size_t i = 0; i < SDRPLAY_HISTOGRAM_BUCKETS; i++)
+    {
+        callbackDelta[i] -= _prev.callbackCounts[i];
+        retuneDelta[i] -= _prev.retuneCounts[i];
+    }
+
+    std::string text;
+    addFamily(text, "sdrplay_sample_rate_hertz", "gauge", "Output sample rate");
+    addSample(text, "sdrplay_sample_rate_hertz", _labels, gauges.sampleRate);
+    addFamily(text, "sdrplay_frequency_hertz", "gauge", "Center frequency");
+    addSample(text, "sdrplay_frequency_hertz", _labels, gauges.centerFrequency);
+    addFamily(text, "sdrplay_if_gain_reduction_db", "gauge", "IF gain reduction");
+    addSample(text, "sdrplay_if_gain_reduction_db", _labels, gauges.gRdB);
+    addFamily(text, "sdrplay_lna_state", "gauge", "LNA state");
+    addSample(text, "sdrplay_lna_state", _labels, gauges.lnaState);
+
+    addFamily(text, "sdrplay_received_samples", "counter", "Samples received from the USB callback");
+    addSample(text, "sdrplay_received_samples_total", _labels, (double)gauges.receivedSamples);
+    addFamily(text, "sdrplay_delivered_samples", "counter", "Samples published to the stream readers");
+    addSample(text, "sdrplay_delivered_samples_total", _labels, (double)published);
+    addFamily(text, "sdrplay_dropped_samples", "counter", "Samples dropped for lack of a free buffer");
+    addSample(text, "sdrplay_dropped_samples_total", _labels, (double)dropped);
+    addFamily(text, "sdrplay_reader_dropped_buffers", "counter", "Buffers taken back from readers that fell behind");
+    addSample(text, "sdrplay_reader_dropped_buffers_total", _labels, (double)_metrics.droppedBuffers.load(std::memory_order_relaxed));
+    addFamily(text, "sdrplay_delivered_msps", "gauge", "Delivered rate over the last interval in MS/s");
+    addSample(text, "sdrplay_delivered_msps", _labels, (elapsed > 0.0) ? (published - _prev.publishedSamples) / elapsed / 1e6 : 0.0);
+    addFamily(text, "sdrplay_drop_ratio", "gauge", "Dropped over received samples in the last interval");
+    addSample(text, "sdrplay_drop_ratio", _labels, (received > 0) ? (double)(dropped - _prev.droppedSamples) / received : 0.0);
+    addFamily(text, "sdrplay_fifo_fill_ratio", "gauge", "Buffers queued for the slowest reader over ring buffers");
+    addSample(text, "sdrplay_fifo_fill_ratio", _labels, (ring > 0) ? (double)queued / ring : 0.0);
+
+    addSummary(text, "sdrplay_callback_duration_seconds", "USB callback run time, quantiles over the last interval",
+               _labels, callbackDelta, callbackCount, callbackSumNs);
+    addFamily(text, "sdrplay_retunes", "counter", "Frequency changes while streaming");
+    addSample(text, "sdrplay_retunes_total", _labels, (double)_metrics.retunes.load(std::memory_order_relaxed));
+    addSummary(text, "sdrplay_retune_latency_seconds", "Retune request to the first callback flagging it, quantiles over the last interval",
+               _labels, retuneDelta, retuneCount, retuneSumNs);
+
+    addFamily(text, "sdrplay_adc_overloads", "counter", "ADC overload events");
+    addSample(text, "sdrplay_adc_overloads_total", _labels, (double)overloads);
+    addFamily(text, "sdrplay_adc_overload_rate", "gauge", "ADC overload events per second over the last interval");
+    addSample(text, "sdrplay_adc_overload_rate", _labels, (elapsed > 0.0) ? (overloads - _prev.overloads) / elapsed : 0.0);
+    text += "# EOF\n";
+
+    _prev.seconds = seconds;
+    _prev.receivedSamples = gauges.receivedSamples;
+    _prev.publishedSamples = published;
+    _prev.droppedSamples = dropped;
+    _prev.overloads = overloads;
+    _prev.callbackCounts.swap(callbackCounts);
+    _prev.retuneCounts.swap(retuneCounts);
+
+    if (not _path.empty()) writeFile(text);
+
+    std::lock_guard <std::mutex> lock(_mutex);
+    _text.swap(text);
+}
+
+void SoapySDRPlayMetricsExporter::writeFile(const std::string &text)
+{
+    // collectors never see a half written file
+    const std::string tmpPath = _path + ".tmp";
+    FILE *fp = std::fopen(tmpPath.c_str(), "w");
+    bool ok = (fp != nullptr);
+    if (ok) ok = (std::fwrite(text.data(), 1, text.size(), fp) == text.size());
+    if (fp != nullptr and std::fclose(fp) != 0) ok = false;
+    if (ok) ok = (std::rename(tmpPath.c_str(), _path.c_str()) == 0);
+    if (not ok) SoapySDR_logf(SOAPY_SDR_WARNING, "metrics file %s not written: %s", _path.c_str(), strerror(errno));
+}
+
+void SoapySDRPlayMetricsExporter::serveClient(const int fd)
+{
+#ifndef _WIN32
+    // a stalled scraper holds the exporter for one second at most
+    struct timeval tv;
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    std::string request;
+    char buf[1024];
+    while (request.find("\r\n\r\n") == std::string::npos and request.size() < 8192)
+    {
+        const ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 and errno == EINTR) continue;
+        if (n <= 0) return;
+        request.append(buf, n);
+    }
+
+    std::string response;
+    if (request.compare(0, 4, "GET ") == 0)
+    {
+        const std::string text = getText();
+        response = "HTTP/1.1 200 OK\r\n"
+                   "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                   "Content-Length: " + std::to_string(text.size()) + "\r\n"
+                   "Connection: close\r\n\r\n" + text;
+        std::lock_guard <std::mutex> lock(_mutex);
+        _scrapes++;
+    }
+    else
+    {
+        response = "HTTP/1.1 405 Method Not Allowed\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    }
+
+    for (size_t off = 0; off < response.size();)
+    {
+        const ssize_t n = send(fd, response.data() + off, response.size() - off, MSG_NOSIGNAL);
+        if (n < 0 and errno == EINTR) continue;
+        if (n <= 0) return;
+        off += n;
+    }
+#endif
+}
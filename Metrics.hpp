@@ -0,0 +1,153 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <string>
+#include <vector>
+
+//Streaming metrics in OpenMetrics text format: the stream path only bumps
+//the lock-free counters and histograms of SoapySDRPlayMetrics, the exporter
+//thread turns them into rates and quantiles once per interval, serves the
+//result over HTTP on a TCP port or UNIX socket and/or writes it to a file.
+
+#define DEFAULT_METRICS_INTERVAL 5.0
+
+//log-linear buckets, four per power of two: quantiles within 25%
+#define SDRPLAY_HISTOGRAM_BUCKETS 256
+
+class SoapySDRPlayHistogram
+{
+public:
+    SoapySDRPlayHistogram(void);
+
+    void record(const long long valueNs);
+
+    //counts per bucket, plus the running count and sum
+    void snapshot(std::vector<unsigned long long> &counts, unsigned long long &count, unsigned long long &sumNs) const;
+
+    //upper bound of the bucket holding quantile q of the given counts, NaN without any
+    static double quantile(const std::vector<unsigned long long> &counts, const double q);
+
+private:
+    std::atomic<unsigned long long> _counts[SDRPLAY_HISTOGRAM_BUCKETS];
+    std::atomic<unsigned long long> _count;
+    std::atomic<unsigned long long> _sumNs;
+};
+
+//counters fed by the stream and control paths
+struct SoapySDRPlayMetrics
+{
+    SoapySDRPlayMetrics(void);
+
+    std::atomic<unsigned long long> publishedSamples;
+    std::atomic<unsigned long long> droppedSamples;
+    std::atomic<unsigned long long> droppedBuffers;
+    std::atomic<unsigned long long> retunes;
+    std::atomic<unsigned long long> overloads;
+    std::atomic<unsigned int> queuedBuffers;
+    std::atomic<unsigned int> ringBuffers;
+
+    //when the pending retune was issued, 0 when none is
+    std::atomic<long long> retuneStartNs;
+
+    SoapySDRPlayHistogram callbackNs;
+    SoapySDRPlayHistogram retuneNs;
+};
+
+//receiver state read by the exporter, from the lock-free snapshot
+struct SoapySDRPlayMetricsGauges
+{
+    double sampleRate;
+    double centerFrequency;
+    int gRdB;
+    int lnaState;
+    unsigned long long receivedSamples;
+};
+
+class SoapySDRPlayMetricsExporter
+{
+public:
+    typedef std::function<SoapySDRPlayMetricsGauges(void)> GaugeFn;
+
+    //endpoint is "[host:]port", "unix:<path>" or empty, path a file or empty, throws on errors
+    SoapySDRPlayMetricsExporter(const SoapySDRPlayMetrics &metrics, const GaugeFn &gauges,
+                                const std::string &labels, const std::string &endpoint,
+                                const std::string &path, const double interval);
+
+    ~SoapySDRPlayMetricsExporter(void);
+
+    //the text of the last interval
+    std::string getText(void) const;
+
+    std::string getStatus(void) const;
+
+    //serial="...",hardware="..." with the values escaped
+    static std::string makeLabels(const std::string &serial, const std::string &hardware);
+
+private:
+    struct Previous
+    {
+        double seconds;
+        unsigned long long receivedSamples;
+        unsigned long long publishedSamples;
+        unsigned long long droppedSamples;
+        unsigned long long overloads;
+        std::vector<unsigned long long> callbackCounts;
+        std::vector<unsigned long long> retuneCounts;
+    };
+
+    void exporter_loop(void);
+
+    void aggregate(void);
+
+    void writeFile(const std::string &text);
+
+    void serveClient(const int fd);
+
+    const SoapySDRPlayMetrics &_metrics;
+    const GaugeFn _gauges;
+    const std::string _labels;
+    const std::string _endpoint;
+    const std::string _path;
+    const double _interval;
+    const std::chrono::steady_clock::time_point _start;
+
+    Previous _prev;
+    int _listenFd;
+    std::string _unixPath;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _cond;
+    std::string _text;
+    unsigned long long _scrapes;
+    bool _running;
+    std::thread _thread;
+};
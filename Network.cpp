@@ -0,0 +1,919 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "Network.hpp"
+#include <SoapySDR/Logger.h>
+#include <SoapySDR/Formats.hpp>
+#include <SoapySDR/Errors.h>
+#include <stdexcept>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#ifndef MSG_MORE
+#define MSG_MORE 0
+#endif
+
+static_assert(sizeof(SoapySDRPlayNetFrame) == 40, "the frame header is a wire format");
+
+//values per Rice coded group (64 samples), each with its own predictor and parameter
+#define DELTA_GROUP  (128)
+
+//quotients from here on are escaped, the value follows in 17 bits
+#define DELTA_ESCAPE  (16)
+
+/*******************************************************************
+ * Codecs
+ ******************************************************************/
+
+SoapySDRPlayNetCodec SoapySDRPlayNet_parseCodec(const std::string &name)
+{
+    if (name == "cs16") return SDRPLAY_NET_CS16;
+    if (name == "cs8") return SDRPLAY_NET_CS8;
+    if (name == "delta") return SDRPLAY_NET_DELTA;
+    throw std::runtime_error("unknown stream codec '" + name + "', cs16, cs8 or delta");
+}
+
+std::string SoapySDRPlayNet_codecName(const SoapySDRPlayNetCodec codec)
+{
+    switch (codec)
+    {
+    case SDRPLAY_NET_CS8: return "cs8";
+    case SDRPLAY_NET_DELTA: return "delta";
+    default: return "cs16";
+    }
+}
+
+size_t SoapySDRPlayNet_maxPayload(const size_t numValues)
+{
+    //an escaped value takes 33 bits, plus one header byte per group
+    return numValues * 5 + numValues / DELTA_GROUP + 16;
+}
+
+//trailing ones of value, limit at most
+static inline unsigned int trailingOnes(const uint64_t value, const unsigned int limit)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(~value | (1ull << limit));
+#else
+    unsigned int n = 0;
+    while (n < limit and ((value >> n) & 1)) n++;
+    return n;
+#endif
+}
+
+//LSB first, at most 32 bits per put
+class BitWriter
+{
+public:
+    BitWriter(unsigned char *out): _out(out), _pos(0), _acc(0), _bits(0) {}
+
+    inline void put(const uint32_t value, const unsigned int bits)
+    {
+        _acc |= (uint64_t)value << _bits;
+        _bits += bits;
+        if (_bits >= 32)
+        {
+            for (int i = 0; i < 4; i++) _out[_pos++] = (unsigned char)(_acc >> (8 * i));
+            _acc >>= 32;
+            _bits -= 32;
+        }
+    }
+
+    size_t finish(void)
+    {
+        for (; _bits > 0; _bits = (_bits > 8) ? _bits - 8 : 0)
+        {
+            _out[_pos++] = (unsigned char)_acc;
+            _acc >>= 8;
+        }
+        return _pos;
+    }
+
+private:
+    unsigned char *_out;
+    size_t _pos;
+    uint64_t _acc;
+    unsigned int _bits;
+};
+
+class BitReader
+{
+public:
+    BitReader(const unsigned char *in, const size_t bytes): _in(in), _bytes(bytes), _pos(0), _acc(0), _bits(0) {}
+
+    inline uint32_t get(const unsigned int bits)
+    {
+        refill();
+        if (_bits < bits) throw std::runtime_error("truncated stream payload");
+        const uint32_t value = (uint32_t)(_acc & ((1ull << bits) - 1));
+        _acc >>= bits;
+        _bits -= bits;
+        return value;
+    }
+
+    //ones up to the first zero, which is consumed too, DELTA_ESCAPE at most
+    inline unsigned int unary(void)
+    {
+        refill();
+        const unsigned int q = trailingOnes(_acc, DELTA_ESCAPE);
+        const unsigned int used = (q < DELTA_ESCAPE) ? q + 1 : q;
+        if (used > _bits) throw std::runtime_error("truncated stream payload");
+        _acc >>= used;
+        _bits -= used;
+        return q;
+    }
+
+private:
+    inline void refill(void)
+    {
+        while (_bits <= 56 and _pos < _bytes)
+        {
+            _acc |= (uint64_t)_in[_pos++] << _bits;
+            _bits += 8;
+        }
+    }
+
+    const unsigned char *_in;
+    const size_t _bytes;
+    size_t _pos;
+    uint64_t _acc;
+    unsigned int _bits;
+};
+
+static inline uint32_t zigzag(const int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t unzigzag(const uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+//I/Q noise is often better sent as is, a tone or oversampled signal as
+//the difference to the previous sample of the same component: every
+//group takes whichever is smaller, then the Rice parameter for its mean
+static size_t encodeDelta(const short *in, const size_t numValues, unsigned char *out)
+{
+    BitWriter bits(out);
+    uint32_t plain[DELTA_GROUP], delta[DELTA_GROUP];
+    int32_t prev[2] = {0, 0};
+
+    for (size_t start = 0; start < numValues; start += DELTA_GROUP)
+    {
+        const size_t n = std::min((size_t)DELTA_GROUP, numValues - start);
+        uint64_t plainSum = 0, deltaSum = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            const int32_t value = in[start + i];
+            plain[i] = zigzag(value);
+            delta[i] = zigzag(value - prev[i & 1]);
+            prev[i & 1] = value;
+            plainSum += plain[i];
+            deltaSum += delta[i];
+        }
+
+        const bool useDelta = deltaSum < plainSum;
+        const uint32_t *values = useDelta ? delta : plain;
+        const uint64_t sum = useDelta ? deltaSum : plainSum;
+        unsigned int k = 0;
+        while (k < 16 and ((uint64_t)n << (k + 1)) <= sum) k++;
+        bits.put(k | (useDelta ? 0x80 : 0), 8);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            const uint32_t q = values[i] >> k;
+            if (q < DELTA_ESCAPE)
+            {
+                bits.put((1u << q) - 1, q + 1);
+                if (k > 0) bits.put(values[i] & ((1u << k) - 1), k);
+            }
+            else
+            {
+                bits.put((1u << DELTA_ESCAPE) - 1, DELTA_ESCAPE);
+                bits.put(values[i], 17);
+            }
+        }
+    }
+    return bits.finish();
+}
+
+static void decodeDelta(const unsigned char *in, const size_t bytes, const size_t numValues, short *out)
+{
+    BitReader bits(in, bytes);
+    int32_t prev[2] = {0, 0};
+
+    for (size_t start = 0; start < numValues; start += DELTA_GROUP)
+    {
+        const size_t n = std::min((size_t)DELTA_GROUP, numValues - start);
+        const uint32_t header = bits.get(8);
+        const bool useDelta = (header & 0x80) != 0;
+        const unsigned int k = header & 0x1f;
+        if (k > 16) throw std::runtime_error("malformed stream payload");
+
+        for (size_t i = 0; i < n; i++)
+        {
+            const unsigned int q = bits.unary();
+            const uint32_t u = (q < DELTA_ESCAPE) ? ((q << k) | (k > 0 ? bits.get(k) : 0)) : bits.get(17);
+            const int32_t value = unzigzag(u) + (useDelta ? prev[i & 1] : 0);
+            prev[i & 1] = value;
+            out[start + i] = (short)value;
+        }
+    }
+}
+
+size_t SoapySDRPlayNet_encode(const SoapySDRPlayNetCodec codec, const short *in, const size_t numValues, unsigned char *out)
+{
+    switch (codec)
+    {
+    case SDRPLAY_NET_CS8:
+        for (size_t i = 0; i < numValues; i++) out[i] = (unsigned char)(in[i] >> 8);
+        return numValues;
+    case SDRPLAY_NET_DELTA:
+        return encodeDelta(in, numValues, out);
+    default:
+        std::memcpy(out, in, numValues * sizeof(short));
+        return numValues * sizeof(short);
+    }
+}
+
+void SoapySDRPlayNet_decode(const SoapySDRPlayNetCodec codec, const unsigned char *in, const size_t bytes, const size_t numValues, short *out)
+{
+    switch (codec)
+    {
+    case SDRPLAY_NET_CS8:
+        if (bytes != numValues) throw std::runtime_error("malformed stream payload");
+        for (size_t i = 0; i < numValues; i++) out[i] = (short)((signed char)in[i] * 256);
+        return;
+    case SDRPLAY_NET_DELTA:
+        decodeDelta(in, bytes, numValues, out);
+        return;
+    case SDRPLAY_NET_CS16:
+        if (bytes != numValues * sizeof(short)) throw std::runtime_error("malformed stream payload");
+        std::memcpy(out, in, bytes);
+        return;
+    default:
+        throw std::runtime_error("unknown stream codec");
+    }
+}
+
+/*******************************************************************
+ * Sockets
+ ******************************************************************/
+
+#ifndef _WIN32
+//"[address:]port", IPv6 addresses in brackets
+static void splitEndpoint(const std::string &endpoint, std::string &host, std::string &port)
+{
+    const size_t colon = endpoint.rfind(':');
+    host = (colon == std::string::npos) ? "" : endpoint.substr(0, colon);
+    port = (colon == std::string::npos) ? endpoint : endpoint.substr(colon + 1);
+    if (host.size() > 1 and host.front() == '[' and host.back() == ']') host = host.substr(1, host.size() - 2);
+    if (port.empty()) throw std::runtime_error("no port in '" + endpoint + "'");
+}
+
+//connected (client) or bound and listening (server) socket
+static int openSocket(const std::string &endpoint, const bool server)
+{
+    std::string host, port;
+    splitEndpoint(endpoint, host, port);
+
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = server ? AI_PASSIVE : 0;
+    struct addrinfo *result = nullptr;
+    const int ret = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result);
+    if (ret != 0) throw std::runtime_error(endpoint + ": " + gai_strerror(ret));
+
+    int fd = -1;
+    int err = 0;
+    for (struct addrinfo *ai = result; ai != nullptr and fd < 0; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) { err = errno; continue; }
+
+        const int one = 1;
+        if (server) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        const bool ok = server ?
+            (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 and listen(fd, 8) == 0) :
+            (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0);
+        if (ok) break;
+        err = errno;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    if (fd < 0) throw std::runtime_error(endpoint + ": " + std::strerror(err));
+    return fd;
+}
+
+static bool sendAll(const int fd, const void *data, const size_t bytes, const int flags)
+{
+    for (size_t off = 0; off < bytes;)
+    {
+        const ssize_t n = send(fd, (const char *)data + off, bytes - off, flags | MSG_NOSIGNAL);
+        if (n < 0 and errno == EINTR) continue;
+        if (n <= 0) return false;
+        off += n;
+    }
+    return true;
+}
+#endif
+
+/*******************************************************************
+ * Server
+ ******************************************************************/
+
+SoapySDRPlayNetServer::SoapySDRPlayNetServer(const std::string &endpoint, const SoapySDRPlayNetCodec codec, const ReleaseFn &release):
+    _endpoint(endpoint),
+    _codec(codec),
+    _release(release),
+    _listenFd(-1),
+    _frames(0),
+    _rawBytes(0),
+    _sentBytes(0),
+    _zcCopied(0),
+    _skipped(0),
+    _numClients(0),
+    _held(0),
+    _running(true)
+{
+#ifdef _WIN32
+    throw std::runtime_error("the streaming server is not supported on this platform");
+#else
+    _listenFd = openSocket(endpoint, true);
+    fcntl(_listenFd, F_SETFL, fcntl(_listenFd, F_GETFL) | O_NONBLOCK);
+    _thread = std::thread(&SoapySDRPlayNetServer::server_loop, this);
+    SoapySDR_logf(SOAPY_SDR_INFO, "Streaming server on %s (%s)", endpoint.c_str(), SoapySDRPlayNet_codecName(codec).c_str());
+#endif
+}
+
+SoapySDRPlayNetServer::~SoapySDRPlayNetServer(void)
+{
+    {
+        std::lock_guard <std::mutex> lock(_mutex);
+        _running = false;
+    }
+    _cond.notify_one();
+    if (_thread.joinable()) _thread.join();
+
+    //whatever the thread didn't get to
+    for (const auto &block : _queue)
+    {
+        _held--;
+        _release(block.handle);
+    }
+    _queue.clear();
+
+#ifndef _WIN32
+    while (not _clients.empty()) dropClient(_clients.size() - 1);
+    if (_listenFd >= 0) close(_listenFd);
+#endif
+}
+
+bool SoapySDRPlayNetServer::push(const Block &block)
+{
+    //nobody to send to, or still busy: the buffer goes back to the ring
+    if (_numClients == 0) return false;
+    if (_held >= SDRPLAY_NET_MAX_BLOCKS)
+    {
+        _skipped++;
+        return false;
+    }
+
+    {
+        std::lock_guard <std::mutex> lock(_mutex);
+        if (not _running) return false;
+        _queue.push_back(block);
+        _held++;
+    }
+    _cond.notify_one();
+    return true;
+}
+
+std::string SoapySDRPlayNetServer::getStatus(void) const
+{
+    const unsigned long long sent = _sentBytes;
+    char ratio[32];
+    std::snprintf(ratio, sizeof(ratio), "%.3f", sent ? (double)_rawBytes / sent : 0.0);
+    return "endpoint=" + _endpoint +
+           ", codec=" + SoapySDRPlayNet_codecName(_codec) +
+           ", clients=" + std::to_string(_numClients) +
+           ", frames=" + std::to_string(_frames) +
+           ", sent_bytes=" + std::to_string(sent) +
+           ", compression=" + ratio +
+           ", zerocopy_copied=" + std::to_string(_zcCopied) +
+           ", skipped=" + std::to_string(_skipped);
+}
+
+void SoapySDRPlayNetServer::server_loop(void)
+{
+#ifndef _WIN32
+    std::unique_lock <std::mutex> lock(_mutex);
+
+    while (_running)
+    {
+        //completions are only seen by polling, often while sends are in flight
+        bool pending = false;
+        for (const auto &client : _clients) pending = pending or not client.zcPending.empty();
+        _cond.wait_for(lock, std::chrono::milliseconds(pending ? 1 : 50), [this]{
+            return not _running or not _queue.empty();
+        });
+        if (not _running) break;
+
+        lock.unlock();
+        acceptClients();
+        for (auto &client : _clients) reapCompletions(client);
+        lock.lock();
+
+        while (_running and not _queue.empty())
+        {
+            const Block block = _queue.front();
+            _queue.pop_front();
+            lock.unlock();
+            sendBlock(block);
+            lock.lock();
+        }
+    }
+#endif
+}
+
+void SoapySDRPlayNetServer::acceptClients(void)
+{
+#ifndef _WIN32
+    for (;;)
+    {
+        struct sockaddr_storage addr;
+        socklen_t addrLen = sizeof(addr);
+        const int fd = accept(_listenFd, (struct sockaddr *)&addr, &addrLen);
+        if (fd < 0) break;
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+        //a stalled client is dropped rather than stalling the others
+        struct timeval tv;
+        tv.tv_sec = SDRPLAY_NET_SEND_TIMEOUT_MS / 1000;
+        tv.tv_usec = (SDRPLAY_NET_SEND_TIMEOUT_MS % 1000) * 1000;
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        Client client;
+        client.fd = fd;
+        client.zeroCopy = false;
+        client.zcSeq = 0;
+#ifdef SO_ZEROCOPY
+        const int one = 1;
+        client.zeroCopy = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+#endif
+        char host[NI_MAXHOST], port[NI_MAXSERV];
+        if (getnameinfo((struct sockaddr *)&addr, addrLen, host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) == 0)
+        {
+            client.peer = std::string(host) + ":" + port;
+        }
+        SoapySDR_logf(SOAPY_SDR_INFO, "Streaming to %s%s", client.peer.c_str(), client.zeroCopy ? " (zero copy)" : "");
+        _clients.push_back(client);
+        _numClients = _clients.size();
+    }
+#endif
+}
+
+void SoapySDRPlayNetServer::sendBlock(const Block &block)
+{
+    //the ring buffer goes back once no send points into it anymore
+    const size_t handle = block.handle;
+    std::shared_ptr<void> hold(nullptr, [this, handle](void *){
+        _held--;
+        _release(handle);
+    });
+
+    const size_t numValues = block.numSamples * 2;
+    const short *samples = (const short *)block.data;
+    if (block.isFloat)
+    {
+        const float *src = (const float *)block.data;
+        _scratch16.resize(numValues);
+        for (size_t i = 0; i < numValues; i++)
+        {
+            _scratch16[i] = (short)std::max(-32768.0f, std::min(32767.0f, src[i] * 32768.0f));
+        }
+        samples = _scratch16.data();
+    }
+
+    SoapySDRPlayNetFrame frame;
+    frame.magic = SDRPLAY_NET_MAGIC;
+    frame.codec = _codec;
+    frame.overload = block.overload ? 1 : 0;
+    frame.numSamples = (uint32_t)block.numSamples;
+    frame.sampleCount = block.sampleCount;
+    frame.timeNs = block.timeNs;
+    frame.centerFrequency = block.centerFrequency;
+    frame.sampleRate = block.sampleRate;
+
+    //CS16 from a CS16 ring is sent in place, everything else is encoded once for all
+    bool inPlace = (_codec == SDRPLAY_NET_CS16) and not block.isFloat;
+    const void *payload = samples;
+    if (inPlace)
+    {
+        frame.payloadBytes = (uint32_t)(numValues * sizeof(short));
+    }
+    else
+    {
+        _payload.resize(SoapySDRPlayNet_maxPayload(numValues));
+        frame.payloadBytes = (uint32_t)SoapySDRPlayNet_encode(_codec, samples, numValues, _payload.data());
+        payload = _payload.data();
+    }
+
+    //noise-like blocks can grow a little, they go out uncompressed instead
+    if (frame.codec == SDRPLAY_NET_DELTA and frame.payloadBytes >= numValues * sizeof(short))
+    {
+        frame.codec = SDRPLAY_NET_CS16;
+        frame.payloadBytes = (uint32_t)(numValues * sizeof(short));
+        payload = samples;
+        inPlace = not block.isFloat;
+    }
+
+    for (size_t i = 0; i < _clients.size();)
+    {
+        if (sendFrame(_clients[i], frame, payload, inPlace ? hold : std::shared_ptr<void>())) i++;
+        else dropClient(i);
+    }
+
+    _frames++;
+    _rawBytes += numValues * sizeof(short);
+    _sentBytes += sizeof(frame) + frame.payloadBytes;
+}
+
+bool SoapySDRPlayNetServer::sendFrame(Client &client, const SoapySDRPlayNetFrame &frame, const void *payload, const std::shared_ptr<void> &hold)
+{
+#ifndef _WIN32
+    //the header is small and copied, the payload may be mapped by the kernel
+    if (not sendAll(client.fd, &frame, sizeof(frame), MSG_MORE)) return false;
+
+    bool zeroCopy = client.zeroCopy and hold;
+    for (size_t off = 0; off < frame.payloadBytes;)
+    {
+        struct iovec iov;
+        iov.iov_base = (char *)payload + off;
+        iov.iov_len = frame.payloadBytes - off;
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+
+        int flags = MSG_NOSIGNAL;
+#ifdef MSG_ZEROCOPY
+        if (zeroCopy) flags |= MSG_ZEROCOPY;
+#endif
+        const ssize_t n = sendmsg(client.fd, &msg, flags);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            //out of pinned memory allowance: this send is copied
+            if (errno == ENOBUFS and zeroCopy)
+            {
+                zeroCopy = false;
+                continue;
+            }
+            return false;
+        }
+        if (zeroCopy) client.zcPending.push_back(std::make_pair(client.zcSeq++, hold));
+        off += n;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void SoapySDRPlayNetServer::reapCompletions(Client &client)
+{
+#if defined(__linux__) && defined(SO_EE_ORIGIN_ZEROCOPY)
+    while (not client.zcPending.empty())
+    {
+        char control[128];
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(client.fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (not ((cm->cmsg_level == IPPROTO_IP and cm->cmsg_type == IP_RECVERR) or
+                     (cm->cmsg_level == IPPROTO_IPV6 and cm->cmsg_type == IPV6_RECVERR))) continue;
+
+            //sends ee_info to ee_data are done with the memory
+            const struct sock_extended_err *err = (const struct sock_extended_err *)CMSG_DATA(cm);
+            if (err->ee_errno != 0 or err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) _zcCopied += err->ee_data - err->ee_info + 1;
+            while (not client.zcPending.empty() and (int32_t)(client.zcPending.front().first - err->ee_data) <= 0)
+            {
+                client.zcPending.pop_front();
+            }
+        }
+    }
+#endif
+}
+
+void SoapySDRPlayNetServer::dropClient(const size_t index)
+{
+#ifndef _WIN32
+    SoapySDR_logf(SOAPY_SDR_INFO, "Streaming to %s stopped", _clients[index].peer.c_str());
+    close(_clients[index].fd);
+#endif
+    _clients.erase(_clients.begin() + index);
+    _numClients = _clients.size();
+}
+
+/*******************************************************************
+ * Client device
+ ******************************************************************/
+
+SoapySDRPlayNetDevice::SoapySDRPlayNetDevice(const SoapySDR::Kwargs &args):
+    _endpoint(args.at("net")),
+    _fd(-1),
+    _useShort(true),
+    _hostTime(false),
+    _active(false),
+    _rx(sizeof(SoapySDRPlayNetFrame)),
+    _rxBytes(0),
+    _sampleOffset(0),
+    _nextSampleCount(0),
+    _receivedBytes(0),
+    _gaps(0)
+{
+#ifdef _WIN32
+    throw std::runtime_error("the streaming client is not supported on this platform");
+#else
+    _fd = openSocket(_endpoint, false);
+#endif
+    std::memset(&_frame, 0, sizeof(_frame));
+}
+
+SoapySDRPlayNetDevice::~SoapySDRPlayNetDevice(void)
+{
+#ifndef _WIN32
+    if (_fd >= 0) close(_fd);
+#endif
+}
+
+std::string SoapySDRPlayNetDevice::getDriverKey(void) const
+{
+    return "SDRplay";
+}
+
+std::string SoapySDRPlayNetDevice::getHardwareKey(void) const
+{
+    return "Network";
+}
+
+SoapySDR::Kwargs SoapySDRPlayNetDevice::getHardwareInfo(void) const
+{
+    SoapySDR::Kwargs hwArgs;
+    hwArgs["net"] = _endpoint;
+    return hwArgs;
+}
+
+size_t SoapySDRPlayNetDevice::getNumChannels(const int dir) const
+{
+    return (dir == SOAPY_SDR_RX) ? 1 : 0;
+}
+
+std::vector<std::string> SoapySDRPlayNetDevice::getStreamFormats(const int direction, const size_t channel) const
+{
+    std::vector<std::string> formats;
+
+    formats.push_back("CS16");
+    formats.push_back("CF32");
+
+    return formats;
+}
+
+std::string SoapySDRPlayNetDevice::getNativeStreamFormat(const int direction, const size_t channel, double &fullScale) const
+{
+    fullScale = 32767;
+    return "CS16";
+}
+
+SoapySDR::Stream *SoapySDRPlayNetDevice::setupStream(const int direction,
+                                                     const std::string &format,
+                                                     const std::vector<size_t> &channels,
+                                                     const SoapySDR::Kwargs &args)
+{
+    if (direction != SOAPY_SDR_RX) throw std::runtime_error("the network stream is receive only");
+    if (channels.size() > 1 or (channels.size() > 0 and channels.at(0) != 0))
+    {
+        throw std::runtime_error("setupStream invalid channel selection");
+    }
+    if (format != "CS16" and format != "CF32")
+    {
+        throw std::runtime_error("setupStream invalid format '" + format + "' -- Only CS16 or CF32 are supported by the SoapySDRPlay module.");
+    }
+
+    _useShort = (format == "CS16");
+    _hostTime = (args.count("host_time") != 0) and (args.at("host_time") == "true");
+    return (SoapySDR::Stream *)this;
+}
+
+void SoapySDRPlayNetDevice::closeStream(SoapySDR::Stream *stream)
+{
+    _active = false;
+}
+
+size_t SoapySDRPlayNetDevice::getStreamMTU(SoapySDR::Stream *stream) const
+{
+    return _frame.numSamples ? _frame.numSamples : 65536;
+}
+
+int SoapySDRPlayNetDevice::activateStream(SoapySDR::Stream *stream, const int flags, const long long timeNs, const size_t numElems)
+{
+    if (flags != 0) return SOAPY_SDR_NOT_SUPPORTED;
+
+    _active = true;
+    return 0;
+}
+
+int SoapySDRPlayNetDevice::deactivateStream(SoapySDR::Stream *stream, const int flags, const long long timeNs)
+{
+    if (flags != 0) return SOAPY_SDR_NOT_SUPPORTED;
+
+    _active = false;
+    return 0;
+}
+
+int SoapySDRPlayNetDevice::receiveFrame(const long timeoutUs)
+{
+#ifndef _WIN32
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs);
+
+    //the header, then the payload it announces
+    for (;;)
+    {
+        size_t need = sizeof(SoapySDRPlayNetFrame);
+        if (_rxBytes >= need)
+        {
+            std::memcpy(&_frame, _rx.data(), sizeof(_frame));
+            if (_frame.magic != SDRPLAY_NET_MAGIC)
+            {
+                SoapySDR_log(SOAPY_SDR_ERROR, "Lost the stream framing");
+                return SOAPY_SDR_STREAM_ERROR;
+            }
+            //sizes come from the wire, checked before anything is allocated for them
+            if (_frame.numSamples > SDRPLAY_NET_MAX_FRAME_SAMPLES or
+                _frame.payloadBytes > SoapySDRPlayNet_maxPayload(2 * (size_t)_frame.numSamples))
+            {
+                SoapySDR_logf(SOAPY_SDR_ERROR, "Stream from %s: bad frame of %u samples in %u bytes",
+                              _endpoint.c_str(), _frame.numSamples, _frame.payloadBytes);
+                return SOAPY_SDR_STREAM_ERROR;
+            }
+            need += _frame.payloadBytes;
+            if (_rx.size() < need) _rx.resize(need);
+        }
+        if (_rxBytes == need) break;
+
+        const long leftUs = (long)std::chrono::duration_cast<std::chrono::microseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        struct pollfd pfd = {_fd, POLLIN, 0};
+        const int ret = (leftUs > 0) ? poll(&pfd, 1, (int)((leftUs + 999) / 1000)) : 0;
+        if (ret < 0 and errno == EINTR) continue;
+        if (ret <= 0) return SOAPY_SDR_TIMEOUT;
+
+        const ssize_t n = recv(_fd, _rx.data() + _rxBytes, need - _rxBytes, 0);
+        if (n < 0 and errno == EINTR) continue;
+        if (n <= 0)
+        {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "Stream from %s closed", _endpoint.c_str());
+            return SOAPY_SDR_STREAM_ERROR;
+        }
+        _rxBytes += n;
+    }
+    _receivedBytes += _rxBytes;
+    _rxBytes = 0;
+
+    _samples.resize(2 * _frame.numSamples);
+    try
+    {
+        SoapySDRPlayNet_decode((SoapySDRPlayNetCodec)_frame.codec, _rx.data() + sizeof(_frame),
+                               _frame.payloadBytes, _samples.size(), _samples.data());
+    }
+    catch (const std::exception &ex)
+    {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "Stream from %s: %s", _endpoint.c_str(), ex.what());
+        _samples.clear();
+        return SOAPY_SDR_STREAM_ERROR;
+    }
+    _sampleOffset = 0;
+
+    //the server skipped buffers, reported once before this frame is read
+    const bool gap = (_nextSampleCount != 0) and (_frame.sampleCount != _nextSampleCount);
+    _nextSampleCount = _frame.sampleCount + _frame.numSamples;
+    if (gap)
+    {
+        _gaps++;
+        return SOAPY_SDR_OVERFLOW;
+    }
+    return 0;
+#else
+    return SOAPY_SDR_NOT_SUPPORTED;
+#endif
+}
+
+int SoapySDRPlayNetDevice::readStream(SoapySDR::Stream *stream,
+                                      void * const *buffs,
+                                      const size_t numElems,
+                                      int &flags,
+                                      long long &timeNs,
+                                      const long timeoutUs)
+{
+    if (not _active) return 0;
+
+    if (2 * _sampleOffset == _samples.size())
+    {
+        const int ret = receiveFrame(timeoutUs);
+        if (ret < 0) return ret;
+    }
+
+    const size_t n = std::min(numElems, _samples.size() / 2 - _sampleOffset);
+    const short *src = _samples.data() + 2 * _sampleOffset;
+    if (_useShort) std::memcpy(buffs[0], src, n * 2 * sizeof(short));
+    else
+    {
+        float *dst = (float *)buffs[0];
+        for (size_t i = 0; i < 2 * n; i++) dst[i] = src[i] / 32768.0f;
+    }
+
+    //the server's host clock, a later fragment starts that many periods after the frame
+    flags = _hostTime ? SOAPY_SDR_HAS_TIME : 0;
+    timeNs = _frame.timeNs + (_frame.sampleRate ? (long long)(_sampleOffset * 1e9 / _frame.sampleRate) : 0);
+    _sampleOffset += n;
+    return (int)n;
+}
+
+double SoapySDRPlayNetDevice::getFrequency(const int direction, const size_t channel) const
+{
+    return _frame.centerFrequency;
+}
+
+double SoapySDRPlayNetDevice::getSampleRate(const int direction, const size_t channel) const
+{
+    return _frame.sampleRate;
+}
+
+std::vector<double> SoapySDRPlayNetDevice::listSampleRates(const int direction, const size_t channel) const
+{
+    return std::vector<double>(1, _frame.sampleRate);
+}
+
+std::string SoapySDRPlayNetDevice::readSetting(const std::string &key) const
+{
+    if (key == "net_status")
+    {
+        std::stringstream ss;
+        ss << "endpoint=" << _endpoint << ", codec=" << SoapySDRPlayNet_codecName((SoapySDRPlayNetCodec)_frame.codec)
+           << ", received_bytes=" << _receivedBytes << ", gaps=" << _gaps;
+        return ss.str();
+    }
+    return "";
+}
@@ -0,0 +1,250 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <SoapySDR/Device.hpp>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <deque>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//TCP streaming server fed with stream buffers straight from the ring:
+//every published buffer goes out to each connected client as a frame
+//header followed by the samples. Uncompressed CS16 is sent from the ring
+//with MSG_ZEROCOPY where the kernel supports it, the buffer is handed
+//back once the kernel reports the send complete. The server holds at
+//most SDRPLAY_NET_MAX_BLOCKS buffers, it skips buffers rather than
+//holding the receiver back, clients see the gap in sampleCount.
+
+#define SDRPLAY_NET_MAGIC       (0x46524453u)
+#define SDRPLAY_NET_MAX_BLOCKS  (2)
+
+//a client that can't take a frame within this time is disconnected
+#define SDRPLAY_NET_SEND_TIMEOUT_MS  (1000)
+
+//largest frame a client accepts, far above any ring buffer
+#define SDRPLAY_NET_MAX_FRAME_SAMPLES  (1 << 22)
+
+enum SoapySDRPlayNetCodec
+{
+    //interleaved 16 bit I/Q
+    SDRPLAY_NET_CS16 = 0,
+    //the upper 8 bits of each sample, lossy
+    SDRPLAY_NET_CS8 = 1,
+    //lossless: per 64 samples, plain or previous sample prediction, Rice coded
+    SDRPLAY_NET_DELTA = 2,
+};
+
+//sent in host byte order, as is the CS16 payload that goes out straight
+//from the ring: server and client must share it, a mismatch shows as a
+//bad magic. Followed by payloadBytes of samples.
+struct SoapySDRPlayNetFrame
+{
+    uint32_t magic;
+    uint16_t codec;
+    uint16_t overload;
+    uint32_t numSamples;
+    uint32_t payloadBytes;
+    uint64_t sampleCount;
+    //host steady clock time of the first sample on the server
+    int64_t timeNs;
+    uint32_t centerFrequency;
+    uint32_t sampleRate;
+};
+
+//"cs16", "cs8" or "delta", throws otherwise
+SoapySDRPlayNetCodec SoapySDRPlayNet_parseCodec(const std::string &name);
+
+std::string SoapySDRPlayNet_codecName(const SoapySDRPlayNetCodec codec);
+
+//worst case encoded size of numValues shorts
+size_t SoapySDRPlayNet_maxPayload(const size_t numValues);
+
+//numValues shorts (2 per sample) into out, returns the byte count
+size_t SoapySDRPlayNet_encode(const SoapySDRPlayNetCodec codec, const short *in, const size_t numValues, unsigned char *out);
+
+//decodes numValues shorts, throws on a malformed payload
+void SoapySDRPlayNet_decode(const SoapySDRPlayNetCodec codec, const unsigned char *in, const size_t bytes, const size_t numValues, short *out);
+
+class SoapySDRPlayNetServer
+{
+public:
+    typedef std::function<void(size_t handle)> ReleaseFn;
+
+    struct Block
+    {
+        size_t handle;
+        const void *data;
+        size_t numSamples;
+        bool isFloat;
+        unsigned long long sampleCount;
+        long long timeNs;
+        uint32_t centerFrequency;
+        uint32_t sampleRate;
+        bool overload;
+    };
+
+    //listens on "port" (all interfaces) or "address:port"
+    SoapySDRPlayNetServer(const std::string &endpoint, const SoapySDRPlayNetCodec codec, const ReleaseFn &release);
+
+    //disconnects the clients and hands back every buffer it holds
+    ~SoapySDRPlayNetServer(void);
+
+    //false without clients or when the server is still busy with
+    //SDRPLAY_NET_MAX_BLOCKS buffers, the caller keeps the buffer then
+    bool push(const Block &block);
+
+    std::string getStatus(void) const;
+
+private:
+    struct Client
+    {
+        int fd;
+        std::string peer;
+        bool zeroCopy;
+        //MSG_ZEROCOPY sends so far, the kernel completes them by this counter
+        uint32_t zcSeq;
+        std::deque<std::pair<uint32_t, std::shared_ptr<void>>> zcPending;
+    };
+
+    void server_loop(void);
+
+    void acceptClients(void);
+
+    void sendBlock(const Block &block);
+
+    bool sendFrame(Client &client, const SoapySDRPlayNetFrame &frame, const void *payload, const std::shared_ptr<void> &hold);
+
+    //buffers whose zero copy sends have completed are released
+    void reapCompletions(Client &client);
+
+    void dropClient(const size_t index);
+
+    const std::string _endpoint;
+    const SoapySDRPlayNetCodec _codec;
+    const ReleaseFn _release;
+
+    int _listenFd;
+    std::vector<Client> _clients;
+    std::vector<short> _scratch16;
+    std::vector<unsigned char> _payload;
+
+    //statistics, written by the server thread
+    std::atomic<unsigned long long> _frames;
+    std::atomic<unsigned long long> _rawBytes;
+    std::atomic<unsigned long long> _sentBytes;
+    std::atomic<unsigned long long> _zcCopied;
+    std::atomic<unsigned long long> _skipped;
+    std::atomic<size_t> _numClients;
+
+    //blocks queued plus the ones the kernel still holds
+    std::atomic<size_t> _held;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _cond;
+    std::deque<Block> _queue;
+    bool _running;
+    std::thread _thread;
+};
+
+//client device for a driver streaming server, opened with net=<host>:<port>,
+//the receiver itself is controlled by the process that owns it
+class SoapySDRPlayNetDevice : public SoapySDR::Device
+{
+public:
+    SoapySDRPlayNetDevice(const SoapySDR::Kwargs &args);
+
+    ~SoapySDRPlayNetDevice(void);
+
+    std::string getDriverKey(void) const;
+
+    std::string getHardwareKey(void) const;
+
+    SoapySDR::Kwargs getHardwareInfo(void) const;
+
+    size_t getNumChannels(const int dir) const;
+
+    std::vector<std::string> getStreamFormats(const int direction, const size_t channel) const;
+
+    std::string getNativeStreamFormat(const int direction, const size_t channel, double &fullScale) const;
+
+    SoapySDR::Stream *setupStream(const int direction,
+                                  const std::string &format,
+                                  const std::vector<size_t> &channels = std::vector<size_t>(),
+                                  const SoapySDR::Kwargs &args = SoapySDR::Kwargs());
+
+    void closeStream(SoapySDR::Stream *stream);
+
+    size_t getStreamMTU(SoapySDR::Stream *stream) const;
+
+    int activateStream(SoapySDR::Stream *stream,
+                       const int flags = 0,
+                       const long long timeNs = 0,
+                       const size_t numElems = 0);
+
+    int deactivateStream(SoapySDR::Stream *stream, const int flags = 0, const long long timeNs = 0);
+
+    int readStream(SoapySDR::Stream *stream,
+                   void * const *buffs,
+                   const size_t numElems,
+                   int &flags,
+                   long long &timeNs,
+                   const long timeoutUs = 200000);
+
+    double getFrequency(const int direction, const size_t channel) const;
+
+    double getSampleRate(const int direction, const size_t channel) const;
+
+    std::vector<double> listSampleRates(const int direction, const size_t channel) const;
+
+    std::string readSetting(const std::string &key) const;
+
+private:
+    //the next frame into _samples, returns 0 or a stream error
+    int receiveFrame(const long timeoutUs);
+
+    const std::string _endpoint;
+    int _fd;
+
+    bool _useShort;
+    //SOAPY_SDR_HAS_TIME on the source host's clock, opt-in by host_time=true
+    bool _hostTime;
+    bool _active;
+    //partial frame carried over a timeout
+    std::vector<unsigned char> _rx;
+    size_t _rxBytes;
+    SoapySDRPlayNetFrame _frame;
+    std::vector<short> _samples;
+    size_t _sampleOffset;
+    unsigned long long _nextSampleCount;
+    unsigned long long _receivedBytes;
+    unsigned long long _gaps;
+};
@@ -0,0 +1,299 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "Recorder.hpp"
+#include <SoapySDR/Logger.h>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <fstream>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+//write-behind granularity, older data is dropped from the page cache
+#define RECORDER_SYNC_BYTES  (8 * 1024 * 1024)
+
+static std::string jsonEscape(const std::string &value)
+{
+    std::string out;
+    for (const char c : value)
+    {
+        if (c == '"' or c == '\\') out += '\\';
+        if ((unsigned char)c < 0x20) continue;
+        out += c;
+    }
+    return out;
+}
+
+SoapySDRPlayRecorder::SoapySDRPlayRecorder(const std::string &basePath,
+                                           const std::string &datatype,
+                                           const size_t bytesPerSample,
+                                           const SoapySDR::Kwargs &hwInfo,
+                                           const ReleaseFn &release):
+    _basePath(basePath),
+    _datatype(datatype),
+    _bytesPerSample(bytesPerSample),
+    _hwInfo(hwInfo),
+    _release(release),
+    _bytesWritten(0),
+    _bytesSynced(0),
+    _numCaptures(0),
+    _numAnnotations(0),
+    _firstBlock(true),
+    _nextSampleCount(0),
+    _overflows(0),
+    _pendingSkipped(0),
+    _skipped(0),
+    _running(true),
+    _failed(false)
+{
+    const std::string dataPath = _basePath + ".sigmf-data";
+#ifdef _WIN32
+    _fd = _open(dataPath.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+    _fd = open(dataPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+    if (_fd < 0)
+    {
+        throw std::runtime_error("cannot open " + dataPath + ": " + strerror(errno));
+    }
+
+    std::memset(&_last, 0, sizeof(_last));
+    _writer = std::thread(&SoapySDRPlayRecorder::writer_loop, this);
+    SoapySDR_logf(SOAPY_SDR_INFO, "Recording to %s", dataPath.c_str());
+}
+
+SoapySDRPlayRecorder::~SoapySDRPlayRecorder(void)
+{
+    {
+        std::lock_guard <std::mutex> lock(_mutex);
+        _running = false;
+    }
+    _cond.notify_one();
+    _writer.join();
+
+    // buffers skipped after the last one written end the recording early
+    if (_pendingSkipped != 0) annotateGap(_bytesWritten / _bytesPerSample, _pendingSkipped, 0);
+
+#ifdef _WIN32
+    _close(_fd);
+#else
+    fdatasync(_fd);
+    close(_fd);
+#endif
+    writeMeta();
+}
+
+bool SoapySDRPlayRecorder::push(const Block &block)
+{
+    {
+        std::lock_guard <std::mutex> lock(_mutex);
+        if (not _running or _failed) return false;
+        if (_queue.size() >= SDRPLAY_RECORDER_MAX_BLOCKS)
+        {
+            _pendingSkipped += block.bytes / _bytesPerSample;
+            _skipped += block.bytes / _bytesPerSample;
+            return false;
+        }
+        Queued queued;
+        queued.block = block;
+        queued.skippedBefore = _pendingSkipped;
+        _queue.push_back(queued);
+        _pendingSkipped = 0;
+    }
+    _cond.notify_one();
+    return true;
+}
+
+std::string SoapySDRPlayRecorder::getStatus(void) const
+{
+    std::lock_guard <std::mutex> lock(_mutex);
+    return "path=" + _basePath +
+           ", samples=" + std::to_string(_bytesWritten / _bytesPerSample) +
+           ", overflows=" + std::to_string(_overflows) +
+           ", skipped=" + std::to_string(_skipped) +
+           ", queued=" + std::to_string(_queue.size()) +
+           ", failed=" + (_failed ? "true" : "false");
+}
+
+void SoapySDRPlayRecorder::writer_loop(void)
+{
+    std::unique_lock <std::mutex> lock(_mutex);
+
+    while (true)
+    {
+        _cond.wait(lock, [this]{ return not _running or not _queue.empty(); });
+        if (_queue.empty()) break;
+
+        const Queued queued = _queue.front();
+        _queue.pop_front();
+
+        lock.unlock();
+        if (not _failed) writeBlock(queued.block, queued.skippedBefore);
+        _release(queued.block.handle);
+        lock.lock();
+    }
+}
+
+void SoapySDRPlayRecorder::annotateGap(const unsigned long long fileSample, const unsigned long long skipped, const unsigned long long lost)
+{
+    if (skipped != 0)
+    {
+        if (_numAnnotations++ != 0) _annotations << ",\n";
+        _annotations << "    {\"core:sample_start\": " << fileSample
+                     << ", \"core:sample_count\": 0"
+                     << ", \"core:comment\": \"recorder behind, "
+                     << skipped << " samples skipped\"}";
+    }
+    if (lost != 0)
+    {
+        if (_numAnnotations++ != 0) _annotations << ",\n";
+        _annotations << "    {\"core:sample_start\": " << fileSample
+                     << ", \"core:sample_count\": 0"
+                     << ", \"core:comment\": \"overflow, "
+                     << lost << " samples lost\"}";
+    }
+}
+
+void SoapySDRPlayRecorder::writeBlock(const Block &block, const unsigned long long skipped)
+{
+    const unsigned long long fileSample = _bytesWritten / _bytesPerSample;
+    const bool gap = not _firstBlock and (block.sampleCount != _nextSampleCount);
+    bool driverLoss = false;
+
+    // a new capture segment whenever tuning changes or samples went missing,
+    // core:global_index keeps the driver sample counter so gaps stay visible
+    if (_firstBlock or (block.frequency != _last.frequency) or (block.sampleRate != _last.sampleRate) or
+        (block.sampleCount != _nextSampleCount))
+    {
+        if (_numCaptures++ != 0) _captures << ",\n";
+        _captures << "    {\"core:sample_start\": " << fileSample
+                  << ", \"core:global_index\": " << block.sampleCount
+                  << ", \"core:frequency\": " << block.frequency
+                  << ", \"sdrplay:sample_rate\": " << block.sampleRate;
+        if (_firstBlock)
+        {
+            char datetime[32];
+            const time_t now = time(nullptr);
+            strftime(datetime, sizeof(datetime), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+            _captures << ", \"core:datetime\": \"" << datetime << "\"";
+        }
+        _captures << "}";
+
+        // the gap is what the recorder skipped plus what the driver dropped
+        if (gap)
+        {
+            const unsigned long long missing = block.sampleCount - _nextSampleCount;
+            const unsigned long long recSkipped = std::min(skipped, missing);
+            annotateGap(fileSample, recSkipped, missing - recSkipped);
+            driverLoss = (missing != recSkipped);
+        }
+    }
+
+    if (_firstBlock or (block.gRdB != _last.gRdB) or (block.lnaState != _last.lnaState) or (block.overload and not _last.overload))
+    {
+        if (_numAnnotations++ != 0) _annotations << ",\n";
+        _annotations << "    {\"core:sample_start\": " << fileSample
+                     << ", \"core:sample_count\": 0"
+                     << ", \"core:comment\": \"IFGR " << block.gRdB << " dB, LNA state " << block.lnaState
+                     << (block.overload ? ", ADC overload" : "") << "\"}";
+    }
+
+    _firstBlock = false;
+    _last = block;
+    _nextSampleCount = block.sampleCount + block.bytes / _bytesPerSample;
+
+    const char *data = (const char *)block.data;
+    size_t remaining = block.bytes;
+    while (remaining > 0)
+    {
+#ifdef _WIN32
+        const int ret = _write(_fd, data, (unsigned int)remaining);
+#else
+        const ssize_t ret = write(_fd, data, remaining);
+#endif
+        if (ret < 0 and errno == EINTR) continue;
+        if (ret <= 0)
+        {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "Recording to %s failed: %s", _basePath.c_str(), strerror(errno));
+            std::lock_guard <std::mutex> lock(_mutex);
+            _failed = true;
+            return;
+        }
+        data += ret;
+        remaining -= ret;
+    }
+
+    unsigned long long written;
+    {
+        std::lock_guard <std::mutex> lock(_mutex);
+        _bytesWritten += block.bytes;
+        if (driverLoss) _overflows++;
+        written = _bytesWritten;
+    }
+
+#if defined(__linux__)
+    // start writeback early and drop what is on disk from the page cache,
+    // so a long recording streams at disk speed without filling memory;
+    // outside the lock, push() must never wait behind a writeback stall
+    if (written - _bytesSynced >= RECORDER_SYNC_BYTES)
+    {
+        sync_file_range(_fd, _bytesSynced, written - _bytesSynced, SYNC_FILE_RANGE_WRITE);
+        if (_bytesSynced >= RECORDER_SYNC_BYTES)
+        {
+            const off_t done = _bytesSynced - RECORDER_SYNC_BYTES;
+            sync_file_range(_fd, done, RECORDER_SYNC_BYTES, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(_fd, done, RECORDER_SYNC_BYTES, POSIX_FADV_DONTNEED);
+        }
+        _bytesSynced = written;
+    }
+#endif
+}
+
+void SoapySDRPlayRecorder::writeMeta(void)
+{
+    std::ofstream meta(_basePath + ".sigmf-meta");
+
+    meta << "{\n";
+    meta << "  \"global\": {\n";
+    meta << "    \"core:datatype\": \"" << _datatype << "\",\n";
+    meta << "    \"core:sample_rate\": " << _last.sampleRate << ",\n";
+    meta << "    \"core:version\": \"1.0.0\",\n";
+    meta << "    \"core:recorder\": \"SoapySDRPlay\",\n";
+    std::string hw;
+    for (const auto &kv : _hwInfo) hw += (hw.empty() ? "" : ", ") + kv.first + "=" + kv.second;
+    meta << "    \"core:hw\": \"" << jsonEscape(hw) << "\",\n";
+    meta << "    \"core:extensions\": [{\"name\": \"sdrplay\", \"version\": \"1.0.0\", \"optional\": true}]\n";
+    meta << "  },\n";
+    meta << "  \"captures\": [\n" << _captures.str() << "\n  ],\n";
+    meta << "  \"annotations\": [\n" << _annotations.str() << "\n  ]\n";
+    meta << "}\n";
+}
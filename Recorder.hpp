@@ -0,0 +1,126 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <SoapySDR/Types.hpp>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <string>
+#include <sstream>
+
+//SigMF dataset writer fed with stream buffers straight from the ring:
+//push() queues a buffer, the writer thread writes it to the .sigmf-data
+//file and hands it back through the release callback, so samples are
+//never copied. Captures and annotations go to the .sigmf-meta file.
+//At most SDRPLAY_RECORDER_MAX_BLOCKS buffers are held, a disk that falls
+//behind skips buffers rather than taking the ring from the readers, the
+//skipped samples show as a gap annotation.
+
+#define SDRPLAY_RECORDER_MAX_BLOCKS (4)
+
+class SoapySDRPlayRecorder
+{
+public:
+    typedef std::function<void(size_t handle)> ReleaseFn;
+
+    struct Block
+    {
+        size_t handle;
+        const void *data;
+        size_t bytes;
+        unsigned long long sampleCount;
+        double frequency;
+        double sampleRate;
+        int gRdB;
+        int lnaState;
+        bool overload;
+    };
+
+    //datatype is the SigMF core:datatype, i.e. ci16_le or cf32_le
+    SoapySDRPlayRecorder(const std::string &basePath,
+                         const std::string &datatype,
+                         const size_t bytesPerSample,
+                         const SoapySDR::Kwargs &hwInfo,
+                         const ReleaseFn &release);
+
+    //drains the queue, then writes the metadata file
+    ~SoapySDRPlayRecorder(void);
+
+    //false when the writer is gone or SDRPLAY_RECORDER_MAX_BLOCKS are
+    //queued, the caller keeps the buffer then
+    bool push(const Block &block);
+
+    std::string getStatus(void) const;
+
+private:
+    //a queued buffer and the samples push() refused just before it
+    struct Queued
+    {
+        Block block;
+        unsigned long long skippedBefore;
+    };
+
+    void writer_loop(void);
+
+    //skipped is the number of samples push() refused since the previous block
+    void writeBlock(const Block &block, const unsigned long long skipped);
+
+    void annotateGap(const unsigned long long fileSample, const unsigned long long skipped, const unsigned long long lost);
+
+    void writeMeta(void);
+
+    const std::string _basePath;
+    const std::string _datatype;
+    const size_t _bytesPerSample;
+    const SoapySDR::Kwargs _hwInfo;
+    const ReleaseFn _release;
+
+    int _fd;
+    unsigned long long _bytesWritten;
+    //writeback progress, only touched by the writer thread
+    unsigned long long _bytesSynced;
+
+    //metadata, only touched by the writer thread
+    std::stringstream _captures;
+    std::stringstream _annotations;
+    size_t _numCaptures;
+    size_t _numAnnotations;
+    bool _firstBlock;
+    Block _last;
+    unsigned long long _nextSampleCount;
+    unsigned long long _overflows;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _cond;
+    std::deque<Queued> _queue;
+    //samples refused by push() since the last queued buffer, and in total
+    unsigned long long _pendingSkipped;
+    unsigned long long _skipped;
+    bool _running;
+    bool _failed;
+    std::thread _writer;
+};
@@ -23,6 +23,7 @@
  */
 
 #include "SoapySDRPlay.hpp"
+#include "Aggregate.hpp"
 #include <SoapySDR/Registry.hpp>
 
 #if !defined(_M_X64) && !defined(_M_IX86)
@@ -37,39 +38,85 @@ static std::vector<SoapySDR::Kwargs> findSDRPlay(const SoapySDR::Kwargs &args)
    unsigned int nDevs = 0;
    char lblstr[128];
 
+   //a recorded file played back as a device, the hardware isn't enumerated
+   if (args.count("replay") != 0)
+   {
+      SoapySDR::Kwargs dev(args);
+      const std::string &path = args.at("replay");
+      dev["serial"] = "replay";
+      dev["label"] = "SDRplay Replay " + path.substr(path.find_last_of("/\\") + 1);
+      results.push_back(dev);
+      return results;
+   }
+
+   //a stream shared by the process that owns the device
+   if (args.count("shm") != 0)
+   {
+      SoapySDR::Kwargs dev;
+      dev["shm"] = args.at("shm");
+      dev["serial"] = "shm:" + args.at("shm");
+      dev["label"] = "SDRplay Shared " + args.at("shm");
+      results.push_back(dev);
+      return results;
+   }
+
+   //a stream served by the driver in another process or on another host
+   if (args.count("net") != 0)
+   {
+      SoapySDR::Kwargs dev;
+      dev["net"] = args.at("net");
+      dev["serial"] = "net:" + args.at("net");
+      dev["label"] = "SDRplay Network " + args.at("net");
+      results.push_back(dev);
+      return results;
+   }
+
+   //several devices behind worker processes, each one opened by serial
+   if (args.count("aggregate") != 0)
+   {
+      SoapySDR::Kwargs dev(args);
+      dev["serial"] = "aggregate:" + args.at("aggregate");
+      dev["label"] = "SDRplay Aggregate " + args.at("aggregate");
+      results.push_back(dev);
+      return results;
+   }
+
    //Enable (= 1) API calls tracing,
    //but only for debug purposes due to its performance impact. 
    mir_sdr_DebugEnable(0);
 
    std::string baseLabel = "SDRplay Dev";
 
-   // list devices by API
-   mir_sdr_DeviceT rspDevs[MAX_RSP_DEVICES];
-   mir_sdr_GetDevices(&rspDevs[0], &nDevs, MAX_RSP_DEVICES);
+   // list devices by API, or from a recent enough scan
+   auto &cache = SoapySDRPlayDeviceCache::instance();
+   if (args.count("hotplug") != 0 and args.at("hotplug") == "true") cache.startHotplug();
+   const double ttl = args.count("cache_ttl") ? std::stod(args.at("cache_ttl")) : DEFAULT_ENUM_CACHE_TTL;
+   const auto rspDevs = cache.getDevices(ttl);
+   nDevs = (unsigned int)rspDevs.size();
 
   for (unsigned int i = 0; i < nDevs; i++)
   {
      if (rspDevs[i].devAvail)
      {
         SoapySDR::Kwargs dev;
-        dev["serial"] = rspDevs[i].SerNo;
+        dev["serial"] = rspDevs[i].serial;
         const bool serialMatch = args.count("serial") == 0 or args.at("serial") == dev["serial"];
         if (not serialMatch) continue;
         if (rspDevs[i].hwVer > 253)
         {
-           sprintf_s(lblstr, sizeof(lblstr), "SDRplay Dev%d RSP1A %s", i, rspDevs[i].SerNo);
+           sprintf_s(lblstr, sizeof(lblstr), "SDRplay Dev%d RSP1A %s", i, rspDevs[i].serial.c_str());
         }
         else if (rspDevs[i].hwVer == 3)
         {
-           sprintf_s(lblstr, sizeof(lblstr), "SDRplay Dev%d RSPduo %s", i, rspDevs[i].SerNo);
+           sprintf_s(lblstr, sizeof(lblstr), "SDRplay Dev%d RSPduo %s", i, rspDevs[i].serial.c_str());
         }
         else
         {
-           sprintf_s(lblstr, sizeof(lblstr), "SDRplay Dev%d RSP%d %s", i, rspDevs[i].hwVer, rspDevs[i].SerNo);
+           sprintf_s(lblstr, sizeof(lblstr), "SDRplay Dev%d RSP%d %s", i, rspDevs[i].hwVer, rspDevs[i].serial.c_str());
         }
         dev["label"] = lblstr;
         results.push_back(dev);
-        _cachedResults[rspDevs[i].SerNo] = dev;
+        _cachedResults[rspDevs[i].serial] = dev;
      }
   }
 
@@ -86,6 +133,9 @@ static std::vector<SoapySDR::Kwargs> findSDRPlay(const SoapySDR::Kwargs &args)
 
 static SoapySDR::Device *makeSDRPlay(const SoapySDR::Kwargs &args)
 {
+    if (args.count("shm") != 0) return new SoapySDRPlayShmDevice(args);
+    if (args.count("net") != 0) return new SoapySDRPlayNetDevice(args);
+    if (args.count("aggregate") != 0) return new SoapySDRPlayAggregateDevice(args);
     return new SoapySDRPlay(args);
 }
 
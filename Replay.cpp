@@ -0,0 +1,204 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "Replay.hpp"
+#include <SoapySDR/Logger.h>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <iterator>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static bool endsWith(const std::string &value, const std::string &suffix)
+{
+    return value.size() >= suffix.size() and
+           value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+//the value following "key": in a SigMF metadata file, first occurrence only
+static std::string findJsonValue(const std::string &json, const std::string &key)
+{
+    const std::string quoted = "\"" + key + "\"";
+    size_t pos = json.find(quoted);
+    if (pos == std::string::npos) return "";
+    pos = json.find(':', pos + quoted.size());
+    if (pos == std::string::npos) return "";
+    pos = json.find_first_not_of(" \t\r\n", pos + 1);
+    if (pos == std::string::npos) return "";
+
+    if (json[pos] == '"')
+    {
+        const size_t end = json.find('"', pos + 1);
+        if (end == std::string::npos) return "";
+        return json.substr(pos + 1, end - pos - 1);
+    }
+    const size_t end = json.find_first_of(",}] \t\r\n", pos);
+    return json.substr(pos, end - pos);
+}
+
+SoapySDRPlayReplay::SoapySDRPlayReplay(const std::string &path, const std::string &format, const double sampleRate):
+    _dataPath(path),
+    _format(format),
+    _sampleRate(sampleRate),
+    _frequency(0),
+    _data(nullptr),
+    _bytes(0),
+    _bytesPerSample(0),
+    _numSamples(0),
+    _position(0)
+{
+    //a SigMF dataset is given by its base name or any of its two files
+    std::string base;
+    if (endsWith(path, ".sigmf-data") or endsWith(path, ".sigmf-meta"))
+    {
+        base = path.substr(0, path.size() - 11);
+    }
+    else if (endsWith(path, ".sigmf"))
+    {
+        base = path.substr(0, path.size() - 6);
+    }
+
+    if (not base.empty())
+    {
+        _dataPath = base + ".sigmf-data";
+        parseMeta(base + ".sigmf-meta");
+    }
+    else if (_format.empty())
+    {
+        _format = (endsWith(path, ".cf32") or endsWith(path, ".fc32")) ? "cf32" : "cs16";
+    }
+
+    if (_format == "cs16") _bytesPerSample = 2 * sizeof(short);
+    else if (_format == "cf32") _bytesPerSample = 2 * sizeof(float);
+    else throw std::runtime_error("replay: unsupported format '" + _format + "'");
+
+    if (_sampleRate <= 0) throw std::runtime_error("replay: invalid sample rate");
+
+    mapFile();
+
+    _numSamples = _bytes / _bytesPerSample;
+    if (_numSamples == 0) throw std::runtime_error("replay: no samples in " + _dataPath);
+
+    SoapySDR_logf(SOAPY_SDR_INFO, "Replaying %s: %s, %llu samples at %g Sps",
+                  _dataPath.c_str(), _format.c_str(), _numSamples, _sampleRate);
+}
+
+SoapySDRPlayReplay::~SoapySDRPlayReplay(void)
+{
+#ifndef _WIN32
+    if (_data != nullptr) munmap((void *)_data, _bytes);
+#endif
+}
+
+void SoapySDRPlayReplay::parseMeta(const std::string &metaPath)
+{
+    std::ifstream file(metaPath.c_str());
+    if (not file) throw std::runtime_error("replay: cannot open " + metaPath);
+    std::stringstream json;
+    json << file.rdbuf();
+
+    const std::string datatype = findJsonValue(json.str(), "core:datatype");
+    if (datatype == "ci16_le") _format = "cs16";
+    else if (datatype == "cf32_le") _format = "cf32";
+    else throw std::runtime_error("replay: unsupported SigMF datatype '" + datatype + "'");
+
+    const std::string rate = findJsonValue(json.str(), "core:sample_rate");
+    if (not rate.empty()) _sampleRate = std::atof(rate.c_str());
+
+    //the first capture segment, later retunes are not replayed
+    const std::string frequency = findJsonValue(json.str(), "core:frequency");
+    if (not frequency.empty()) _frequency = std::atof(frequency.c_str());
+}
+
+void SoapySDRPlayReplay::mapFile(void)
+{
+#ifdef _WIN32
+    std::ifstream file(_dataPath.c_str(), std::ios::binary);
+    if (not file) throw std::runtime_error("replay: cannot open " + _dataPath);
+    _contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    _data = _contents.data();
+    _bytes = _contents.size();
+#else
+    const int fd = open(_dataPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw std::runtime_error("replay: cannot open " + _dataPath + ": " + std::strerror(errno));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 or st.st_size == 0)
+    {
+        close(fd);
+        throw std::runtime_error("replay: empty or unreadable " + _dataPath);
+    }
+
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) throw std::runtime_error("replay: mmap failed: " + std::string(std::strerror(errno)));
+
+    //read ahead aggressively, every page is touched exactly once per pass
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    _data = (const unsigned char *)data;
+    _bytes = st.st_size;
+#endif
+}
+
+size_t SoapySDRPlayReplay::read(short *xi, short *xq, size_t numSamples)
+{
+    const size_t n = (size_t)std::min<unsigned long long>(numSamples, _numSamples - _position);
+    const unsigned char *src = _data + _position * _bytesPerSample;
+
+    if (_format == "cs16")
+    {
+        //memcpy per sample keeps unaligned reads legal
+        for (size_t i = 0; i < n; i++)
+        {
+            short iq[2];
+            std::memcpy(iq, src + i * sizeof(iq), sizeof(iq));
+            xi[i] = iq[0];
+            xq[i] = iq[1];
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            float iq[2];
+            std::memcpy(iq, src + i * sizeof(iq), sizeof(iq));
+            xi[i] = (short)std::max(-32768.0f, std::min(32767.0f, iq[0] * 32768.0f));
+            xq[i] = (short)std::max(-32768.0f, std::min(32767.0f, iq[1] * 32768.0f));
+        }
+    }
+
+    _position += n;
+    return n;
+}
@@ -0,0 +1,95 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+//read side of a recorded dataset for the replay device: the file is
+//mapped read-only and de-interleaved into 16 bit I/Q planes, the same
+//layout the stream callback receives from the API.
+//Supported inputs are raw CS16 or CF32 files and SigMF datasets
+//(ci16_le or cf32_le), either given as the base name or one of its files.
+class SoapySDRPlayReplay
+{
+public:
+    //format is "cs16", "cf32" or empty to guess it from the file,
+    //sampleRate is used when the file itself doesn't carry one
+    SoapySDRPlayReplay(const std::string &path, const std::string &format, const double sampleRate);
+
+    ~SoapySDRPlayReplay(void);
+
+    const std::string &getPath(void) const
+    {
+        return _dataPath;
+    }
+
+    const std::string &getFormat(void) const
+    {
+        return _format;
+    }
+
+    double getSampleRate(void) const
+    {
+        return _sampleRate;
+    }
+
+    //0 when unknown
+    double getFrequency(void) const
+    {
+        return _frequency;
+    }
+
+    unsigned long long getNumSamples(void) const
+    {
+        return _numSamples;
+    }
+
+    //copy up to numSamples from the current position, returns 0 at the end of the file
+    size_t read(short *xi, short *xq, size_t numSamples);
+
+    void rewind(void)
+    {
+        _position = 0;
+    }
+
+private:
+    void parseMeta(const std::string &metaPath);
+
+    void mapFile(void);
+
+    std::string _dataPath;
+    std::string _format;
+    double _sampleRate;
+    double _frequency;
+
+    const unsigned char *_data;
+    size_t _bytes;
+#ifdef _WIN32
+    std::vector<unsigned char> _contents;
+#endif
+    size_t _bytesPerSample;
+    unsigned long long _numSamples;
+    unsigned long long _position;
+};
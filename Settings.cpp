@@ -23,6 +23,13 @@
  */
 
 #include "SoapySDRPlay.hpp"
+#include <cmath>
+
+//lower band edges of the gain calibration table in MHz
+static const double gainBandEdgesMHz[SDRPLAY_NUM_GAIN_BANDS + 1] =
+{
+    0.0, 12.0, 30.0, 60.0, 120.0, 250.0, 420.0, 1000.0, 2000.0
+};
 
 std::set<std::string> &SoapySDRPlay_getClaimedSerials(void)
 {
@@ -32,35 +39,114 @@ std::set<std::string> &SoapySDRPlay_getClaimedSerials(void)
 
 SoapySDRPlay::SoapySDRPlay(const SoapySDR::Kwargs &args)
 {
-    if (args.count("serial") == 0) throw std::runtime_error("no sdrplay device found");
+    const auto constructStart = std::chrono::steady_clock::now();
+    std::memset(&_startup, 0, sizeof(_startup));
+    _awaitFirstSample = false;
+    _firstSampleUs = -1;
+    _cbCount = 0;
+    _cbSamples = 0;
+    _cbLastSamples = 0;
+    _cbMinSamples = 0;
+    _cbMaxSamples = 0;
+    _timeRate = 0;
+    _timeSamples = 0;
+    _timeBaseNs = 0;
+    _tpTime = constructStart;
+    _tpCount = 0;
+    _tpSamples = 0;
+
+    // open and the first stream setup show in the trace too
+    if (args.count("trace") != 0 and args.at("trace") == "true") SoapySDRPlayTrace::enable(true);
+
+    // numeric arguments are checked before the device is claimed
+    for (const char *key : {"cache_ttl", "rate", "bandwidth", "frequency", "ifgr", "rfgr", "metrics_interval"})
+    {
+        if (args.count(key) == 0) continue;
+        const std::string &value = args.at(key);
+        size_t end = 0;
+        try
+        {
+            std::stod(value, &end);
+        }
+        catch (const std::exception &)
+        {
+            end = 0;
+        }
+        if (end == 0 or end != value.size()) throw std::runtime_error("invalid " + std::string(key) + " '" + value + "'");
+    }
 
-    serNo = args.at("serial");
+    // a constructor that throws never runs the destructor, so until the
+    // end of it the claimed device index is given back from here
+    struct DeviceClaim
+    {
+        bool claimed = false;
+        ~DeviceClaim(void)
+        {
+            if (not claimed) return;
+            mir_sdr_ReleaseDeviceIdx();
+            SoapySDRPlayDeviceCache::instance().invalidate();
+        }
+    } deviceClaim;
 
-    // retreive hwVer and device index by API
-    unsigned int nDevs = 0;
+    replayMode = args.count("replay") != 0;
+    replayRealtime = true;
+    replayLoop = false;
+    replayActive = false;
 
-    mir_sdr_DeviceT rspDevs[MAX_RSP_DEVICES];
-    mir_sdr_GetDevices(&rspDevs[0], &nDevs, MAX_RSP_DEVICES);
+    mir_sdr_ApiVersion(&ver);
 
-    unsigned devIdx = MAX_RSP_DEVICES;
-    for (unsigned int i = 0; i < nDevs; i++)
+    if (replayMode)
     {
-        if (rspDevs[i].devAvail and rspDevs[i].SerNo == serNo) devIdx = i;
+        // a recorded file stands in for the device, nothing is opened through the API
+        const double rate = args.count("replay_rate") ? std::stod(args.at("replay_rate")) : 2e6;
+        _replay.reset(new SoapySDRPlayReplay(args.at("replay"),
+                                             args.count("replay_format") ? args.at("replay_format") : "",
+                                             rate));
+        replayRealtime = not (args.count("replay_pace") and args.at("replay_pace") == "fast");
+        replayLoop = args.count("replay_loop") and args.at("replay_loop") == "true";
+        serNo = "replay";
+        // plain RSP1: single antenna, no model specific controls to emulate
+        hwVer = 1;
     }
-    if (devIdx == MAX_RSP_DEVICES) throw std::runtime_error("no sdrplay device matches");
+    else
+    {
+        if (args.count("serial") == 0) throw std::runtime_error("no sdrplay device found");
 
-    hwVer = rspDevs[devIdx].hwVer;
+        serNo = args.at("serial");
 
-    mir_sdr_ApiVersion(&ver);
-    if (ver != MIR_SDR_API_VERSION)
-    {
-        SoapySDR_logf(SOAPY_SDR_WARNING, "mir_sdr version: '%.3f' does not equal build version: '%.3f'", ver, MIR_SDR_API_VERSION);
-    }
+        // retreive hwVer and device index from the enumeration scan, when recent
+        auto &cache = SoapySDRPlayDeviceCache::instance();
+        const double ttl = args.count("cache_ttl") ? std::stod(args.at("cache_ttl")) : DEFAULT_ENUM_CACHE_TTL;
+        SoapySDRPlayDeviceInfo info;
+        auto stepStart = std::chrono::steady_clock::now();
+        if (not cache.findDevice(serNo, ttl, info)) throw std::runtime_error("no sdrplay device matches");
+        _startup.lookup = msSince(stepStart);
+
+        if (ver != MIR_SDR_API_VERSION)
+        {
+            SoapySDR_logf(SOAPY_SDR_WARNING, "mir_sdr version: '%.3f' does not equal build version: '%.3f'", ver, MIR_SDR_API_VERSION);
+        }
 
-    mir_sdr_SetDeviceIdx(devIdx);
+        // the index may be stale if devices came and went since the scan
+        stepStart = std::chrono::steady_clock::now();
+        if (mir_sdr_SetDeviceIdx(info.devIdx) != mir_sdr_Success)
+        {
+            if (not cache.findDevice(serNo, 0.0, info) or mir_sdr_SetDeviceIdx(info.devIdx) != mir_sdr_Success)
+            {
+                throw std::runtime_error("no sdrplay device matches");
+            }
+        }
+        _startup.setDeviceIdx = msSince(stepStart);
+        deviceClaim.claimed = true;
+        hwVer = info.hwVer;
+
+        // now claimed, it no longer shows as available
+        cache.invalidate();
+    }
 
     sampleRate = 2000000;
     reqSampleRate = sampleRate;
+    reqBandwidth = 0;
     decM = 1;
     decEnable = 0;
     centerFrequency = 100;
@@ -75,10 +161,15 @@ SoapySDRPlay::SoapySDRPlay(const SoapySDR::Kwargs &args)
     bufferLength = bufferElems * elementsPerSample * shortsPerWord;
 
     agcMode = mir_sdr_AGC_100HZ;
+    softwareAgc = false;
+    agcAttackMs = DEFAULT_AGC_ATTACK_MS;
+    agcDecayMs = DEFAULT_AGC_DECAY_MS;
+    agcHysteresis = DEFAULT_AGC_HYSTERESIS_DB;
     dcOffsetMode = true;
 
     IQcorr = 1;
     setPoint = -30;
+    transferMode = DEFAULT_TRANSFER_MODE;
 
     antSel = mir_sdr_RSPII_ANTENNA_A;
     tunSel = mir_sdr_rspDuo_Tuner_1;
@@ -88,18 +179,89 @@ SoapySDRPlay::SoapySDRPlay(const SoapySDR::Kwargs &args)
     notchEn = 0;
     dabNotchEn = 0;
 
-    bufferedElems = 0;
-    _currentBuff = 0;
     resetBuffer = false;
     useShort = true;
+    calibratedOutput = false;
+
+    _agcEnergy = 0;
+    _agcSamples = 0;
+    _agcStep = false;
+    _agc_running = false;
+
+    rtPriority = 0;
+    rtPolicy = "fifo";
+    memoryLock = false;
+    netCodec = "cs16";
+    latencyUs = 0;
+    metricsInterval = DEFAULT_METRICS_INTERVAL;
+    _tailConverting = false;
+    _callbackSchedPending = false;
+
+    pipelineMode = false;
+    dspThreads = 0;
+
+    _buf_waiters = 0;
+    _publishSeq = 0;
+
+    _arena = nullptr;
+    _arenaBytes = 0;
+    _arenaHuge = false;
+    hugePages = false;
+    _buffStride = 0;
+    _raw_head = 0;
+    _raw_tail = 0;
+    _rawOverflow = false;
+    _raw_waiting = false;
+    _pipeline_running = false;
+
+    buildGainTable();
     
     streamActive = false;
-    SoapySDRPlay_getClaimedSerials().insert(serNo);
+    adcOverload = false;
+    _sampleCount = 0;
+    std::memset(&_lastMeta, 0, sizeof(_lastMeta));
+    current_gRdB = gRdB;
+
+    if (replayMode)
+    {
+        // the file rate is fixed, no decimation
+        sampleRate = (uint32_t)_replay->getSampleRate();
+        reqSampleRate = sampleRate;
+        if (_replay->getFrequency() > 0) centerFrequency = (uint32_t)_replay->getFrequency();
+    }
+    publishState();
+
+    // fast-open: the initial settings only update the cached state here,
+    // activateStream() applies them all with the single mir_sdr_StreamInit()
+    if (args.count("if_mode") != 0) writeSetting("if_mode", args.at("if_mode"));
+    if (args.count("rate") != 0) setSampleRate(SOAPY_SDR_RX, 0, std::stod(args.at("rate")));
+    if (args.count("bandwidth") != 0) setBandwidth(SOAPY_SDR_RX, 0, std::stod(args.at("bandwidth")));
+    if (args.count("frequency") != 0) setFrequency(SOAPY_SDR_RX, 0, "RF", std::stod(args.at("frequency")));
+    if (args.count("antenna") != 0) setAntenna(SOAPY_SDR_RX, 0, args.at("antenna"));
+    if (args.count("agc") != 0) setGainMode(SOAPY_SDR_RX, 0, args.at("agc") == "true");
+    if (args.count("ifgr") != 0) setGain(SOAPY_SDR_RX, 0, "IFGR", std::stod(args.at("ifgr")));
+    if (args.count("rfgr") != 0) setGain(SOAPY_SDR_RX, 0, "RFGR", std::stod(args.at("rfgr")));
+
+    if (not replayMode) SoapySDRPlay_getClaimedSerials().insert(serNo);
+    _startup.construct = msSince(constructStart);
+
+    if (args.count("metrics_interval") != 0) writeSetting("metrics_interval", args.at("metrics_interval"));
+    if (args.count("metrics_file") != 0) writeSetting("metrics_file", args.at("metrics_file"));
+    if (args.count("metrics_server") != 0) writeSetting("metrics_server", args.at("metrics_server"));
+
+    // fully constructed, the destructor releases the device from now on
+    deviceClaim.claimed = false;
 }
 
 SoapySDRPlay::~SoapySDRPlay(void)
 {
-    SoapySDRPlay_getClaimedSerials().erase(serNo);
+    if (not replayMode) SoapySDRPlay_getClaimedSerials().erase(serNo);
+    stopMetricsExporter();
+    stopAgcThread();
+    stopReplayThread();
+    stopRecorder();
+    stopSharedStream();
+    stopNetServer();
     std::lock_guard <std::mutex> lock(_general_state_mutex);
 
     if (streamActive)
@@ -107,7 +269,17 @@ SoapySDRPlay::~SoapySDRPlay(void)
         mir_sdr_StreamUninit();
     }
     streamActive = false;
-    mir_sdr_ReleaseDeviceIdx();
+    stopPipelineThread();
+    if (not replayMode)
+    {
+        mir_sdr_ReleaseDeviceIdx();
+        SoapySDRPlayDeviceCache::instance().invalidate();
+    }
+
+    std::lock_guard <std::mutex> bufLock(_buf_mutex);
+    lockRingMemory(false);
+    freeRing();
+    for (const auto &reader : _streams) closeStreamEvent(reader.get());
 }
 
 /*******************************************************************
@@ -121,6 +293,7 @@ std::string SoapySDRPlay::getDriverKey(void) const
 
 std::string SoapySDRPlay::getHardwareKey(void) const
 {
+    if (replayMode) return "Replay";
     if (hwVer > 253) return "RSP1A";
     if (hwVer == 3) return "RSPduo";
     return "RSP" + std::to_string(hwVer);
@@ -135,6 +308,11 @@ SoapySDR::Kwargs SoapySDRPlay::getHardwareInfo(void) const
     hwArgs["mir_sdr_api_version"] = std::to_string(ver);
     hwArgs["mir_sdr_hw_version"] = std::to_string(hwVer);
     hwArgs["serial"] = serNo;
+    if (replayMode)
+    {
+        hwArgs["replay_file"] = _replay->getPath();
+        hwArgs["replay_format"] = _replay->getFormat();
+    }
     return hwArgs;
 }
 
@@ -205,6 +383,7 @@ void SoapySDRPlay::setAntenna(const int direction, const size_t channel, const s
 
             if (streamActive)
             {
+                SoapySDRPlayTraceScope trace("mir_sdr_Reinit", "reason", mir_sdr_CHANGE_AM_PORT);
                 mir_sdr_Reinit(&gRdB, 0.0, 0.0, mir_sdr_BW_Undefined, mir_sdr_IF_Undefined, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, mir_sdr_CHANGE_AM_PORT);
             }
         }
@@ -222,6 +401,7 @@ void SoapySDRPlay::setAntenna(const int direction, const size_t channel, const s
 
                 if (streamActive)
                 {
+                    SoapySDRPlayTraceScope trace("mir_sdr_Reinit", "reason", mir_sdr_CHANGE_AM_PORT);
                     mir_sdr_Reinit(&gRdB, 0.0, 0.0, mir_sdr_BW_Undefined, mir_sdr_IF_Undefined, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, mir_sdr_CHANGE_AM_PORT);
                 }
             }
@@ -272,26 +452,29 @@ void SoapySDRPlay::setAntenna(const int direction, const size_t channel, const s
 
         if (streamActive)
         {
+            SoapySDRPlayTraceScope trace("mir_sdr_Reinit", "reason", mir_sdr_CHANGE_AM_PORT);
             mir_sdr_Reinit(&gRdB, 0.0, 0.0, mir_sdr_BW_Undefined, mir_sdr_IF_Undefined, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, mir_sdr_CHANGE_AM_PORT);
         }
     }
+
+    publishState();
 }
 
 std::string SoapySDRPlay::getAntenna(const int direction, const size_t channel) const
 {
-    std::lock_guard <std::mutex> lock(_general_state_mutex);
-
     if (direction == SOAPY_SDR_TX)
     {
         return "";
     }
 
+    const SoapySDRPlayState state = _state.load();
+
     if (hwVer == 2)
     {
-        if (amPort == 1) {
+        if (state.amPort == 1) {
             return "Hi-Z";
         }
-        else if (antSel == mir_sdr_RSPII_ANTENNA_A) {
+        else if (state.antSel == mir_sdr_RSPII_ANTENNA_A) {
             return "Antenna A";
         }
         else {
@@ -300,10 +483,10 @@ std::string SoapySDRPlay::getAntenna(const int direction, const size_t channel)
     }
     else if (hwVer == 3)
     {
-        if (amPort == 1) {
+        if (state.amPort == 1) {
             return "Tuner 1 Hi-Z";
         }
-        else if (tunSel == mir_sdr_rspDuo_Tuner_1) {
+        else if (state.tunSel == mir_sdr_rspDuo_Tuner_1) {
             return "Tuner 1 50 ohm";
         }
         else {
@@ -331,14 +514,13 @@ void SoapySDRPlay::setDCOffsetMode(const int direction, const size_t channel, co
 
     //enable/disable automatic DC removal
     dcOffsetMode = automatic;
-    mir_sdr_DCoffsetIQimbalanceControl((unsigned int)automatic, (unsigned int)automatic);
+    if (not replayMode) mir_sdr_DCoffsetIQimbalanceControl((unsigned int)automatic, (unsigned int)automatic);
+    publishState();
 }
 
 bool SoapySDRPlay::getDCOffsetMode(const int direction, const size_t channel) const
 {
-    std::lock_guard <std::mutex> lock(_general_state_mutex);
-
-    return dcOffsetMode;
+    return _state.load().dcOffsetMode;
 }
 
 bool SoapySDRPlay::hasDCOffset(const int direction, const size_t channel) const
@@ -379,14 +561,21 @@ void SoapySDRPlay::setGainMode(const int direction, const size_t channel, const
         //align known agc values with current value before starting AGC.
         current_gRdB = gRdB;
     }
-    mir_sdr_AgcControl(agcMode, setPoint, 0, 0, 0, 0, lnaState);
+    applyAgcControl();
+    publishState();
 }
 
 bool SoapySDRPlay::getGainMode(const int direction, const size_t channel) const
 {
-    std::lock_guard <std::mutex> lock(_general_state_mutex);
+    return (_state.load().agcMode == mir_sdr_AGC_DISABLE)? false: true;
+}
+
+void SoapySDRPlay::applyAgcControl(void)
+{
+    if (replayMode) return;
 
-    return (agcMode == mir_sdr_AGC_DISABLE)? false: true;
+    //the software AGC drives the gain itself, keep the vendor loop out of its way
+    mir_sdr_AgcControl(softwareAgc ? mir_sdr_AGC_DISABLE : agcMode, setPoint, 0, 0, 0, 0, lnaState);
 }
 
 void SoapySDRPlay::setGain(const int direction, const size_t channel, const std::string &name, const double value)
@@ -417,21 +606,21 @@ void SoapySDRPlay::setGain(const int direction, const size_t channel, const std:
    }
    if ((doUpdate == true) && (streamActive))
    {
+      SoapySDRPlayTraceScope trace("mir_sdr_Reinit", "reason", mir_sdr_CHANGE_GR);
       mir_sdr_Reinit(&gRdB, 0.0, 0.0, mir_sdr_BW_Undefined, mir_sdr_IF_Undefined, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, mir_sdr_CHANGE_GR);
    }
+   publishState();
 }
 
 double SoapySDRPlay::getGain(const int direction, const size_t channel, const std::string &name) const
 {
-    std::lock_guard <std::mutex> lock(_general_state_mutex);
-
    if (name == "IFGR")
    {
        return current_gRdB;
    }
    else if (name == "RFGR")
    {
-      return lnaState;
+      return _state.load().lnaState;
    }
 
    return 0;
@@ -481,28 +670,31 @@ void SoapySDRPlay::setFrequency(const int direction,
          centerFrequency = (uint32_t)frequency;
          if (streamActive)
          {
+            SoapySDRPlayTraceScope trace("mir_sdr_Reinit", "reason", mir_sdr_CHANGE_RF_FREQ);
+            _metrics.retunes.fetch_add(1, std::memory_order_relaxed);
+            _metrics.retuneStartNs.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count(), std::memory_order_relaxed);
             mir_sdr_Reinit(&gRdB, 0.0, frequency / 1e6, mir_sdr_BW_Undefined, mir_sdr_IF_Undefined, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, mir_sdr_CHANGE_RF_FREQ);
          }
       }
       else if ((name == "CORR") && (ppm != frequency))
       {
          ppm = frequency;
-         mir_sdr_SetPpm(ppm);
+         if (not replayMode) mir_sdr_SetPpm(ppm);
       }
+      publishState();
    }
 }
 
 double SoapySDRPlay::getFrequency(const int direction, const size_t channel, const std::string &name) const
 {
-    std::lock_guard <std::mutex> lock(_general_state_mutex);
-
     if (name == "RF")
     {
-        return (double)centerFrequency;
+        return (double)_state.load().centerFrequency;
     }
     else if (name == "CORR")
     {
-        return ppm;
+        return _state.load().ppm;
     }
 
     return 0;
@@ -543,20 +735,27 @@ void SoapySDRPlay::setSampleRate(const int direction, const size_t channel, cons
 
     SoapySDR_logf(SOAPY_SDR_DEBUG, "Setting sample rate: %d", sampleRate);
 
+    if (replayMode)
+    {
+        // fixed by the replayed file
+        if ((uint32_t)rate != sampleRate) SoapySDR_logf(SOAPY_SDR_WARNING, "Replay sample rate is fixed at %d", sampleRate);
+        return;
+    }
+
     if (direction == SOAPY_SDR_RX)
     {
        unsigned int decMp = decM;
        reqSampleRate = (uint32_t)rate;
        uint32_t currSampleRate = sampleRate;
 
-       sampleRate = getInputSampleRateAndDecimation(reqSampleRate, &decM, &decEnable, ifMode);
-       bwMode = getBwEnumForRate(rate, ifMode);
+       applyRatePlan();
 
        if ((sampleRate != currSampleRate) || (decM != decMp) || (reqSampleRate != sampleRate))
        {
           resetBuffer = true;
           if (streamActive)
           {
+             SoapySDRPlayTraceScope trace("mir_sdr_Reinit", "reason", mir_sdr_CHANGE_FS_FREQ | mir_sdr_CHANGE_BW_TYPE);
              mir_sdr_Reinit(&gRdB, sampleRate / 1e6, 0.0, bwMode, mir_sdr_IF_Undefined, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, (mir_sdr_ReasonForReinitT)(mir_sdr_CHANGE_FS_FREQ | mir_sdr_CHANGE_BW_TYPE));
              if (ifMode == mir_sdr_IF_Zero)
              {
@@ -564,57 +763,130 @@ void SoapySDRPlay::setSampleRate(const int direction, const size_t channel, cons
              }
           }
        }
+       publishState();
     }
 }
 
 double SoapySDRPlay::getSampleRate(const int direction, const size_t channel) const
 {
-   return reqSampleRate;
+   return _state.load().reqSampleRate;
 }
 
 std::vector<double> SoapySDRPlay::listSampleRates(const int direction, const size_t channel) const
 {
     std::vector<double> rates;
 
-    rates.push_back(250000);
-    rates.push_back(500000);
-    rates.push_back(1000000);
-    rates.push_back(2000000);
-    rates.push_back(2048000);
-    rates.push_back(3000000);
-    rates.push_back(4000000);
-    rates.push_back(5000000);
-    rates.push_back(6000000);
-    rates.push_back(7000000);
-    rates.push_back(8000000);
-    rates.push_back(9000000);
-    rates.push_back(10000000);
+    if (replayMode)
+    {
+        rates.push_back(_replay->getSampleRate());
+        return rates;
+    }
+
+    static const uint32_t commonRates[] =
+    {
+        62500, 125000, 250000, 500000, 1000000, 2000000, 2048000, 3000000,
+        4000000, 5000000, 6000000, 7000000, 8000000, 9000000, 10000000
+    };
+
+    // the rates the current IF mode produces exactly, the planner never
+    // switches IF mode (a low-IF mode moves the signal), so other modes'
+    // rates only show after "if_mode" is changed
+    const SoapySDRPlayState state = _state.load();
+    for (const uint32_t rate : commonRates)
+    {
+        SoapySDRPlayRatePlan plan;
+        if (planSampleRate(rate, 0, state.ifMode, plan) and plan.outputRate == rate) rates.push_back(rate);
+    }
+    if (rates.empty()) rates.push_back(state.reqSampleRate);
     
     return rates;
 }
 
-uint32_t SoapySDRPlay::getInputSampleRateAndDecimation(uint32_t rate, unsigned int *decM, unsigned int *decEnable, mir_sdr_If_kHzT ifMode)
+std::vector<SoapySDRPlayRatePlan> SoapySDRPlay::listRatePlans(uint32_t rate, mir_sdr_If_kHzT ifMode)
 {
-   if (ifMode == mir_sdr_IF_2_048)
+   std::vector<SoapySDRPlayRatePlan> plans;
+   const auto addPlan = [&plans, ifMode](uint32_t adcRate, unsigned int decM)
+   {
+      SoapySDRPlayRatePlan plan;
+      plan.outputRate = adcRate / decM;
+      plan.adcRate = adcRate;
+      plan.ifMode = ifMode;
+      plan.decM = decM;
+      plan.decEnable = (decM > 1) ? 1 : 0;
+      plan.bwMode = mir_sdr_BW_Undefined;
+      plans.push_back(plan);
+   };
+
+   if (ifMode == mir_sdr_IF_Zero)
    {
-      if      (rate == 2048000) { *decM = 4; *decEnable = 1; return 8192000; }
+      // any ADC rate in range, decimated by a power of two
+      for (unsigned int decM = 1; decM <= SDRPLAY_MAX_DECIMATION; decM *= 2)
+      {
+         const double adcRate = std::min(std::max((double)rate * decM, (double)SDRPLAY_MIN_ADC_RATE), (double)SDRPLAY_MAX_ADC_RATE);
+         addPlan((uint32_t)adcRate, decM);
+      }
    }
    else if (ifMode == mir_sdr_IF_0_450)
    {
-      if      (rate == 1000000) { *decM = 2; *decEnable = 1; return 2000000; }
-      else if (rate == 500000)  { *decM = 4; *decEnable = 1; return 2000000; }
+      addPlan(2000000, 2);
+      addPlan(2000000, 4);
    }
-   else if (ifMode == mir_sdr_IF_Zero)
+   else if (ifMode == mir_sdr_IF_2_048)
    {
+      addPlan(8192000, 4);
+   }
+
+   return plans;
+}
+
+bool SoapySDRPlay::planSampleRate(uint32_t rate, uint32_t bandwidth, mir_sdr_If_kHzT ifMode, SoapySDRPlayRatePlan &plan)
+{
+   const std::vector<SoapySDRPlayRatePlan> plans = listRatePlans(rate, ifMode);
+   if (plans.empty()) return false;
+
+   // the API decimates on the host, so the ADC rate is both the USB load and the CPU load
+   const auto error = [rate](const SoapySDRPlayRatePlan &p) { return (p.outputRate > rate) ? p.outputRate - rate : rate - p.outputRate; };
+   plan = *std::min_element(plans.begin(), plans.end(), [&error](const SoapySDRPlayRatePlan &a, const SoapySDRPlayRatePlan &b)
+   {
+      if (error(a) != error(b)) return error(a) < error(b);
+      if (a.adcRate != b.adcRate) return a.adcRate < b.adcRate;
+      return a.decM < b.decM;
+   });
+
+   // a requested filter is kept as long as the IF mode passes it
+   plan.bwMode = getBwEnumForRate(plan.outputRate, ifMode);
+   if (bandwidth != 0)
+   {
+      const mir_sdr_Bw_MHzT requested = mirGetBwMhzEnum(bandwidth);
+      if (getBwValueFromEnum(requested) <= getBwValueFromEnum(getBwEnumForRate(SDRPLAY_MAX_ADC_RATE, ifMode))) plan.bwMode = requested;
+   }
+   return true;
+}
 
-      if      ((rate >= 200000)  && (rate < 500000))  { *decM = 8; *decEnable = 1; return 2000000; }
-      else if ((rate >= 500000)  && (rate < 1000000)) { *decM = 4; *decEnable = 1; return 2000000; }
-      else if ((rate >= 1000000) && (rate < 2000000)) { *decM = 2; *decEnable = 1; return 2000000; }
-      else                                            { *decM = 1; *decEnable = 0; return rate; }
+void SoapySDRPlay::applyRatePlan(void)
+{
+   SoapySDRPlayRatePlan plan;
+   if (not planSampleRate(reqSampleRate, reqBandwidth, ifMode, plan))
+   {
+      // no known ADC rate for the IF mode, pass the rate through as before
+      SoapySDR_logf(SOAPY_SDR_WARNING, "No sample rate plan for %d Sps with IF mode %s", reqSampleRate, IFtoString(ifMode).c_str());
+      sampleRate = reqSampleRate;
+      decM = 1;
+      decEnable = 0;
+      bwMode = getBwEnumForRate(reqSampleRate, ifMode);
+      return;
    }
 
-   // this is invalid, but return something
-   *decM = 1; *decEnable = 0; return rate;
+   if (plan.outputRate != reqSampleRate)
+   {
+      SoapySDR_logf(SOAPY_SDR_WARNING, "Sample rate %d Sps not available with IF mode %s, using %d Sps",
+                    reqSampleRate, IFtoString(ifMode).c_str(), plan.outputRate);
+      reqSampleRate = plan.outputRate;
+   }
+   sampleRate = plan.adcRate;
+   decM = plan.decM;
+   decEnable = plan.decEnable;
+   bwMode = plan.bwMode;
 }
 
 /*******************************************************************
@@ -627,24 +899,27 @@ void SoapySDRPlay::setBandwidth(const int direction, const size_t channel, const
 
    if (direction == SOAPY_SDR_RX) 
    {
-      if (getBwValueFromEnum(bwMode) != bw_in)
+      // 0 drops the requested filter and follows the sample rate again
+      reqBandwidth = (uint32_t)bw_in;
+      const mir_sdr_Bw_MHzT newBwMode = (reqBandwidth == 0) ? getBwEnumForRate(reqSampleRate, ifMode) : mirGetBwMhzEnum(bw_in);
+      if (bwMode != newBwMode)
       {
-         bwMode = mirGetBwMhzEnum(bw_in);
+         bwMode = newBwMode;
          if (streamActive)
          {
+            SoapySDRPlayTraceScope trace("mir_sdr_Reinit", "reason", mir_sdr_CHANGE_BW_TYPE);
             mir_sdr_Reinit(&gRdB, 0.0, 0.0, bwMode, mir_sdr_IF_Undefined, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, mir_sdr_CHANGE_BW_TYPE);
          }
+         publishState();
       }
    }
 }
 
 double SoapySDRPlay::getBandwidth(const int direction, const size_t channel) const
 {
-    std::lock_guard <std::mutex> lock(_general_state_mutex);
-
    if (direction == SOAPY_SDR_RX)
    {
-      return getBwValueFromEnum(bwMode);
+      return getBwValueFromEnum(_state.load().bwMode);
    }
    return 0;
 }
@@ -692,7 +967,7 @@ mir_sdr_Bw_MHzT SoapySDRPlay::getBwEnumForRate(double rate, mir_sdr_If_kHzT ifMo
 {
    if (ifMode == mir_sdr_IF_Zero)
    {
-      if      ((rate >= 200000)  && (rate < 300000))  return mir_sdr_BW_0_200;
+      if      (rate < 300000)                         return mir_sdr_BW_0_200;
       else if ((rate >= 300000)  && (rate < 600000))  return mir_sdr_BW_0_300;
       else if ((rate >= 600000)  && (rate < 1536000)) return mir_sdr_BW_0_600;
       else if ((rate >= 1536000) && (rate < 5000000)) return mir_sdr_BW_1_536;
@@ -703,13 +978,13 @@ mir_sdr_Bw_MHzT SoapySDRPlay::getBwEnumForRate(double rate, mir_sdr_If_kHzT ifMo
    }
    else if ((ifMode == mir_sdr_IF_0_450) || (ifMode == mir_sdr_IF_1_620))
    {
-      if      ((rate >= 200000)  && (rate < 500000))  return mir_sdr_BW_0_200;
+      if      (rate < 500000)                         return mir_sdr_BW_0_200;
       else if ((rate >= 500000)  && (rate < 1000000)) return mir_sdr_BW_0_300;
       else                                            return mir_sdr_BW_0_600;
    }
    else
    {
-      if      ((rate >= 200000)  && (rate < 500000))  return mir_sdr_BW_0_200;
+      if      (rate < 500000)                         return mir_sdr_BW_0_200;
       else if ((rate >= 500000)  && (rate < 1000000)) return mir_sdr_BW_0_300;
       else if ((rate >= 1000000) && (rate < 1536000)) return mir_sdr_BW_0_600;
       else                                            return mir_sdr_BW_1_536;
@@ -769,6 +1044,88 @@ mir_sdr_If_kHzT SoapySDRPlay::stringToIF(std::string ifMode)
    return mir_sdr_IF_Zero;
 }
 
+void SoapySDRPlay::buildGainTable(void)
+{
+    const int maxLnaState = getMaxLnaState();
+
+    for (int band = 0; band < SDRPLAY_NUM_GAIN_BANDS; band++)
+    {
+        //query the middle of each band with a fixed IF gain reduction,
+        //what remains of the system gain reduction is due to the LNA state
+        const double rfMHz = (gainBandEdgesMHz[band] + gainBandEdgesMHz[band + 1]) / 2.0;
+        int lnaGr = 0;
+
+        for (int state = 0; state < SDRPLAY_MAX_LNA_STATES; state++)
+        {
+            if (state <= maxLnaState)
+            {
+                mir_sdr_BandT bandType;
+                int ifGr = 40;
+                int systemGr = 0;
+                if (mir_sdr_GetGrByFreq(rfMHz, &bandType, &ifGr, state, &systemGr, mir_sdr_USE_RSP_SET_GR) == mir_sdr_Success)
+                {
+                    lnaGr = std::max(systemGr - ifGr, 0);
+                }
+            }
+            //states not supported in this band keep the deepest known reduction
+            lnaGrTable[band][state] = lnaGr;
+        }
+    }
+
+    for (int gr = 0; gr < SDRPLAY_MAX_SYSTEM_GR; gr++)
+    {
+        grScaleTable[gr] = std::pow(10.0f, gr / 20.0f);
+    }
+}
+
+int SoapySDRPlay::getMaxLnaState(void) const
+{
+    return (hwVer == 1) ? 3 : (hwVer == 2) ? 8 : 9;
+}
+
+int SoapySDRPlay::getGainBand(uint32_t frequency)
+{
+    const double rfMHz = frequency / 1e6;
+    int band = 0;
+    while ((band < SDRPLAY_NUM_GAIN_BANDS - 1) && (rfMHz >= gainBandEdgesMHz[band + 1])) band++;
+    return band;
+}
+
+float SoapySDRPlay::getConversionScale(const SoapySDRPlayState &state, int gRdBnow) const
+{
+    if (not calibratedOutput)
+    {
+        return 1.0f / 32768.0f;
+    }
+
+    //scale samples back to the level they would have at zero gain reduction
+    const int lnaIdx = std::min(std::max(state.lnaState, 0), SDRPLAY_MAX_LNA_STATES - 1);
+    const int systemGr = gRdBnow + lnaGrTable[getGainBand(state.centerFrequency)][lnaIdx];
+    return grScaleTable[std::min(std::max(systemGr, 0), SDRPLAY_MAX_SYSTEM_GR - 1)] / 32768.0f;
+}
+
+void SoapySDRPlay::publishState(void)
+{
+    SoapySDRPlayState state;
+    std::memset(&state, 0, sizeof(state));
+
+    state.centerFrequency = centerFrequency;
+    state.sampleRate = sampleRate;
+    state.reqSampleRate = reqSampleRate;
+    state.ppm = ppm;
+    state.bwMode = bwMode;
+    state.ifMode = ifMode;
+    state.agcMode = agcMode;
+    state.gRdB = gRdB;
+    state.lnaState = lnaState;
+    state.dcOffsetMode = dcOffsetMode;
+    state.antSel = antSel;
+    state.tunSel = tunSel;
+    state.amPort = amPort;
+
+    _state.store(state);
+}
+
 std::string SoapySDRPlay::IFtoString(mir_sdr_If_kHzT ifkHzT)
 {
    switch (ifkHzT)
@@ -892,6 +1249,14 @@ SoapySDR::ArgInfoList SoapySDRPlay::getSettingInfo(void) const
     IQcorrArg.type = SoapySDR::ArgInfo::BOOL;
     setArgs.push_back(IQcorrArg);
 
+    SoapySDR::ArgInfo CalibratedArg;
+    CalibratedArg.key = "calibrated_output";
+    CalibratedArg.value = "false";
+    CalibratedArg.name = "Calibrated Output";
+    CalibratedArg.description = "Scale CF32 samples by the inverse of the current gain, full scale at 0 dB gain reduction";
+    CalibratedArg.type = SoapySDR::ArgInfo::BOOL;
+    setArgs.push_back(CalibratedArg);
+
     SoapySDR::ArgInfo SetPointArg;
     SetPointArg.key = "agc_setpoint";
     SetPointArg.value = "-30";
@@ -901,6 +1266,87 @@ SoapySDR::ArgInfoList SoapySDRPlay::getSettingInfo(void) const
     SetPointArg.range = SoapySDR::Range(-60, 0);
     setArgs.push_back(SetPointArg);
 
+    SoapySDR::ArgInfo AgcEngineArg;
+    AgcEngineArg.key = "agc_engine";
+    AgcEngineArg.value = "vendor";
+    AgcEngineArg.name = "AGC Engine";
+    AgcEngineArg.description = "Automatic gain control by the vendor 100 Hz loop or by the driver";
+    AgcEngineArg.type = SoapySDR::ArgInfo::STRING;
+    AgcEngineArg.options.push_back("vendor");
+    AgcEngineArg.options.push_back("software");
+    setArgs.push_back(AgcEngineArg);
+
+    SoapySDR::ArgInfo AgcAttackArg;
+    AgcAttackArg.key = "agc_attack_ms";
+    AgcAttackArg.value = std::to_string(DEFAULT_AGC_ATTACK_MS);
+    AgcAttackArg.name = "AGC Attack";
+    AgcAttackArg.description = "Software AGC time constant for reducing gain (ms)";
+    AgcAttackArg.type = SoapySDR::ArgInfo::INT;
+    AgcAttackArg.range = SoapySDR::Range(1, 10000);
+    setArgs.push_back(AgcAttackArg);
+
+    SoapySDR::ArgInfo AgcDecayArg;
+    AgcDecayArg.key = "agc_decay_ms";
+    AgcDecayArg.value = std::to_string(DEFAULT_AGC_DECAY_MS);
+    AgcDecayArg.name = "AGC Decay";
+    AgcDecayArg.description = "Software AGC time constant for restoring gain (ms)";
+    AgcDecayArg.type = SoapySDR::ArgInfo::INT;
+    AgcDecayArg.range = SoapySDR::Range(1, 10000);
+    setArgs.push_back(AgcDecayArg);
+
+    SoapySDR::ArgInfo AgcHysteresisArg;
+    AgcHysteresisArg.key = "agc_hysteresis";
+    AgcHysteresisArg.value = std::to_string(DEFAULT_AGC_HYSTERESIS_DB);
+    AgcHysteresisArg.name = "AGC Hysteresis";
+    AgcHysteresisArg.description = "Software AGC dead band around the setpoint (dB)";
+    AgcHysteresisArg.type = SoapySDR::ArgInfo::INT;
+    AgcHysteresisArg.range = SoapySDR::Range(0, 20);
+    setArgs.push_back(AgcHysteresisArg);
+
+    SoapySDR::ArgInfo TransferModeArg;
+    TransferModeArg.key = "transfer_mode";
+    TransferModeArg.value = DEFAULT_TRANSFER_MODE;
+    TransferModeArg.name = "USB Transfer Mode";
+    TransferModeArg.description = "USB transfer mode, applied when the stream is (re)activated";
+    TransferModeArg.type = SoapySDR::ArgInfo::STRING;
+    TransferModeArg.options.push_back("isoch");
+    TransferModeArg.options.push_back("bulk");
+    setArgs.push_back(TransferModeArg);
+
+    SoapySDR::ArgInfo TraceArg;
+    TraceArg.key = "trace";
+    TraceArg.value = "false";
+    TraceArg.name = "Event Trace";
+    TraceArg.description = "Record driver events, written as Chrome trace JSON by writeSetting(\"trace_dump\", path)";
+    TraceArg.type = SoapySDR::ArgInfo::BOOL;
+    setArgs.push_back(TraceArg);
+
+    SoapySDR::ArgInfo MetricsServerArg;
+    MetricsServerArg.key = "metrics_server";
+    MetricsServerArg.value = "";
+    MetricsServerArg.name = "Metrics Server";
+    MetricsServerArg.description = "Serve OpenMetrics over HTTP on [host:]port or unix:<path>, empty to stop";
+    MetricsServerArg.type = SoapySDR::ArgInfo::STRING;
+    setArgs.push_back(MetricsServerArg);
+
+    SoapySDR::ArgInfo MetricsFileArg;
+    MetricsFileArg.key = "metrics_file";
+    MetricsFileArg.value = "";
+    MetricsFileArg.name = "Metrics File";
+    MetricsFileArg.description = "Rewrite this OpenMetrics text file every interval, empty to stop";
+    MetricsFileArg.type = SoapySDR::ArgInfo::STRING;
+    setArgs.push_back(MetricsFileArg);
+
+    SoapySDR::ArgInfo MetricsIntervalArg;
+    MetricsIntervalArg.key = "metrics_interval";
+    MetricsIntervalArg.value = std::to_string(DEFAULT_METRICS_INTERVAL);
+    MetricsIntervalArg.name = "Metrics Interval";
+    MetricsIntervalArg.description = "Seconds between metrics updates, rates and quantiles cover one interval";
+    MetricsIntervalArg.type = SoapySDR::ArgInfo::FLOAT;
+    MetricsIntervalArg.units = "s";
+    MetricsIntervalArg.range = SoapySDR::Range(0.1, 3600);
+    setArgs.push_back(MetricsIntervalArg);
+
     if (hwVer == 2) // RSP2/RSP2pro
     {
        SoapySDR::ArgInfo ExtRefArg;
@@ -993,6 +1439,56 @@ SoapySDR::ArgInfoList SoapySDRPlay::getSettingInfo(void) const
 
 void SoapySDRPlay::writeSetting(const std::string &key, const std::string &value)
 {
+    if (writeStreamingSetting(key, value))
+    {
+        if (key == "memory_lock")
+        {
+            std::lock_guard <std::mutex> lock(_buf_mutex);
+            lockRingMemory(value == "true");
+        }
+        else if ((key == "record_path") and (streamActive or replayActive))
+        {
+            stopRecorder();
+            startRecorder();
+        }
+        else if ((key == "shm_name") and (streamActive or replayActive))
+        {
+            stopSharedStream();
+            startSharedStream();
+        }
+        else if ((key == "net_server" or key == "net_codec") and (streamActive or replayActive))
+        {
+            stopNetServer();
+            startNetServer();
+        }
+        return;
+    }
+
+    // the trace is process wide and takes no device lock
+    if (key == "trace")
+    {
+        SoapySDRPlayTrace::enable(value == "true");
+        return;
+    }
+    if (key == "trace_dump")
+    {
+        SoapySDRPlayTrace::dump(value);
+        return;
+    }
+
+    if (key == "metrics_server" or key == "metrics_file" or key == "metrics_interval")
+    {
+        {
+            std::lock_guard <std::mutex> lock(_metrics_mutex);
+            if (key == "metrics_server") metricsServer = value;
+            if (key == "metrics_file") metricsFile = value;
+            if (key == "metrics_interval") metricsInterval = std::max(std::stod(value), 0.1);
+        }
+        stopMetricsExporter();
+        startMetricsExporter();
+        return;
+    }
+
     std::lock_guard <std::mutex> lock(_general_state_mutex);
 
 #ifdef RF_GAIN_IN_MENU
@@ -1010,40 +1506,78 @@ void SoapySDRPlay::writeSetting(const std::string &key, const std::string &value
       else                   lnaState = 9;
       if (agcMode != mir_sdr_AGC_DISABLE)
       {
-         mir_sdr_AgcControl(agcMode, setPoint, 0, 0, 0, 0, lnaState);
+         applyAgcControl();
       }
-      else
+      else if (not replayMode)
       {
+         SoapySDRPlayTraceScope trace("mir_sdr_Reinit", "reason", mir_sdr_CHANGE_GR);
          mir_sdr_Reinit(&gRdB, 0.0, 0.0, mir_sdr_BW_Undefined, mir_sdr_IF_Undefined, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, mir_sdr_CHANGE_GR);
       }
    }
    else
 #endif
-   if (key == "if_mode")
+   if ((key == "if_mode") and replayMode)
+   {
+      // the replayed samples are already at baseband
+   }
+   else if (key == "if_mode")
    {
       if (ifMode != stringToIF(value))
       {
          ifMode = stringToIF(value);
-         sampleRate = getInputSampleRateAndDecimation(reqSampleRate, &decM, &decEnable, ifMode);
-         bwMode = getBwEnumForRate(reqSampleRate, ifMode);
+         applyRatePlan();
          if (streamActive)
          {
             mir_sdr_DecimateControl(0, 1, 1);
+            SoapySDRPlayTraceScope trace("mir_sdr_Reinit", "reason", mir_sdr_CHANGE_FS_FREQ | mir_sdr_CHANGE_BW_TYPE | mir_sdr_CHANGE_IF_TYPE);
             mir_sdr_Reinit(&gRdB, sampleRate / 1e6, 0.0, bwMode, ifMode, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, (mir_sdr_ReasonForReinitT)(mir_sdr_CHANGE_FS_FREQ | mir_sdr_CHANGE_BW_TYPE | mir_sdr_CHANGE_IF_TYPE));
          }
       }
    }
+   else if (key == "transfer_mode")
+   {
+      if (value != "isoch" and value != "bulk")
+      {
+         SoapySDR_logf(SOAPY_SDR_WARNING, "Unknown transfer_mode '%s'", value.c_str());
+      }
+      else if (value != transferMode)
+      {
+         transferMode = value;
+         if (streamActive) SoapySDR_log(SOAPY_SDR_INFO, "transfer_mode applies when the stream is activated again");
+      }
+   }
    else if (key == "iqcorr_ctrl")
    {
       if (value == "false") IQcorr = 0;
       else                  IQcorr = 1;
-      mir_sdr_DCoffsetIQimbalanceControl(1, IQcorr);
+      if (not replayMode) mir_sdr_DCoffsetIQimbalanceControl(1, IQcorr);
       //mir_sdr_DCoffsetIQimbalanceControl(IQcorr, IQcorr);
    }
+   else if (key == "calibrated_output")
+   {
+      calibratedOutput = (value == "true");
+   }
    else if (key == "agc_setpoint")
    {
       setPoint = stoi(value);
-      mir_sdr_AgcControl(agcMode, setPoint, 0, 0, 0, 0, lnaState);
+      applyAgcControl();
+   }
+   else if (key == "agc_engine")
+   {
+      softwareAgc = (value == "software");
+      applyAgcControl();
+   }
+   else if (key == "agc_attack_ms")
+   {
+      agcAttackMs = std::max(stoi(value), 1);
+   }
+   else if (key == "agc_decay_ms")
+   {
+      agcDecayMs = std::max(stoi(value), 1);
+   }
+   else if (key == "agc_hysteresis")
+   {
+      agcHysteresis = std::max(stoi(value), 0);
    }
    else if (key == "extref_ctrl")
    {
@@ -1079,12 +1613,93 @@ void SoapySDRPlay::writeSetting(const std::string &key, const std::string &value
       if (hwVer == 3) mir_sdr_rspDuo_DabNotch(dabNotchEn);
       if (hwVer > 253) mir_sdr_rsp1a_DabNotch(dabNotchEn);
    }
+
+   publishState();
 }
 
 std::string SoapySDRPlay::readSetting(const std::string &key) const
 {
+    if (key == "last_buffer_meta")
+    {
+        //describes the buffer most recently handed out by acquireReadBuffer()
+        std::lock_guard <std::mutex> lock(_buf_mutex);
+        return bufferMetaToString(_lastMeta);
+    }
+
+    {
+        std::lock_guard <std::mutex> lock(_sched_mutex);
+        if (key == "rt_priority") return std::to_string(rtPriority);
+        if (key == "rt_policy") return rtPolicy;
+        if (key == "cpu_affinity") return cpuAffinity;
+        if (key == "memory_lock") return memoryLock ? "true" : "false";
+        if (key == "record_path") return recordPath;
+        if (key == "shm_name") return shmName;
+        if (key == "net_server") return netServer;
+        if (key == "net_codec") return netCodec;
+    }
+
+    if (key == "latency_ms") return std::to_string(latencyUs / 1000.0);
+
+    if (key == "trace") return SoapySDRPlayTrace::enabled() ? "true" : "false";
+    if (key == "trace_status") return SoapySDRPlayTrace::getStatus();
+
+    {
+        std::lock_guard <std::mutex> lock(_metrics_mutex);
+        if (key == "metrics_server") return metricsServer;
+        if (key == "metrics_file") return metricsFile;
+        if (key == "metrics_interval") return std::to_string(metricsInterval);
+        if (key == "metrics") return _metricsExporter ? _metricsExporter->getText() : "";
+        if (key == "metrics_status") return _metricsExporter ? _metricsExporter->getStatus() : "";
+    }
+
+    if (key == "stream_fd")
+    {
+        //only with a single reader, getStreamFd() tells readers apart
+        std::lock_guard <std::mutex> lock(_buf_mutex);
+        return (_streams.size() != 1) ? "-1" : std::to_string(_streams.front()->eventFd);
+    }
+
+    if (key == "record_status")
+    {
+        std::lock_guard <std::mutex> lock(_buf_mutex);
+        return _recorder ? _recorder->getStatus() : "";
+    }
+
+    if (key == "shm_status")
+    {
+        std::lock_guard <std::mutex> lock(_buf_mutex);
+        return _shm ? _shm->getStatus() : "";
+    }
+
+    if (key == "net_status")
+    {
+        std::lock_guard <std::mutex> lock(_buf_mutex);
+        return _net ? _net->getStatus() : "";
+    }
+
     std::lock_guard <std::mutex> lock(_general_state_mutex);
 
+    if (key == "startup_profile")
+    {
+        return startupProfileToString();
+    }
+
+    if (key == "stream_throughput")
+    {
+        return throughputToString();
+    }
+
+    if (key == "rate_plan")
+    {
+        return "output=" + std::to_string(reqSampleRate) +
+               ", adc=" + std::to_string(sampleRate) +
+               ", if=" + IFtoString(ifMode) +
+               ", decimation=" + std::to_string(decEnable ? decM : 1) +
+               ", bandwidth=" + std::to_string((uint32_t)getBwValueFromEnum(bwMode)) +
+               (reqBandwidth == 0 ? " (follows rate)" : " (requested)") +
+               ", searched=" + IFtoString(ifMode) + " only";
+    }
+
 #ifdef RF_GAIN_IN_MENU
     if (key == "rfgain_sel")
     {
@@ -1105,15 +1720,41 @@ std::string SoapySDRPlay::readSetting(const std::string &key) const
     {
         return IFtoString(ifMode);
     }
+    else if (key == "transfer_mode")
+    {
+       return transferMode;
+    }
     else if (key == "iqcorr_ctrl")
     {
        if (IQcorr == 0) return "false";
        else             return "true";
     }
+    else if (key == "calibrated_output")
+    {
+       if (calibratedOutput) return "true";
+       else                  return "false";
+    }
     else if (key == "agc_setpoint")
     {
        return std::to_string(setPoint);
     }
+    else if (key == "agc_engine")
+    {
+       if (softwareAgc) return "software";
+       else             return "vendor";
+    }
+    else if (key == "agc_attack_ms")
+    {
+       return std::to_string(agcAttackMs);
+    }
+    else if (key == "agc_decay_ms")
+    {
+       return std::to_string(agcDecayMs);
+    }
+    else if (key == "agc_hysteresis")
+    {
+       return std::to_string(agcHysteresis);
+    }
     else if (key == "extref_ctrl")
     {
        if (extRef == 0) return "false";
@@ -0,0 +1,574 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "SharedMemory.hpp"
+#include <SoapySDR/Logger.h>
+#include <stdexcept>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <new>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory ring needs lock-free 64 bit atomics");
+
+static std::string shmName(const std::string &name)
+{
+    return (not name.empty() and name[0] == '/') ? name : "/" + name;
+}
+
+static size_t roundUp(const size_t value, const size_t align)
+{
+    return (value + align - 1) / align * align;
+}
+
+/*******************************************************************
+ * Writer
+ ******************************************************************/
+
+SoapySDRPlayShmWriter::SoapySDRPlayShmWriter(const std::string &name, const std::string &format, const size_t slotBytes, const ReleaseFn &release):
+    _name(shmName(name)),
+    _release(release),
+    _header(nullptr),
+    _slots(nullptr),
+    _data(nullptr),
+    _bytes(0),
+    _writeSeq(0),
+    _skipped(0),
+    _running(true)
+{
+#ifdef _WIN32
+    throw std::runtime_error("shared memory streaming is not supported on this platform");
+#else
+    const size_t slotStride = roundUp(slotBytes, 64);
+    const size_t dataOffset = roundUp(sizeof(SoapySDRPlayShmHeader) + SDRPLAY_SHM_NUM_SLOTS * sizeof(SoapySDRPlayShmSlot), 4096);
+    _bytes = dataOffset + SDRPLAY_SHM_NUM_SLOTS * slotStride;
+
+    //a writer that died leaves its segment behind, readers still holding it see no more data
+    shm_unlink(_name.c_str());
+    const int fd = shm_open(_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) throw std::runtime_error("shm_open(" + _name + ") failed: " + std::strerror(errno));
+
+    if (ftruncate(fd, _bytes) != 0)
+    {
+        const int err = errno;
+        close(fd);
+        shm_unlink(_name.c_str());
+        throw std::runtime_error("shared memory resize failed: " + std::string(std::strerror(err)));
+    }
+
+    void *mem = mmap(nullptr, _bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED)
+    {
+        shm_unlink(_name.c_str());
+        throw std::runtime_error("shared memory mmap failed: " + std::string(std::strerror(errno)));
+    }
+
+    _header = new (mem) SoapySDRPlayShmHeader();
+    _slots = (SoapySDRPlayShmSlot *)((unsigned char *)mem + sizeof(SoapySDRPlayShmHeader));
+    for (size_t i = 0; i < SDRPLAY_SHM_NUM_SLOTS; i++) new (&_slots[i]) SoapySDRPlayShmSlot();
+    _data = (unsigned char *)mem + dataOffset;
+
+    _header->version = SDRPLAY_SHM_VERSION;
+    _header->numSlots = SDRPLAY_SHM_NUM_SLOTS;
+    _header->slotBytes = slotStride;
+    _header->dataOffset = dataOffset;
+    std::strncpy(_header->format, format.c_str(), sizeof(_header->format) - 1);
+    _header->generation = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count() ^ ((uint64_t)getpid() << 48);
+    _header->magic.store(SDRPLAY_SHM_MAGIC, std::memory_order_release);
+
+    _writer = std::thread(&SoapySDRPlayShmWriter::writer_loop, this);
+    SoapySDR_logf(SOAPY_SDR_INFO, "Sharing the stream as %s (%s, %d slots)", _name.c_str(), format.c_str(), SDRPLAY_SHM_NUM_SLOTS);
+#endif
+}
+
+SoapySDRPlayShmWriter::~SoapySDRPlayShmWriter(void)
+{
+    {
+        std::lock_guard <std::mutex> lock(_mutex);
+        _running = false;
+    }
+    _cond.notify_one();
+    if (_writer.joinable()) _writer.join();
+
+    //whatever the thread didn't get to
+    for (const auto &block : _queue) _release(block.handle);
+    _queue.clear();
+
+#ifndef _WIN32
+    _header->closed.store(1, std::memory_order_release);
+    _header->wakeSeq.fetch_add(1, std::memory_order_release);
+#ifdef __linux__
+    syscall(SYS_futex, &_header->wakeSeq, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+    munmap((void *)_header, _bytes);
+    shm_unlink(_name.c_str());
+#endif
+}
+
+bool SoapySDRPlayShmWriter::push(const Block &block)
+{
+    {
+        std::lock_guard <std::mutex> lock(_mutex);
+        if (not _running) return false;
+        if (_queue.size() >= SDRPLAY_SHM_MAX_BLOCKS)
+        {
+            _skipped++;
+            return false;
+        }
+        _queue.push_back(block);
+    }
+    _cond.notify_one();
+    return true;
+}
+
+void SoapySDRPlayShmWriter::writer_loop(void)
+{
+    std::unique_lock <std::mutex> lock(_mutex);
+
+    while (true)
+    {
+        _cond.wait(lock, [this]{ return not _running or not _queue.empty(); });
+        if (not _running) break;
+
+        const Block block = _queue.front();
+        _queue.pop_front();
+
+        lock.unlock();
+        publish(block.data, block.bytes, block.meta);
+        _release(block.handle);
+        lock.lock();
+    }
+}
+
+void SoapySDRPlayShmWriter::publish(const void *data, const size_t bytes, const SoapySDRPlayShmMeta &meta)
+{
+    const uint64_t n = _writeSeq;
+    const size_t index = n % SDRPLAY_SHM_NUM_SLOTS;
+    SoapySDRPlayShmSlot &slot = _slots[index];
+
+    slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.meta = meta;
+    slot.meta.bytes = std::min<size_t>(bytes, _header->slotBytes);
+    std::memcpy(_data + index * _header->slotBytes, data, slot.meta.bytes);
+
+    slot.seq.store(2 * n + 2, std::memory_order_release);
+
+    _header->sampleRate.store(meta.sampleRate, std::memory_order_relaxed);
+    _header->centerFrequency.store(meta.centerFrequency, std::memory_order_relaxed);
+    _header->writeSeq.store(n + 1, std::memory_order_release);
+    _writeSeq = n + 1;
+
+    _header->wakeSeq.fetch_add(1, std::memory_order_release);
+#ifdef __linux__
+    syscall(SYS_futex, &_header->wakeSeq, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+std::string SoapySDRPlayShmWriter::getStatus(void) const
+{
+    std::stringstream ss;
+    ss << "name=" << _name << ", format=" << _header->format
+       << ", slots=" << _header->numSlots << ", published=" << _header->writeSeq.load(std::memory_order_relaxed)
+       << ", skipped=" << _skipped;
+    return ss.str();
+}
+
+/*******************************************************************
+ * Reader
+ ******************************************************************/
+
+SoapySDRPlayShmReader::SoapySDRPlayShmReader(const std::string &name):
+    _name(shmName(name)),
+    _header(nullptr),
+    _slots(nullptr),
+    _data(nullptr),
+    _bytes(0),
+    _cursor(0)
+{
+#ifdef _WIN32
+    throw std::runtime_error("shared memory streaming is not supported on this platform");
+#else
+    attach();
+#endif
+}
+
+SoapySDRPlayShmReader::~SoapySDRPlayShmReader(void)
+{
+    detach();
+}
+
+void SoapySDRPlayShmReader::attach(void)
+{
+#ifndef _WIN32
+    const int fd = shm_open(_name.c_str(), O_RDONLY, 0);
+    if (fd < 0) throw std::runtime_error("no shared stream " + _name + ": " + std::strerror(errno));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 or (size_t)st.st_size < sizeof(SoapySDRPlayShmHeader))
+    {
+        close(fd);
+        throw std::runtime_error("shared stream " + _name + " is not ready");
+    }
+
+    void *mem = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) throw std::runtime_error("shared memory mmap failed: " + std::string(std::strerror(errno)));
+
+    const SoapySDRPlayShmHeader *header = (const SoapySDRPlayShmHeader *)mem;
+    if (header->magic.load(std::memory_order_acquire) != SDRPLAY_SHM_MAGIC or
+        header->version != SDRPLAY_SHM_VERSION or
+        (size_t)st.st_size < header->dataOffset + (size_t)header->numSlots * header->slotBytes)
+    {
+        munmap(mem, st.st_size);
+        throw std::runtime_error("shared stream " + _name + " is not ready or incompatible");
+    }
+
+    _header = header;
+    _slots = (const SoapySDRPlayShmSlot *)((const unsigned char *)mem + sizeof(SoapySDRPlayShmHeader));
+    _data = (const unsigned char *)mem + header->dataOffset;
+    _bytes = st.st_size;
+    seekLatest();
+#endif
+}
+
+void SoapySDRPlayShmReader::detach(void)
+{
+#ifndef _WIN32
+    if (_header != nullptr) munmap((void *)_header, _bytes);
+#endif
+    _header = nullptr;
+}
+
+bool SoapySDRPlayShmReader::reattach(void)
+{
+    const uint64_t generation = _header->generation;
+    try
+    {
+        SoapySDRPlayShmReader other(_name);
+        if (other._header->generation == generation) return false;
+
+        //take over the new mapping
+        detach();
+        std::swap(_header, other._header);
+        std::swap(_bytes, other._bytes);
+        _slots = other._slots;
+        _data = other._data;
+        _cursor = other._cursor;
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+    SoapySDR_logf(SOAPY_SDR_INFO, "Reattached to restarted shared stream %s", _name.c_str());
+    return true;
+}
+
+void SoapySDRPlayShmReader::seekLatest(void)
+{
+    _cursor = _header->writeSeq.load(std::memory_order_acquire);
+}
+
+bool SoapySDRPlayShmReader::wait(const long timeoutUs)
+{
+    const uint32_t wake = _header->wakeSeq.load(std::memory_order_acquire);
+    if (_header->writeSeq.load(std::memory_order_acquire) != _cursor) return true;
+    if (_header->closed.load(std::memory_order_acquire)) return false;
+
+#ifdef __linux__
+    struct timespec ts;
+    ts.tv_sec = timeoutUs / 1000000;
+    ts.tv_nsec = (timeoutUs % 1000000) * 1000;
+    syscall(SYS_futex, &_header->wakeSeq, FUTEX_WAIT, wake, &ts, nullptr, 0);
+#else
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs);
+    while (_header->wakeSeq.load(std::memory_order_acquire) == wake and std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+#endif
+    return _header->writeSeq.load(std::memory_order_acquire) != _cursor;
+}
+
+int SoapySDRPlayShmReader::read(void *data, SoapySDRPlayShmMeta &meta, const long timeoutUs)
+{
+    if (not wait(timeoutUs))
+    {
+        //the writer went away, or was restarted without a clean close
+        reattach();
+        return SOAPY_SDR_TIMEOUT;
+    }
+
+    const uint64_t n = _cursor;
+    const SoapySDRPlayShmSlot &slot = _slots[n % _header->numSlots];
+
+    const uint64_t seq0 = slot.seq.load(std::memory_order_acquire);
+    if (seq0 == 2 * n + 2)
+    {
+        meta = slot.meta;
+        meta.bytes = std::min(meta.bytes, _header->slotBytes);
+        std::memcpy(data, _data + (n % _header->numSlots) * _header->slotBytes, meta.bytes);
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        //a stamp still in place means the writer didn't lap us while copying
+        if (slot.seq.load(std::memory_order_relaxed) == seq0)
+        {
+            _cursor = n + 1;
+            return meta.bytes;
+        }
+    }
+
+    //overrun: skip to the newest data, like the driver's own ring drains on overflow
+    seekLatest();
+    return SOAPY_SDR_OVERFLOW;
+}
+
+std::string SoapySDRPlayShmReader::getFormat(void) const
+{
+    return std::string(_header->format, strnlen(_header->format, sizeof(_header->format)));
+}
+
+size_t SoapySDRPlayShmReader::getSlotBytes(void) const
+{
+    return _header->slotBytes;
+}
+
+uint32_t SoapySDRPlayShmReader::getSampleRate(void) const
+{
+    return _header->sampleRate.load(std::memory_order_relaxed);
+}
+
+uint32_t SoapySDRPlayShmReader::getCenterFrequency(void) const
+{
+    return _header->centerFrequency.load(std::memory_order_relaxed);
+}
+
+/*******************************************************************
+ * Companion device
+ ******************************************************************/
+
+SoapySDRPlayShmDevice::SoapySDRPlayShmDevice(const SoapySDR::Kwargs &args):
+    _name(args.at("shm")),
+    _reader(new SoapySDRPlayShmReader(args.at("shm"))),
+    _useShort(true),
+    _hostTime(false),
+    _active(false),
+    _slotElems(0),
+    _slotOffset(0)
+{
+    std::memset(&_meta, 0, sizeof(_meta));
+    _slot.resize(_reader->getSlotBytes());
+}
+
+std::string SoapySDRPlayShmDevice::getDriverKey(void) const
+{
+    return "SDRplay";
+}
+
+std::string SoapySDRPlayShmDevice::getHardwareKey(void) const
+{
+    return "Shared";
+}
+
+SoapySDR::Kwargs SoapySDRPlayShmDevice::getHardwareInfo(void) const
+{
+    SoapySDR::Kwargs hwArgs;
+    hwArgs["shm_name"] = _name;
+    hwArgs["shm_format"] = _reader->getFormat();
+    return hwArgs;
+}
+
+size_t SoapySDRPlayShmDevice::getNumChannels(const int dir) const
+{
+    return (dir == SOAPY_SDR_RX) ? 1 : 0;
+}
+
+std::vector<std::string> SoapySDRPlayShmDevice::getStreamFormats(const int direction, const size_t channel) const
+{
+    std::vector<std::string> formats;
+
+    formats.push_back("CS16");
+    formats.push_back("CF32");
+
+    return formats;
+}
+
+std::string SoapySDRPlayShmDevice::getNativeStreamFormat(const int direction, const size_t channel, double &fullScale) const
+{
+    if (_reader->getFormat() == "CF32")
+    {
+        fullScale = 1.0;
+        return "CF32";
+    }
+    fullScale = 32767;
+    return "CS16";
+}
+
+SoapySDR::Stream *SoapySDRPlayShmDevice::setupStream(const int direction,
+                                                     const std::string &format,
+                                                     const std::vector<size_t> &channels,
+                                                     const SoapySDR::Kwargs &args)
+{
+    if (direction != SOAPY_SDR_RX) throw std::runtime_error("the shared stream is receive only");
+    if (channels.size() > 1 or (channels.size() > 0 and channels.at(0) != 0))
+    {
+        throw std::runtime_error("setupStream invalid channel selection");
+    }
+    if (format != "CS16" and format != "CF32")
+    {
+        throw std::runtime_error("setupStream invalid format '" + format + "' -- Only CS16 or CF32 are supported by the SoapySDRPlay module.");
+    }
+
+    _useShort = (format == "CS16");
+    _hostTime = (args.count("host_time") != 0) and (args.at("host_time") == "true");
+    _slotElems = 0;
+    _slotOffset = 0;
+    return (SoapySDR::Stream *)this;
+}
+
+void SoapySDRPlayShmDevice::closeStream(SoapySDR::Stream *stream)
+{
+    _active = false;
+}
+
+size_t SoapySDRPlayShmDevice::getStreamMTU(SoapySDR::Stream *stream) const
+{
+    return _reader->getSlotBytes() / ((_reader->getFormat() == "CF32") ? 2 * sizeof(float) : 2 * sizeof(short));
+}
+
+int SoapySDRPlayShmDevice::activateStream(SoapySDR::Stream *stream, const int flags, const long long timeNs, const size_t numElems)
+{
+    if (flags != 0) return SOAPY_SDR_NOT_SUPPORTED;
+
+    _reader->seekLatest();
+    _slotElems = 0;
+    _slotOffset = 0;
+    _active = true;
+    return 0;
+}
+
+int SoapySDRPlayShmDevice::deactivateStream(SoapySDR::Stream *stream, const int flags, const long long timeNs)
+{
+    if (flags != 0) return SOAPY_SDR_NOT_SUPPORTED;
+
+    _active = false;
+    return 0;
+}
+
+int SoapySDRPlayShmDevice::readStream(SoapySDR::Stream *stream,
+                                      void * const *buffs,
+                                      const size_t numElems,
+                                      int &flags,
+                                      long long &timeNs,
+                                      const long timeoutUs)
+{
+    if (not _active) return 0;
+
+    const bool shmShort = (_reader->getFormat() != "CF32");
+
+    if (_slotOffset == _slotElems)
+    {
+        int ret = _reader->read(_slot.data(), _meta, timeoutUs);
+        if (ret < 0) return ret;
+        _slotElems = ret / (shmShort ? 2 * sizeof(short) : 2 * sizeof(float));
+        _slotOffset = 0;
+    }
+
+    const size_t n = std::min(numElems, _slotElems - _slotOffset);
+
+    //convert only when the reader asked for the other format
+    if (shmShort)
+    {
+        const short *src = (const short *)_slot.data() + 2 * _slotOffset;
+        if (_useShort) std::memcpy(buffs[0], src, n * 2 * sizeof(short));
+        else
+        {
+            float *dst = (float *)buffs[0];
+            for (size_t i = 0; i < 2 * n; i++) dst[i] = src[i] / 32768.0f;
+        }
+    }
+    else
+    {
+        const float *src = (const float *)_slot.data() + 2 * _slotOffset;
+        if (not _useShort) std::memcpy(buffs[0], src, n * 2 * sizeof(float));
+        else
+        {
+            short *dst = (short *)buffs[0];
+            for (size_t i = 0; i < 2 * n; i++) dst[i] = (short)std::max(-32768.0f, std::min(32767.0f, src[i] * 32768.0f));
+        }
+    }
+
+    //the writer's host clock, a later fragment starts that many periods after the slot
+    flags = _hostTime ? SOAPY_SDR_HAS_TIME : 0;
+    timeNs = _meta.timeNs + (long long)(_slotOffset * 1e9 / _meta.sampleRate);
+    _slotOffset += n;
+    return n;
+}
+
+double SoapySDRPlayShmDevice::getFrequency(const int direction, const size_t channel) const
+{
+    return _reader->getCenterFrequency();
+}
+
+double SoapySDRPlayShmDevice::getSampleRate(const int direction, const size_t channel) const
+{
+    return _reader->getSampleRate();
+}
+
+std::vector<double> SoapySDRPlayShmDevice::listSampleRates(const int direction, const size_t channel) const
+{
+    return std::vector<double>(1, _reader->getSampleRate());
+}
+
+std::string SoapySDRPlayShmDevice::readSetting(const std::string &key) const
+{
+    if (key == "last_buffer_meta")
+    {
+        std::stringstream ss;
+        ss << "frequency=" << _meta.centerFrequency << ", rate=" << _meta.sampleRate
+           << ", ifgr=" << _meta.gRdB << ", lna=" << _meta.lnaState
+           << ", overload=" << (_meta.overload ? "true" : "false")
+           << ", sample=" << _meta.sampleCount;
+        return ss.str();
+    }
+    return "";
+}
@@ -0,0 +1,251 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <SoapySDR/Device.hpp>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//stream fan-out to other processes over a named POSIX shared memory segment.
+//The driver is the single writer of a broadcast ring of slots, readers only
+//map it read-only and keep their own cursor, so any number of them can
+//follow the stream without the writer ever waiting on one.
+//
+//Slot n is stamped seq = 2n+1 while written and 2n+2 once complete,
+//a reader copies a slot out and checks the stamp again: a changed stamp
+//or a write counter more than numSlots ahead means it was overrun.
+//
+//The copy into the segment runs on the writer's own thread: push() only
+//queues a ring buffer, which is handed back through the release callback
+//once copied, at most SDRPLAY_SHM_MAX_BLOCKS at a time.
+
+#define SDRPLAY_SHM_MAGIC      (0x50524453u)
+#define SDRPLAY_SHM_VERSION    (2)
+#define SDRPLAY_SHM_NUM_SLOTS  (32)
+#define SDRPLAY_SHM_MAX_BLOCKS (4)
+
+struct SoapySDRPlayShmMeta
+{
+    uint64_t sampleCount;
+    uint32_t centerFrequency;
+    uint32_t sampleRate;
+    int32_t gRdB;
+    int32_t lnaState;
+    uint32_t overload;
+    uint32_t changes;
+    uint32_t bytes;
+    //host steady clock time of the first sample, comparable across
+    //processes on the same machine
+    int64_t timeNs;
+};
+
+struct SoapySDRPlayShmSlot
+{
+    std::atomic<uint64_t> seq;
+    SoapySDRPlayShmMeta meta;
+};
+
+struct SoapySDRPlayShmHeader
+{
+    //written last, readers ignore the segment until it is set
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    uint32_t numSlots;
+    uint32_t slotBytes;
+    uint32_t dataOffset;
+    //"CS16" or "CF32"
+    char format[8];
+    //tells a restarted writer apart from the one a reader attached to
+    uint64_t generation;
+
+    std::atomic<uint64_t> writeSeq;
+    //futex word bumped on every publish, readers map the segment
+    //read-only so the writer wakes unconditionally, once per slot
+    std::atomic<uint32_t> wakeSeq;
+    std::atomic<uint32_t> closed;
+
+    std::atomic<uint32_t> sampleRate;
+    std::atomic<uint32_t> centerFrequency;
+};
+
+class SoapySDRPlayShmWriter
+{
+public:
+    typedef std::function<void(size_t handle)> ReleaseFn;
+
+    struct Block
+    {
+        size_t handle;
+        const void *data;
+        size_t bytes;
+        SoapySDRPlayShmMeta meta;
+    };
+
+    //replaces any stale segment of the same name
+    SoapySDRPlayShmWriter(const std::string &name, const std::string &format, const size_t slotBytes, const ReleaseFn &release);
+
+    //marks the segment closed, wakes the readers and unlinks it
+    ~SoapySDRPlayShmWriter(void);
+
+    //false when the writer is still busy with earlier buffers and skips
+    //this one, the caller keeps the buffer then; never blocks
+    bool push(const Block &block);
+
+    std::string getStatus(void) const;
+
+private:
+    void writer_loop(void);
+
+    //readers that fall behind are overrun
+    void publish(const void *data, const size_t bytes, const SoapySDRPlayShmMeta &meta);
+
+    std::string _name;
+    const ReleaseFn _release;
+    SoapySDRPlayShmHeader *_header;
+    SoapySDRPlayShmSlot *_slots;
+    unsigned char *_data;
+    size_t _bytes;
+    uint64_t _writeSeq;
+    std::atomic<unsigned long long> _skipped;
+
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::deque<Block> _queue;
+    bool _running;
+    std::thread _writer;
+};
+
+class SoapySDRPlayShmReader
+{
+public:
+    //throws when no writer has set up the segment
+    SoapySDRPlayShmReader(const std::string &name);
+
+    ~SoapySDRPlayShmReader(void);
+
+    //copy the next slot into data, at most getSlotBytes() bytes:
+    //returns the byte count, SOAPY_SDR_TIMEOUT or SOAPY_SDR_OVERFLOW
+    //after which the cursor has skipped to the newest data
+    int read(void *data, SoapySDRPlayShmMeta &meta, const long timeoutUs);
+
+    //only new data is read after this
+    void seekLatest(void);
+
+    std::string getFormat(void) const;
+
+    size_t getSlotBytes(void) const;
+
+    uint32_t getSampleRate(void) const;
+
+    uint32_t getCenterFrequency(void) const;
+
+private:
+    void attach(void);
+
+    void detach(void);
+
+    //follow a writer that restarted under the same name
+    bool reattach(void);
+
+    bool wait(const long timeoutUs);
+
+    std::string _name;
+    const SoapySDRPlayShmHeader *_header;
+    const SoapySDRPlayShmSlot *_slots;
+    const unsigned char *_data;
+    size_t _bytes;
+    uint64_t _cursor;
+};
+
+//read-only companion device attached to a shared stream with shm=<name>,
+//the receiver itself is controlled by the process that owns it
+class SoapySDRPlayShmDevice : public SoapySDR::Device
+{
+public:
+    SoapySDRPlayShmDevice(const SoapySDR::Kwargs &args);
+
+    std::string getDriverKey(void) const;
+
+    std::string getHardwareKey(void) const;
+
+    SoapySDR::Kwargs getHardwareInfo(void) const;
+
+    size_t getNumChannels(const int dir) const;
+
+    std::vector<std::string> getStreamFormats(const int direction, const size_t channel) const;
+
+    std::string getNativeStreamFormat(const int direction, const size_t channel, double &fullScale) const;
+
+    SoapySDR::Stream *setupStream(const int direction,
+                                  const std::string &format,
+                                  const std::vector<size_t> &channels = std::vector<size_t>(),
+                                  const SoapySDR::Kwargs &args = SoapySDR::Kwargs());
+
+    void closeStream(SoapySDR::Stream *stream);
+
+    size_t getStreamMTU(SoapySDR::Stream *stream) const;
+
+    int activateStream(SoapySDR::Stream *stream,
+                       const int flags = 0,
+                       const long long timeNs = 0,
+                       const size_t numElems = 0);
+
+    int deactivateStream(SoapySDR::Stream *stream, const int flags = 0, const long long timeNs = 0);
+
+    int readStream(SoapySDR::Stream *stream,
+                   void * const *buffs,
+                   const size_t numElems,
+                   int &flags,
+                   long long &timeNs,
+                   const long timeoutUs = 200000);
+
+    double getFrequency(const int direction, const size_t channel) const;
+
+    double getSampleRate(const int direction, const size_t channel) const;
+
+    std::vector<double> listSampleRates(const int direction, const size_t channel) const;
+
+    std::string readSetting(const std::string &key) const;
+
+private:
+    const std::string _name;
+    std::unique_ptr<SoapySDRPlayShmReader> _reader;
+
+    bool _useShort;
+    //SOAPY_SDR_HAS_TIME on the source host's clock, opt-in by host_time=true
+    bool _hostTime;
+    bool _active;
+    std::vector<unsigned char> _slot;
+    size_t _slotElems;
+    size_t _slotOffset;
+    SoapySDRPlayShmMeta _meta;
+};
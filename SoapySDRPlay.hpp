@@ -28,6 +28,7 @@
 #include <SoapySDR/Types.h>
 #include <stdexcept>
 #include <thread>
+#include <chrono>
 #include <mutex>
 #include <atomic>
 #include <condition_variable>
@@ -35,6 +36,18 @@
 #include <cstring>
 #include <algorithm>
 #include <set>
+#include <cstdint>
+#include <memory>
+#include <deque>
+
+#include "ThreadPool.hpp"
+#include "Recorder.hpp"
+#include "Replay.hpp"
+#include "SharedMemory.hpp"
+#include "Network.hpp"
+#include "DeviceCache.hpp"
+#include "Trace.hpp"
+#include "Metrics.hpp"
 
 #ifdef _WIN32
 #include <mir_sdr.h>
@@ -46,10 +59,237 @@
 #define DEFAULT_NUM_BUFFERS       (8)
 #define DEFAULT_ELEMS_PER_SAMPLE  (2)
 
+//stream buffer arena layout
+#define SDRPLAY_BUFFER_ALIGNMENT  (64)
+#define SDRPLAY_HUGE_PAGE_SIZE    (2 * 1024 * 1024)
+
+//raw sample staging between the stream callback and the pipeline thread
+#define DEFAULT_NUM_RAW_BLOCKS     (64)
+#define DEFAULT_RAW_BLOCK_SAMPLES  (4096)
+
+//samples handed to the stream path per block by the replay device
+#define SDRPLAY_REPLAY_BLOCK_SAMPLES  (1024)
+#define SDRPLAY_REPLAY_RAW_BACKLOG    (8)
+
+//samples per task of the parallel DSP stage
+#define DEFAULT_DSP_CHUNK_SAMPLES  (2048u)
+
 #define MAX_RSP_DEVICES  (4)
 
+//frequency bands (lower edges in MHz) of the gain calibration table
+#define SDRPLAY_NUM_GAIN_BANDS  (8)
+#define SDRPLAY_MAX_LNA_STATES  (10)
+#define SDRPLAY_MAX_SYSTEM_GR   (128)
+
+//software AGC control loop period and defaults
+#define SDRPLAY_AGC_PERIOD_MS       (10)
+#define DEFAULT_AGC_ATTACK_MS       (10)
+#define DEFAULT_AGC_DECAY_MS        (500)
+#define DEFAULT_AGC_HYSTERESIS_DB   (3)
+
 std::set<std::string> &SoapySDRPlay_getClaimedSerials(void);
 
+//milliseconds elapsed since start, for the startup profile
+static inline double msSince(const std::chrono::steady_clock::time_point &start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*******************************************************************
+ * Device state snapshot
+ ******************************************************************/
+
+//cached settings, as published to the lock-free getters
+struct SoapySDRPlayState
+{
+    uint32_t centerFrequency;
+    uint32_t sampleRate;
+    uint32_t reqSampleRate;
+    double ppm;
+    mir_sdr_Bw_MHzT bwMode;
+    mir_sdr_If_kHzT ifMode;
+    mir_sdr_AgcControlT agcMode;
+    int gRdB;
+    int lnaState;
+    bool dcOffsetMode;
+    mir_sdr_RSPII_AntennaSelectT antSel;
+    mir_sdr_rspDuo_TunerSelT tunSel;
+    int amPort;
+};
+
+/*******************************************************************
+ * Per-buffer metadata
+ ******************************************************************/
+
+//change flags reported by the stream callback during a buffer
+#define SDRPLAY_META_GR_CHANGED   (1 << 0)
+#define SDRPLAY_META_RF_CHANGED   (1 << 1)
+#define SDRPLAY_META_FS_CHANGED   (1 << 2)
+#define SDRPLAY_META_RESET        (1 << 3)
+#define SDRPLAY_META_HW_REMOVED   (1 << 4)
+#define SDRPLAY_META_AGC_STEP     (1 << 5)
+
+//snapshot of the receiver state taken when a ring slot starts filling
+struct SoapySDRPlayBufferMeta
+{
+    uint32_t centerFrequency;
+    uint32_t sampleRate;
+    int gRdB;
+    int lnaState;
+    bool overload;
+    unsigned int changes;
+    unsigned int firstSampleNum;
+    unsigned long long sampleCount;
+    //host steady clock time of the first sample, estimated from the callback arrival
+    long long timeNs;
+};
+
+//bulk transfers used to be forced on ARM hosts, isochronous elsewhere
+#if defined(__arm__) || defined(__aarch64__)
+#define DEFAULT_TRANSFER_MODE  "bulk"
+#else
+#define DEFAULT_TRANSFER_MODE  "isoch"
+#endif
+
+//ADC rate range and the largest power of two decimation of the API
+#define SDRPLAY_MIN_ADC_RATE     (2000000)
+#define SDRPLAY_MAX_ADC_RATE     (10000000)
+#define SDRPLAY_MAX_DECIMATION   (64)
+
+//one way of producing an output rate, as chosen by planSampleRate()
+struct SoapySDRPlayRatePlan
+{
+    uint32_t outputRate;
+    uint32_t adcRate;
+    mir_sdr_If_kHzT ifMode;
+    unsigned int decM;
+    unsigned int decEnable;
+    mir_sdr_Bw_MHzT bwMode;
+};
+
+//time spent in each step from construction to the first sample, in ms
+struct SoapySDRPlayStartupProfile
+{
+    double lookup;
+    double setDeviceIdx;
+    double construct;
+    double streamInit;
+    double decimateControl;
+    double dcMode;
+    double activate;
+};
+
+//raw I/Q planes of one stream callback, as staged for the pipeline thread
+struct SoapySDRPlayRawBlock
+{
+    std::vector<short> xi;
+    std::vector<short> xq;
+    unsigned int numSamples;
+    unsigned int firstSampleNum;
+    unsigned int changes;
+    long long timeNs;
+};
+
+//conversion of one block into its reserved place in a stream buffer
+struct SoapySDRPlayConvertJob
+{
+    const short *xi;
+    const short *xq;
+    void *dst;
+    unsigned int numSamples;
+    bool useShort;
+    float scale;
+    bool measurePower;
+};
+
+//how acquireReadBuffer() waits for the producer
+enum SoapySDRPlayWaitPolicy
+{
+    SDRPLAY_WAIT_BLOCK,
+    //spin up to the reader's spinUs, then block
+    SDRPLAY_WAIT_SPIN,
+    //spin for the whole timeout, never sleeps
+    SDRPLAY_WAIT_POLL,
+};
+
+#define DEFAULT_SPIN_US (50)
+
+//one reader of the stream ring, as handed out by setupStream():
+//every reader sees every published buffer and moves at its own pace
+struct SoapySDRPlayStream
+{
+    bool active;
+    //hold the producer back when full, instead of losing the oldest buffer
+    bool blockProducer;
+    //published slots waiting for acquireReadBuffer() and
+    //the slots handed out until released, guarded by _buf_mutex
+    std::deque<size_t> queue;
+    std::vector<size_t> acquired;
+    bool overflow;
+    //eventfd readable while the reader has something to acquire, -1 if unsupported
+    int eventFd;
+    SoapySDRPlayWaitPolicy waitPolicy;
+    long spinUs;
+    //readStream() position in the acquired buffer
+    short *currentBuff;
+    size_t currentHandle;
+    size_t bufferedElems;
+    //SOAPY_SDR_HAS_TIME is set only with host_time=true: the times are
+    //host steady_clock, not the getHardwareTime() clock
+    bool hostTime;
+    //time of the acquired buffer's first sample and the elements read since
+    long long bufferTimeNs;
+    uint32_t bufferRate;
+    size_t bufferOffset;
+};
+
+//Sequence lock over a trivially copyable value:
+//writers must be serialized by the caller (i.e. _general_state_mutex),
+//readers never block and retry only if they raced with a store().
+template <typename T>
+class SoapySDRPlaySeqLock
+{
+public:
+    SoapySDRPlaySeqLock(void): _seq(0)
+    {
+        for (auto &word : _words) word.store(0, std::memory_order_relaxed);
+    }
+
+    void store(const T &value)
+    {
+        uint64_t words[numWords] = {};
+        std::memcpy(words, &value, sizeof(T));
+
+        const unsigned int seq = _seq.load(std::memory_order_relaxed);
+        _seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < numWords; i++) _words[i].store(words[i], std::memory_order_relaxed);
+        _seq.store(seq + 2, std::memory_order_release);
+    }
+
+    T load(void) const
+    {
+        uint64_t words[numWords];
+        unsigned int seq0, seq1;
+        do
+        {
+            seq0 = _seq.load(std::memory_order_acquire);
+            for (size_t i = 0; i < numWords; i++) words[i] = _words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            seq1 = _seq.load(std::memory_order_relaxed);
+        } while ((seq0 & 1) or (seq0 != seq1));
+
+        T value;
+        std::memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+private:
+    static const size_t numWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    std::atomic_uint _seq;
+    std::atomic<uint64_t> _words[numWords];
+};
+
 class SoapySDRPlay: public SoapySDR::Device
 {
 public:
@@ -123,6 +363,25 @@ public:
 
     void releaseReadBuffer(SoapySDR::Stream *stream, const size_t handle);
 
+    //every buffer ready for the reader, up to maxBuffs, in one call:
+    //returns how many were acquired, or an error code as acquireReadBuffer()
+    int acquireReadBuffers(SoapySDR::Stream *stream,
+                           size_t *handles,
+                           const void **buffs,
+                           size_t *numElems,
+                           const size_t maxBuffs,
+                           int &flags,
+                           const long timeoutUs = 100000);
+
+    void releaseReadBuffers(SoapySDR::Stream *stream, const size_t *handles, const size_t numHandles);
+
+    //metadata of an acquired buffer, valid until it is released
+    SoapySDRPlayBufferMeta getReadBufferMeta(SoapySDR::Stream *stream, const size_t handle) const;
+
+    //eventfd of the reader, readable while it has buffers to acquire,
+    //valid until closeStream(), -1 if unsupported
+    int getStreamFd(SoapySDR::Stream *stream) const;
+
     /*******************************************************************
      * Antenna API
      ******************************************************************/
@@ -185,12 +444,14 @@ public:
 
     double getSampleRate(const int direction, const size_t channel) const;
 
+    //exact rates of the current IF mode only, see the "if_mode" setting
     std::vector<double> listSampleRates(const int direction, const size_t channel) const;
 
     /*******************************************************************
     * Bandwidth API
     ******************************************************************/
 
+    //0 goes back to the widest filter the sample rate allows
     void setBandwidth(const int direction, const size_t channel, const double bw);
 
     double getBandwidth(const int direction, const size_t channel) const;
@@ -217,10 +478,68 @@ public:
      * Async API
      ******************************************************************/
 
-    void rx_callback(short *xi, short *xq, unsigned int numSamples);
+    void rx_callback(short *xi, short *xq, unsigned int firstSampleNum, int grChanged, int rfChanged,
+                     int fsChanged, unsigned int numSamples, unsigned int reset, unsigned int hwRemoved);
 
     void gr_callback(unsigned int gRdB, unsigned int lnaGRdB);
 
+    //interleave, convert and queue one block into the stream buffers
+    void convertBlock(const short *xi, const short *xq, unsigned int firstSampleNum,
+                      unsigned int changes, unsigned int numSamples, long long timeNs);
+
+    //claim space for a block in the fill buffer, with _buf_mutex held;
+    //buffers completed meanwhile are held back until publishBuffers()
+    bool reserveBlock(const short *xi, const short *xq, unsigned int firstSampleNum,
+                      unsigned int changes, unsigned int numSamples, long long timeNs, SoapySDRPlayConvertJob &job);
+
+    void publishBuffers(void);
+
+    //fill level in shorts at which a slot is handed out: a full slot,
+    //or what latency_ms allows at this rate
+    size_t publishThreshold(const uint32_t rate) const;
+
+    //move the producer to a free slot, the filled one waits for publishBuffers()
+    bool closeTail(void);
+
+    //with a latency target, hand out a slot the next block of
+    //blockSpace shorts would not fit in rather than wait for that block
+    void closeTailEarly(const size_t blockSpace);
+
+    //the readers' view of the ring, with _buf_mutex held
+    void markOverflow(void);
+
+    //a slot nobody references, possibly taken from readers that drop their oldest buffer
+    bool findFreeSlot(size_t &slot);
+
+    void dropQueued(SoapySDRPlayStream *reader);
+
+    void resetRing(void);
+
+    //wake the readers, blocked in acquireReadBuffer() or polling their eventfd
+    void notifyStreams(void);
+
+    //consume the eventfd signal once the reader has nothing left to acquire
+    static void clearStreamEvent(SoapySDRPlayStream *reader);
+
+    static void closeStreamEvent(SoapySDRPlayStream *reader);
+
+    //returns 0 once the reader's queue has a buffer, the overflow or timeout code otherwise
+    int waitReadable(SoapySDRPlayStream *reader, std::unique_lock <std::mutex> &lock, const long timeoutUs);
+
+    //busy-wait for a publish past seq, false once the deadline is reached
+    bool spinForPublish(const size_t seq, const std::chrono::steady_clock::time_point &deadline) const;
+
+    SoapySDR::Stream *addStream(const SoapySDR::Kwargs &args);
+
+    //give back all buffers of a reader, returns true while other readers are active
+    bool detachStream(SoapySDRPlayStream *reader);
+
+    //returns the block energy when the job measures power
+    static unsigned long long convertSamples(const SoapySDRPlayConvertJob &job, unsigned int from, unsigned int to);
+
+    //convert a run of raw blocks on the DSP thread pool
+    void convertBlocksParallel(size_t head, size_t count);
+
 private:
 
     /*******************************************************************
@@ -229,7 +548,15 @@ private:
 
     static double getRateForBwEnum(mir_sdr_Bw_MHzT bwEnum);
 
-    static uint32_t getInputSampleRateAndDecimation(uint32_t rate, unsigned int *decM, unsigned int *decEnable, mir_sdr_If_kHzT ifMode);
+    //every ADC rate and decimation the IF mode supports around the requested rate
+    static std::vector<SoapySDRPlayRatePlan> listRatePlans(uint32_t rate, mir_sdr_If_kHzT ifMode);
+
+    //the closest output rate, then the lowest USB rate and the least decimation,
+    //bandwidth 0 picks the widest filter the output rate allows
+    static bool planSampleRate(uint32_t rate, uint32_t bandwidth, mir_sdr_If_kHzT ifMode, SoapySDRPlayRatePlan &plan);
+
+    //apply a plan for reqSampleRate to the cached settings, requires _general_state_mutex
+    void applyRatePlan(void);
 
     static mir_sdr_Bw_MHzT getBwEnumForRate(double rate, mir_sdr_If_kHzT ifMode);
 
@@ -241,6 +568,104 @@ private:
 
     static std::string IFtoString(mir_sdr_If_kHzT ifkHzT);
 
+    static std::string bufferMetaToString(const SoapySDRPlayBufferMeta &meta);
+
+    //callback rate, sample throughput and packet sizes since the previous call
+    std::string throughputToString(void) const;
+
+    std::string startupProfileToString(void) const;
+
+    //per band and LNA state gain reduction, queried from the API at open
+    void buildGainTable(void);
+
+    static int getGainBand(uint32_t frequency);
+
+    int getMaxLnaState(void) const;
+
+    //CF32 conversion factor for the given state,
+    //including the inverse of the gain when calibratedOutput is set
+    float getConversionScale(const SoapySDRPlayState &state, int gRdBnow) const;
+
+    //apply agcMode to the vendor AGC, which is kept off when the software AGC is used
+    void applyAgcControl(void);
+
+    //gives back a ring slot a consumer (recorder, shared stream, server) held, takes _buf_mutex
+    void releaseSlot(const size_t handle);
+
+    //SigMF recording of the published buffers, on while the stream is active
+    void startRecorder(void);
+
+    void stopRecorder(void);
+
+    //fan-out of the published buffers to other processes
+    void startSharedStream(void);
+
+    void stopSharedStream(void);
+
+    //streaming server for remote clients, fed from the ring
+    void startNetServer(void);
+
+    void stopNetServer(void);
+
+    //OpenMetrics exporter, independent of the stream
+    void startMetricsExporter(void);
+
+    void stopMetricsExporter(void);
+
+    //replay device: a driver owned thread plays the file through rx_callback()
+    void startReplayThread(void);
+
+    void stopReplayThread(void);
+
+    void replay_thread_loop(void);
+
+    //fast replay waits for room instead of dropping blocks
+    bool waitReplaySpace(void);
+
+    //pipeline mode: the stream callback only stages raw planes,
+    //conversion runs on a driver owned thread
+    void pushRawBlock(const short *xi, const short *xq, unsigned int firstSampleNum,
+                      unsigned int changes, unsigned int numSamples, long long timeNs);
+
+    void startPipelineThread(void);
+
+    void stopPipelineThread(void);
+
+    void pipeline_thread_loop(void);
+
+    //software AGC thread: measures block power from the stream callback
+    //and steps IFGR/LNA state through mir_sdr_Reinit()
+    void startAgcThread(void);
+
+    void stopAgcThread(void);
+
+    void agc_thread_loop(void);
+
+    void agcUpdate(double powerdBfs);
+
+    //real-time priority and CPU affinity of the calling streaming thread
+    void applyThreadScheduling(const char *threadName);
+
+    //streaming settings shared by writeSetting() and setupStream() args
+    bool writeStreamingSetting(const std::string &key, const std::string &value);
+
+    void lockRingMemory(bool lock);
+
+    //stream buffers: numBuffers aligned slots in one pre-faulted arena,
+    //kept across setupStream()/closeStream() cycles
+    void allocateRing(size_t slotShorts, bool hugePages);
+
+    void freeRing(void);
+
+    short *getRingBuffer(size_t handle) const
+    {
+        return _arena + handle * _buffStride;
+    }
+
+    //publish the cached settings to the lock-free getters,
+    //must be called with _general_state_mutex held after any change
+    void publishState(void);
+
     /*******************************************************************
      * Private variables
      ******************************************************************/
@@ -259,6 +684,8 @@ private:
     //cached settings
     uint32_t sampleRate;
     uint32_t reqSampleRate;
+    //filter asked for by setBandwidth(), 0 follows the sample rate
+    uint32_t reqBandwidth;
     unsigned int decM;
     unsigned int decEnable;
     uint32_t centerFrequency;
@@ -274,13 +701,25 @@ private:
     std::atomic_uint shortsPerWord;
  
     mir_sdr_AgcControlT agcMode;
+    std::atomic_bool softwareAgc;
+    int agcAttackMs;
+    int agcDecayMs;
+    int agcHysteresis;
     std::atomic_bool streamActive;
+    std::atomic_bool adcOverload;
   
     bool dcOffsetMode;
     std::atomic_bool useShort;
+    std::atomic_bool calibratedOutput;
+
+    //LNA gain reduction in dB for [band][lnaState]
+    int lnaGrTable[SDRPLAY_NUM_GAIN_BANDS][SDRPLAY_MAX_LNA_STATES];
+    //linear conversion factor for [system gain reduction in dB]
+    float grScaleTable[SDRPLAY_MAX_SYSTEM_GR];
 
     unsigned int IQcorr;
     int setPoint;
+    std::string transferMode;
 
     mir_sdr_RSPII_AntennaSelectT antSel;
     mir_sdr_rspDuo_TunerSelT tunSel;
@@ -291,6 +730,9 @@ private:
     unsigned int dabNotchEn;
     std::string serNo;
 
+    //lock-free copy of the cached settings above
+    SoapySDRPlaySeqLock<SoapySDRPlayState> _state;
+
 public:
 
    /*******************************************************************
@@ -299,16 +741,111 @@ public:
     
     mutable std::mutex _general_state_mutex;
 
-    std::mutex _buf_mutex;
+    mutable std::mutex _buf_mutex;
     std::condition_variable _buf_cond;
-
-    std::vector<std::vector<short> > _buffs;
-    size_t	_buf_head;
+    //readers sleeping on _buf_cond, the producer skips the notify without any
+    unsigned int _buf_waiters;
+    //bumped on every publish, spinning readers watch it without the lock
+    std::atomic_size_t _publishSeq;
+
+    short *_arena;
+    size_t _arenaBytes;
+    bool _arenaHuge;
+    bool hugePages;
+    size_t _buffStride;
+    std::vector<size_t> _buffSize;
+    //readers and recorder holding each slot, only free slots are refilled
+    std::vector<unsigned int> _buffRefs;
+    std::vector<std::unique_ptr<SoapySDRPlayStream>> _streams;
+    std::unique_ptr<SoapySDRPlayRecorder> _recorder;
+    std::unique_ptr<SoapySDRPlayShmWriter> _shm;
+    std::unique_ptr<SoapySDRPlayNetServer> _net;
+    std::vector<SoapySDRPlayBufferMeta> _buffMeta;
+    SoapySDRPlayBufferMeta _lastMeta;
+    unsigned long long _sampleCount;
     size_t	_buf_tail;
-    size_t	_buf_count;
-    short *_currentBuff;
-    bool _overflowEvent;
-    std::atomic_size_t bufferedElems;
-    size_t _currentHandle;
+    std::vector<size_t> _buf_pending;
+    //the fill slot is being converted outside the lock, it can't be flushed
+    bool _tailConverting;
     std::atomic_bool resetBuffer;
+
+    //software AGC power measurement, filled by the stream callback
+    std::atomic_ullong _agcEnergy;
+    std::atomic_ullong _agcSamples;
+    std::atomic_bool _agcStep;
+
+    std::thread _agc_thread;
+    std::mutex _agc_mutex;
+    std::condition_variable _agc_cond;
+    bool _agc_running;
+
+    //scheduling of the streaming threads, guarded by _sched_mutex
+    //since the stream callback must never wait on _general_state_mutex
+    mutable std::mutex _sched_mutex;
+    int rtPriority;
+    std::string rtPolicy;
+    std::string cpuAffinity;
+    bool memoryLock;
+    std::string recordPath;
+    std::string shmName;
+    std::string netServer;
+    std::string netCodec;
+    //latency target, 0 fills whole slots; read by the stream callback
+    std::atomic_uint latencyUs;
+    std::atomic_bool _callbackSchedPending;
+
+    //rx_callback() statistics, written by the callback thread only
+    std::atomic<unsigned long long> _cbCount;
+    std::atomic<unsigned long long> _cbSamples;
+    std::atomic_uint _cbLastSamples;
+    std::atomic_uint _cbMinSamples;
+    std::atomic_uint _cbMaxSamples;
+    //sample clock on the host clock: samples since _timeBaseNs at _timeRate,
+    //callback thread only, _timeRate = 0 restarts it
+    uint32_t _timeRate;
+    unsigned long long _timeSamples;
+    long long _timeBaseNs;
+    //counters for the metrics exporter, lock-free
+    SoapySDRPlayMetrics _metrics;
+    //exporter and its settings, guarded by _metrics_mutex
+    mutable std::mutex _metrics_mutex;
+    std::unique_ptr<SoapySDRPlayMetricsExporter> _metricsExporter;
+    std::string metricsServer;
+    std::string metricsFile;
+    double metricsInterval;
+    //previous stream_throughput reading, guarded by _general_state_mutex
+    mutable std::chrono::steady_clock::time_point _tpTime;
+    mutable unsigned long long _tpCount;
+    mutable unsigned long long _tpSamples;
+
+    //startup profile, guarded by _general_state_mutex but for the
+    //first sample, stamped by the producer on its first publish
+    SoapySDRPlayStartupProfile _startup;
+    std::chrono::steady_clock::time_point _activateTime;
+    std::atomic_bool _awaitFirstSample;
+    std::atomic<long long> _firstSampleUs;
+
+    //pipeline mode, single producer/single consumer raw block ring
+    bool pipelineMode;
+    std::vector<SoapySDRPlayRawBlock> _rawBlocks;
+    std::atomic_size_t _raw_head;
+    std::atomic_size_t _raw_tail;
+    std::atomic_bool _rawOverflow;
+    std::atomic_bool _raw_waiting;
+    std::thread _pipeline_thread;
+    std::mutex _raw_mutex;
+    std::condition_variable _raw_cond;
+    bool _pipeline_running;
+
+    //replay device, no hardware is attached when replayMode is set
+    bool replayMode;
+    bool replayRealtime;
+    bool replayLoop;
+    std::unique_ptr<SoapySDRPlayReplay> _replay;
+    std::atomic_bool replayActive;
+    std::thread _replay_thread;
+
+    //parallel DSP stage on top of the pipeline
+    int dspThreads;
+    std::unique_ptr<SoapySDRPlayThreadPool> _dspPool;
 };
@@ -23,6 +23,30 @@
  */
 
 #include "SoapySDRPlay.hpp"
+#include <cmath>
+#include <sstream>
+#include <cerrno>
+#include <chrono>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SDRPLAY_CONVERT_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SDRPLAY_CONVERT_NEON
+#endif
 
 std::vector<std::string> SoapySDRPlay::getStreamFormats(const int direction, const size_t channel) const 
 {
@@ -34,115 +58,1427 @@ std::vector<std::string> SoapySDRPlay::getStreamFormats(const int direction, con
     return formats;
 }
 
-std::string SoapySDRPlay::getNativeStreamFormat(const int direction, const size_t channel, double &fullScale) const 
-{
-     fullScale = 32767;
-     return "CS16";
-}
+std::string SoapySDRPlay::getNativeStreamFormat(const int direction, const size_t channel, double &fullScale) const 
+{
+     fullScale = 32767;
+     return "CS16";
+}
+
+SoapySDR::ArgInfoList SoapySDRPlay::getStreamArgsInfo(const int direction, const size_t channel) const 
+{
+    SoapySDR::ArgInfoList streamArgs;
+
+    SoapySDR::ArgInfo RtPriorityArg;
+    RtPriorityArg.key = "rt_priority";
+    RtPriorityArg.value = "0";
+    RtPriorityArg.name = "RT Priority";
+    RtPriorityArg.description = "Real-time priority of the streaming threads, 0 keeps the default scheduling";
+    RtPriorityArg.type = SoapySDR::ArgInfo::INT;
+    RtPriorityArg.range = SoapySDR::Range(0, 99);
+    streamArgs.push_back(RtPriorityArg);
+
+    SoapySDR::ArgInfo RtPolicyArg;
+    RtPolicyArg.key = "rt_policy";
+    RtPolicyArg.value = "fifo";
+    RtPolicyArg.name = "RT Policy";
+    RtPolicyArg.description = "Real-time scheduling policy of the streaming threads";
+    RtPolicyArg.type = SoapySDR::ArgInfo::STRING;
+    RtPolicyArg.options.push_back("fifo");
+    RtPolicyArg.options.push_back("rr");
+    streamArgs.push_back(RtPolicyArg);
+
+    SoapySDR::ArgInfo AffinityArg;
+    AffinityArg.key = "cpu_affinity";
+    AffinityArg.value = "";
+    AffinityArg.name = "CPU Affinity";
+    AffinityArg.description = "CPUs for the streaming threads, i.e. 2,3 or 4-7, empty for any";
+    AffinityArg.type = SoapySDR::ArgInfo::STRING;
+    streamArgs.push_back(AffinityArg);
+
+    SoapySDR::ArgInfo MemLockArg;
+    MemLockArg.key = "memory_lock";
+    MemLockArg.value = "false";
+    MemLockArg.name = "Memory Lock";
+    MemLockArg.description = "Lock the stream buffers in RAM to avoid page faults";
+    MemLockArg.type = SoapySDR::ArgInfo::BOOL;
+    streamArgs.push_back(MemLockArg);
+
+    SoapySDR::ArgInfo PipelineArg;
+    PipelineArg.key = "pipeline";
+    PipelineArg.value = "false";
+    PipelineArg.name = "Pipeline";
+    PipelineArg.description = "Convert samples on a driver thread instead of the USB callback thread";
+    PipelineArg.type = SoapySDR::ArgInfo::BOOL;
+    streamArgs.push_back(PipelineArg);
+
+    SoapySDR::ArgInfo DspThreadsArg;
+    DspThreadsArg.key = "dsp_threads";
+    DspThreadsArg.value = "0";
+    DspThreadsArg.name = "DSP Threads";
+    DspThreadsArg.description = "Worker threads sharing the conversion stage, implies pipeline when non zero";
+    DspThreadsArg.type = SoapySDR::ArgInfo::INT;
+    DspThreadsArg.range = SoapySDR::Range(0, 16);
+    streamArgs.push_back(DspThreadsArg);
+
+    SoapySDR::ArgInfo HugePagesArg;
+    HugePagesArg.key = "huge_pages";
+    HugePagesArg.value = "false";
+    HugePagesArg.name = "Huge Pages";
+    HugePagesArg.description = "Back the stream buffers with huge pages";
+    HugePagesArg.type = SoapySDR::ArgInfo::BOOL;
+    streamArgs.push_back(HugePagesArg);
+
+    SoapySDR::ArgInfo RecordArg;
+    RecordArg.key = "record_path";
+    RecordArg.value = "";
+    RecordArg.name = "Record Path";
+    RecordArg.description = "Record the stream to <path>.sigmf-data/.sigmf-meta, empty to stop";
+    RecordArg.type = SoapySDR::ArgInfo::STRING;
+    streamArgs.push_back(RecordArg);
+
+    SoapySDR::ArgInfo ShmArg;
+    ShmArg.key = "shm_name";
+    ShmArg.value = "";
+    ShmArg.name = "Shared Stream";
+    ShmArg.description = "Share the stream with other processes under this name, opened there with shm=<name>";
+    ShmArg.type = SoapySDR::ArgInfo::STRING;
+    streamArgs.push_back(ShmArg);
+
+    SoapySDR::ArgInfo NetServerArg;
+    NetServerArg.key = "net_server";
+    NetServerArg.value = "";
+    NetServerArg.name = "Streaming Server";
+    NetServerArg.description = "Serve the stream over TCP on [address:]port, opened remotely with net=<host>:<port>, empty to stop";
+    NetServerArg.type = SoapySDR::ArgInfo::STRING;
+    streamArgs.push_back(NetServerArg);
+
+    SoapySDR::ArgInfo NetCodecArg;
+    NetCodecArg.key = "net_codec";
+    NetCodecArg.value = "cs16";
+    NetCodecArg.name = "Streaming Codec";
+    NetCodecArg.description = "Samples sent as CS16 (zero copy), CS8 (lossy) or delta (lossless compression)";
+    NetCodecArg.type = SoapySDR::ArgInfo::STRING;
+    NetCodecArg.options.push_back("cs16");
+    NetCodecArg.options.push_back("cs8");
+    NetCodecArg.options.push_back("delta");
+    streamArgs.push_back(NetCodecArg);
+
+    SoapySDR::ArgInfo LatencyArg;
+    LatencyArg.key = "latency_ms";
+    LatencyArg.value = "0";
+    LatencyArg.name = "Latency Target";
+    LatencyArg.description = "Hand out buffers at least every latency_ms at the current rate and flush partial ones on a read timeout, 0 for full buffers";
+    LatencyArg.units = "ms";
+    LatencyArg.type = SoapySDR::ArgInfo::FLOAT;
+    LatencyArg.range = SoapySDR::Range(0, 1000);
+    streamArgs.push_back(LatencyArg);
+
+    SoapySDR::ArgInfo BackpressureArg;
+    BackpressureArg.key = "backpressure";
+    BackpressureArg.value = "drop";
+    BackpressureArg.name = "Backpressure";
+    BackpressureArg.description = "When this reader falls behind: drop its oldest buffer, or block the receiver and drop new samples for all readers";
+    BackpressureArg.type = SoapySDR::ArgInfo::STRING;
+    BackpressureArg.options.push_back("drop");
+    BackpressureArg.options.push_back("block");
+    streamArgs.push_back(BackpressureArg);
+
+    SoapySDR::ArgInfo WaitPolicyArg;
+    WaitPolicyArg.key = "wait_policy";
+    WaitPolicyArg.value = "block";
+    WaitPolicyArg.name = "Wait Policy";
+    WaitPolicyArg.description = "How this reader waits for samples: sleep, spin for spin_us then sleep, or busy-poll";
+    WaitPolicyArg.type = SoapySDR::ArgInfo::STRING;
+    WaitPolicyArg.options.push_back("block");
+    WaitPolicyArg.options.push_back("spin");
+    WaitPolicyArg.options.push_back("poll");
+    streamArgs.push_back(WaitPolicyArg);
+
+    SoapySDR::ArgInfo SpinArg;
+    SpinArg.key = "spin_us";
+    SpinArg.value = std::to_string(DEFAULT_SPIN_US);
+    SpinArg.name = "Spin Time";
+    SpinArg.description = "Microseconds spent spinning before sleeping with wait_policy=spin";
+    SpinArg.units = "us";
+    SpinArg.type = SoapySDR::ArgInfo::INT;
+    SpinArg.range = SoapySDR::Range(0, 10000);
+    streamArgs.push_back(SpinArg);
+
+    SoapySDR::ArgInfo HostTimeArg;
+    HostTimeArg.key = "host_time";
+    HostTimeArg.value = "false";
+    HostTimeArg.name = "Host Time";
+    HostTimeArg.description = "Flag buffers with SOAPY_SDR_HAS_TIME, timed on the host steady clock rather than getHardwareTime()";
+    HostTimeArg.type = SoapySDR::ArgInfo::BOOL;
+    streamArgs.push_back(HostTimeArg);
+
+    return streamArgs;
+}
+
+/*******************************************************************
+ * Thread scheduling
+ ******************************************************************/
+
+bool SoapySDRPlay::writeStreamingSetting(const std::string &key, const std::string &value)
+{
+    std::lock_guard <std::mutex> lock(_sched_mutex);
+
+    if (key == "rt_priority")
+    {
+        rtPriority = std::min(std::max(stoi(value), 0), 99);
+    }
+    else if (key == "rt_policy")
+    {
+        rtPolicy = (value == "rr") ? "rr" : "fifo";
+    }
+    else if (key == "cpu_affinity")
+    {
+        cpuAffinity = value;
+    }
+    else if (key == "memory_lock")
+    {
+        memoryLock = (value == "true");
+        return true;
+    }
+    else if (key == "record_path")
+    {
+        recordPath = value;
+        return true;
+    }
+    else if (key == "shm_name")
+    {
+        shmName = value;
+        return true;
+    }
+    else if (key == "net_server")
+    {
+        netServer = value;
+        return true;
+    }
+    else if (key == "net_codec")
+    {
+        SoapySDRPlayNet_parseCodec(value);
+        netCodec = value;
+        return true;
+    }
+    else if (key == "latency_ms")
+    {
+        latencyUs = (unsigned int)(std::min(std::max(std::stod(value), 0.0), 1000.0) * 1000);
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+
+    // picked up by the stream callback on its next invocation
+    _callbackSchedPending = true;
+    return true;
+}
+
+void SoapySDRPlay::applyThreadScheduling(const char *threadName)
+{
+    SoapySDRPlayTrace::setThreadName(threadName);
+
+#ifndef _WIN32
+    int priority;
+    std::string policy, affinity;
+    {
+        std::lock_guard <std::mutex> lock(_sched_mutex);
+        priority = rtPriority;
+        policy = rtPolicy;
+        affinity = cpuAffinity;
+    }
+
+    if (priority > 0)
+    {
+        struct sched_param param;
+        std::memset(&param, 0, sizeof(param));
+        param.sched_priority = priority;
+        int ret = pthread_setschedparam(pthread_self(), (policy == "rr") ? SCHED_RR : SCHED_FIFO, &param);
+        if (ret != 0)
+        {
+            SoapySDR_logf(SOAPY_SDR_WARNING, "Failed to set %s thread priority %d: %s", threadName, priority, strerror(ret));
+        }
+    }
+
+#ifdef __linux__
+    if (not affinity.empty())
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+
+        // comma separated list of CPUs and CPU ranges
+        std::stringstream ss(affinity);
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            if (item.empty()) continue;
+            const size_t dash = item.find('-');
+            const int first = std::stoi(item.substr(0, dash));
+            const int last = (dash == std::string::npos) ? first : std::stoi(item.substr(dash + 1));
+            for (int cpu = first; cpu <= last and cpu < CPU_SETSIZE; cpu++) CPU_SET(cpu, &cpus);
+        }
+
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (ret != 0)
+        {
+            SoapySDR_logf(SOAPY_SDR_WARNING, "Failed to set %s thread affinity '%s': %s", threadName, affinity.c_str(), strerror(ret));
+        }
+    }
+#endif
+#endif
+}
+
+void SoapySDRPlay::lockRingMemory(bool lock)
+{
+#ifndef _WIN32
+    if (_arena == nullptr) return;
+    if (lock)
+    {
+        if (mlock(_arena, _arenaBytes) != 0)
+        {
+            SoapySDR_logf(SOAPY_SDR_WARNING, "Failed to lock stream buffers: %s", strerror(errno));
+        }
+    }
+    else
+    {
+        munlock(_arena, _arenaBytes);
+    }
+#endif
+}
+
+/*******************************************************************
+ * Buffer arena
+ ******************************************************************/
+
+void SoapySDRPlay::allocateRing(size_t slotShorts, bool hugePages)
+{
+    // every slot starts on a cache line, so SIMD conversion stays aligned
+    const size_t align = SDRPLAY_BUFFER_ALIGNMENT / sizeof(short);
+    const size_t stride = (slotShorts + align - 1) / align * align;
+    const size_t bytes = numBuffers * stride * sizeof(short);
+
+    // reuse the arena of a previous setupStream() whenever it is large enough
+    if ((_arena != nullptr) and (bytes <= _arenaBytes) and (hugePages == _arenaHuge))
+    {
+        _buffStride = stride;
+        return;
+    }
+    freeRing();
+
+#ifdef _WIN32
+    _arena = (short *)_aligned_malloc(bytes, SDRPLAY_BUFFER_ALIGNMENT);
+    if (_arena == nullptr) throw std::runtime_error("setupStream failed to allocate stream buffers");
+    _arenaBytes = bytes;
+#else
+    void *mem = MAP_FAILED;
+    size_t mapBytes = bytes;
+#ifdef MAP_HUGETLB
+    if (hugePages)
+    {
+        // explicit huge pages need a reserved pool, fall back to THP below
+        mapBytes = (bytes + SDRPLAY_HUGE_PAGE_SIZE - 1) / SDRPLAY_HUGE_PAGE_SIZE * SDRPLAY_HUGE_PAGE_SIZE;
+        mem = mmap(nullptr, mapBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if (mem == MAP_FAILED)
+    {
+        mapBytes = bytes;
+        mem = mmap(nullptr, mapBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) throw std::runtime_error("setupStream failed to allocate stream buffers");
+#ifdef MADV_HUGEPAGE
+        if (hugePages) madvise(mem, mapBytes, MADV_HUGEPAGE);
+#endif
+    }
+    _arena = (short *)mem;
+    _arenaBytes = mapBytes;
+#endif
+
+    // touch every page now rather than in the stream callback
+    std::memset(_arena, 0, _arenaBytes);
+
+    _arenaHuge = hugePages;
+    _buffStride = stride;
+}
+
+void SoapySDRPlay::freeRing(void)
+{
+    if (_arena == nullptr) return;
+
+#ifdef _WIN32
+    _aligned_free(_arena);
+#else
+    munmap(_arena, _arenaBytes);
+#endif
+    _arena = nullptr;
+    _arenaBytes = 0;
+    _buffStride = 0;
+}
+
+/*******************************************************************
+ * Async thread work
+ ******************************************************************/
+
+static void _rx_callback(short *xi, short *xq, unsigned int firstSampleNum, int grChanged, int rfChanged, 
+                         int fsChanged, unsigned int numSamples, unsigned int reset, unsigned int hwRemoved, void *cbContext)
+{
+    SoapySDRPlay *self = (SoapySDRPlay *)cbContext;
+    return self->rx_callback(xi, xq, firstSampleNum, grChanged, rfChanged, fsChanged, numSamples, reset, hwRemoved);
+}
+
+static void _gr_callback(unsigned int gRdB, unsigned int lnaGRdB, void *cbContext)
+{
+    SoapySDRPlay *self = (SoapySDRPlay *)cbContext;
+    return self->gr_callback(gRdB, lnaGRdB);
+}
+
+void SoapySDRPlay::rx_callback(short *xi, short *xq, unsigned int firstSampleNum, int grChanged, int rfChanged,
+                               int fsChanged, unsigned int numSamples, unsigned int reset, unsigned int hwRemoved)
+{
+    // the vendor owns this thread, so it can only be configured from here
+    if (_callbackSchedPending and _callbackSchedPending.exchange(false))
+    {
+        applyThreadScheduling("stream callback");
+    }
+    SoapySDRPlayTraceScope trace("rx_callback", "samples", numSamples);
+
+    // single writer, the stores need no read-modify-write
+    _cbCount.store(_cbCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    _cbSamples.store(_cbSamples.load(std::memory_order_relaxed) + numSamples, std::memory_order_relaxed);
+    _cbLastSamples.store(numSamples, std::memory_order_relaxed);
+    const unsigned int minSamples = _cbMinSamples.load(std::memory_order_relaxed);
+    if (minSamples == 0 or numSamples < minSamples) _cbMinSamples.store(numSamples, std::memory_order_relaxed);
+    if (numSamples > _cbMaxSamples.load(std::memory_order_relaxed)) _cbMaxSamples.store(numSamples, std::memory_order_relaxed);
+
+    unsigned int changes = 0;
+    if (grChanged) changes |= SDRPLAY_META_GR_CHANGED;
+    if (rfChanged) changes |= SDRPLAY_META_RF_CHANGED;
+    if (fsChanged) changes |= SDRPLAY_META_FS_CHANGED;
+    if (reset) changes |= SDRPLAY_META_RESET;
+    if (hwRemoved) changes |= SDRPLAY_META_HW_REMOVED;
+    if (changes != 0) SoapySDRPlayTrace::instant("stream_changes", "flags", changes);
+
+    // a block ends about when it arrives, but arrives late by a varying delay:
+    // the earliest arrival anchors the sample clock, later ones only pull it
+    // up slowly to follow the drift between the RSP and host oscillators
+    const uint32_t rate = _state.load().reqSampleRate;
+    const long long nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (rate != _timeRate or reset or fsChanged)
+    {
+        _timeRate = rate;
+        _timeSamples = 0;
+        _timeBaseNs = nowNs - (long long)(numSamples * 1e9 / rate);
+    }
+    const long long baseNs = nowNs - (long long)((_timeSamples + numSamples) * 1e9 / rate);
+    if (baseNs < _timeBaseNs) _timeBaseNs = baseNs;
+    else _timeBaseNs += (baseNs - _timeBaseNs) / 256;
+    const long long timeNs = _timeBaseNs + (long long)(_timeSamples * 1e9 / rate);
+    _timeSamples += numSamples;
+
+    // the vendor flags the first block taken at the new frequency
+    if (rfChanged and _metrics.retuneStartNs.load(std::memory_order_relaxed) != 0)
+    {
+        _metrics.retuneNs.record(nowNs - _metrics.retuneStartNs.exchange(0));
+    }
+
+    if (pipelineMode)
+    {
+        pushRawBlock(xi, xq, firstSampleNum, changes, numSamples, timeNs);
+    }
+    else
+    {
+        convertBlock(xi, xq, firstSampleNum, changes, numSamples, timeNs);
+    }
+
+    _metrics.callbackNs.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count() - nowNs);
+}
+
+void SoapySDRPlay::convertBlock(const short *xi, const short *xq, unsigned int firstSampleNum,
+                                unsigned int changes, unsigned int numSamples, long long timeNs)
+{
+    SoapySDRPlayTraceScope trace("convert", "samples", numSamples);
+    std::lock_guard<std::mutex> lock(_buf_mutex);
+
+    SoapySDRPlayConvertJob job;
+    if (not reserveBlock(xi, xq, firstSampleNum, changes, numSamples, timeNs, job))
+    {
+        return;
+    }
+
+    // copy into the buffer queue
+    const unsigned long long energy = convertSamples(job, 0, numSamples);
+
+    closeTailEarly(numSamples * elementsPerSample * shortsPerWord);
+    publishBuffers();
+
+    // block power for the software AGC, which runs on its own thread
+    if (job.measurePower)
+    {
+       _agcEnergy += energy;
+       _agcSamples += numSamples;
+    }
+}
+
+bool SoapySDRPlay::reserveBlock(const short *xi, const short *xq, unsigned int firstSampleNum,
+                                unsigned int changes, unsigned int numSamples, long long timeNs, SoapySDRPlayConvertJob &job)
+{
+    // dropped samples are counted too, so gaps show in the metadata
+    const unsigned long long sampleCount = _sampleCount;
+    _sampleCount += numSamples;
+
+    const SoapySDRPlayState state = _state.load();
+    int spaceReqd = numSamples * elementsPerSample * shortsPerWord;
+    // an empty tail takes the block whatever the latency target, so no empty slot is published
+    if ((_buffSize[_buf_tail] != 0) and ((_buffSize[_buf_tail] + spaceReqd) >= publishThreshold(state.reqSampleRate)))
+    {
+       // blocking readers and the recorder hold the producer back
+       if (not closeTail())
+       {
+           markOverflow();
+           _metrics.droppedSamples.fetch_add(numSamples, std::memory_order_relaxed);
+           return false;
+       }
+    }
+
+    // get current fill buffer
+    short *buff = getRingBuffer(_buf_tail);
+    size_t &buffSize = _buffSize[_buf_tail];
+    auto &meta = _buffMeta[_buf_tail];
+    const int gRdBnow = current_gRdB;
+
+    // a fresh buffer captures the receiver state its samples are taken with
+    if (buffSize == 0)
+    {
+        meta.centerFrequency = state.centerFrequency;
+        meta.sampleRate = state.reqSampleRate;
+        meta.lnaState = state.lnaState;
+        meta.overload = false;
+        meta.changes = 0;
+        meta.firstSampleNum = firstSampleNum;
+        meta.sampleCount = sampleCount;
+        meta.timeNs = timeNs;
+    }
+    meta.gRdB = gRdBnow;
+    meta.overload = meta.overload or adcOverload;
+    meta.changes |= changes;
+    if (_agcStep and _agcStep.exchange(false)) meta.changes |= SDRPLAY_META_AGC_STEP;
+
+    buffSize += spaceReqd;
+
+    job.xi = xi;
+    job.xq = xq;
+    job.numSamples = numSamples;
+    job.useShort = useShort;
+    if (useShort)
+    {
+       job.dst = buff + (buffSize - spaceReqd);
+       job.scale = 1.0f;
+    }
+    else
+    {
+       // the calibration gain is constant over a block and folded into the conversion
+       job.dst = (float *)buff + ((buffSize - spaceReqd) / shortsPerWord);
+       job.scale = getConversionScale(state, gRdBnow);
+    }
+    job.measurePower = softwareAgc and (state.agcMode != mir_sdr_AGC_DISABLE);
+
+    return true;
+}
+
+size_t SoapySDRPlay::publishThreshold(const uint32_t rate) const
+{
+    const size_t full = bufferLength / decM;
+    const unsigned int latency = latencyUs.load(std::memory_order_relaxed);
+    if (latency == 0) return full;
+
+    const size_t samples = std::max((size_t)((double)rate * latency / 1e6), (size_t)1);
+    return std::min(full, samples * elementsPerSample * shortsPerWord);
+}
+
+bool SoapySDRPlay::closeTail(void)
+{
+    size_t next;
+    if (not findFreeSlot(next)) return false;
+
+    // move to the new slot, the filled one is handed out by publishBuffers()
+    _buf_pending.push_back(_buf_tail);
+    _buf_tail = next;
+    _buffRefs[next] = 1;
+    _buffSize[next] = 0;
+    return true;
+}
+
+void SoapySDRPlay::closeTailEarly(const size_t blockSpace)
+{
+    // without a free slot the next block decides, as without a target
+    if (latencyUs.load(std::memory_order_relaxed) == 0 or _buffSize[_buf_tail] == 0) return;
+    if ((_buffSize[_buf_tail] + blockSpace) < publishThreshold(_buffMeta[_buf_tail].sampleRate)) return;
+    closeTail();
+}
+
+void SoapySDRPlay::publishBuffers(void)
+{
+    if (_buf_pending.empty())
+    {
+        return;
+    }
+    SoapySDRPlayTrace::instant("publish", "buffers", (long long)_buf_pending.size());
+
+    // shared stream readers get a copy, made on the writer thread from the ring
+    if (_shm)
+    {
+        for (const size_t handle : _buf_pending)
+        {
+            const auto &meta = _buffMeta[handle];
+
+            SoapySDRPlayShmWriter::Block block;
+            block.handle = handle;
+            block.data = getRingBuffer(handle);
+            block.bytes = _buffSize[handle] * sizeof(short);
+            block.meta.sampleCount = meta.sampleCount;
+            block.meta.centerFrequency = meta.centerFrequency;
+            block.meta.sampleRate = meta.sampleRate;
+            block.meta.gRdB = meta.gRdB;
+            block.meta.lnaState = meta.lnaState;
+            block.meta.overload = meta.overload;
+            block.meta.changes = meta.changes;
+            block.meta.timeNs = meta.timeNs;
+            if (_shm->push(block)) _buffRefs[handle]++;
+        }
+    }
+
+    // the recorder writes published buffers straight out of the ring,
+    // a recorder that is behind skips them and leaves them to the readers
+    if (_recorder)
+    {
+        for (const size_t handle : _buf_pending)
+        {
+            const auto &meta = _buffMeta[handle];
+
+            SoapySDRPlayRecorder::Block block;
+            block.handle = handle;
+            block.data = getRingBuffer(handle);
+            block.bytes = _buffSize[handle] * sizeof(short);
+            block.sampleCount = meta.sampleCount;
+            block.frequency = meta.centerFrequency;
+            block.sampleRate = meta.sampleRate;
+            block.gRdB = meta.gRdB;
+            block.lnaState = meta.lnaState;
+            block.overload = meta.overload;
+            if (_recorder->push(block)) _buffRefs[handle]++;
+        }
+    }
+
+    // remote clients are sent published buffers straight out of the ring
+    if (_net)
+    {
+        for (const size_t handle : _buf_pending)
+        {
+            const auto &meta = _buffMeta[handle];
+
+            SoapySDRPlayNetServer::Block block;
+            block.handle = handle;
+            block.data = getRingBuffer(handle);
+            block.numSamples = _buffSize[handle] / (elementsPerSample * shortsPerWord);
+            block.isFloat = not useShort;
+            block.sampleCount = meta.sampleCount;
+            block.timeNs = meta.timeNs;
+            block.centerFrequency = meta.centerFrequency;
+            block.sampleRate = meta.sampleRate;
+            block.overload = meta.overload;
+            if (_net->push(block)) _buffRefs[handle]++;
+        }
+    }
+
+    // every active reader gets every buffer, the producer lets go of them
+    size_t published = 0;
+    for (const size_t handle : _buf_pending)
+    {
+        for (const auto &reader : _streams)
+        {
+            if (not reader->active) continue;
+            reader->queue.push_back(handle);
+            _buffRefs[handle]++;
+        }
+        _buffRefs[handle]--;
+        published += _buffSize[handle];
+    }
+    _buf_pending.clear();
+
+    size_t queued = 0;
+    for (const auto &reader : _streams) queued = std::max(queued, reader->queue.size());
+    _metrics.publishedSamples.fetch_add(published / (elementsPerSample * shortsPerWord), std::memory_order_relaxed);
+    _metrics.queuedBuffers.store((unsigned int)queued, std::memory_order_relaxed);
+    _metrics.ringBuffers.store((unsigned int)numBuffers, std::memory_order_relaxed);
+
+    // notify readStream()
+    notifyStreams();
+}
+
+void SoapySDRPlay::notifyStreams(void)
+{
+    if (_awaitFirstSample.load(std::memory_order_relaxed) and _awaitFirstSample.exchange(false))
+    {
+        _firstSampleUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _activateTime).count();
+    }
+
+    _publishSeq.fetch_add(1, std::memory_order_release);
+    if (_buf_waiters > 0) _buf_cond.notify_all();
+
+#ifdef __linux__
+    // the counter value is irrelevant, readers drain it when they run dry
+    const uint64_t one = 1;
+    for (const auto &reader : _streams)
+    {
+        if (reader->eventFd < 0) continue;
+        if (not reader->queue.empty() or reader->overflow)
+        {
+            if (write(reader->eventFd, &one, sizeof(one)) < 0 and errno != EAGAIN)
+            {
+                SoapySDR_logf(SOAPY_SDR_WARNING, "stream eventfd write failed: %s", strerror(errno));
+            }
+        }
+    }
+#endif
+}
+
+void SoapySDRPlay::clearStreamEvent(SoapySDRPlayStream *reader)
+{
+#ifdef __linux__
+    uint64_t value;
+    if (reader->eventFd >= 0 and read(reader->eventFd, &value, sizeof(value)) < 0) {}
+#endif
+}
+
+void SoapySDRPlay::closeStreamEvent(SoapySDRPlayStream *reader)
+{
+#ifndef _WIN32
+    if (reader->eventFd >= 0) close(reader->eventFd);
+#endif
+    reader->eventFd = -1;
+}
+
+void SoapySDRPlay::markOverflow(void)
+{
+    // reported along with the next published buffer, so a run of dropped blocks is one gap
+    SoapySDRPlayTrace::instant("overflow");
+    for (const auto &reader : _streams)
+    {
+        if (reader->active) reader->overflow = true;
+    }
+}
+
+bool SoapySDRPlay::findFreeSlot(size_t &slot)
+{
+    // slots are taken in ring order, so the first one found is the oldest
+    for (size_t k = 1; k < numBuffers; k++)
+    {
+        slot = (_buf_tail + k) % numBuffers;
+        if (_buffRefs[slot] == 0) return true;
+    }
+
+    // otherwise the oldest slot that is only queued for readers dropping their oldest buffer
+    for (size_t k = 1; k < numBuffers; k++)
+    {
+        slot = (_buf_tail + k) % numBuffers;
+
+        unsigned int droppable = 0;
+        for (const auto &reader : _streams)
+        {
+            if (reader->blockProducer) continue;
+            droppable += std::count(reader->queue.begin(), reader->queue.end(), slot);
+        }
+        if (droppable != _buffRefs[slot]) continue;
+
+        for (const auto &reader : _streams)
+        {
+            auto it = std::find(reader->queue.begin(), reader->queue.end(), slot);
+            if (it == reader->queue.end()) continue;
+            reader->queue.erase(it);
+            reader->overflow = true;
+        }
+        SoapySDRPlayTrace::instant("drop", "slot", (long long)slot);
+        _metrics.droppedBuffers.fetch_add(1, std::memory_order_relaxed);
+        _buffRefs[slot] = 0;
+        return true;
+    }
+    return false;
+}
+
+void SoapySDRPlay::dropQueued(SoapySDRPlayStream *reader)
+{
+    for (const size_t handle : reader->queue) _buffRefs[handle]--;
+    reader->queue.clear();
+}
+
+void SoapySDRPlay::resetRing(void)
+{
+    // drop what the readers haven't acquired yet and the buffers in progress,
+    // the fill slot stays with the producer and starts over
+    for (const auto &reader : _streams)
+    {
+        dropQueued(reader.get());
+        reader->overflow = false;
+    }
+    for (const size_t handle : _buf_pending) _buffRefs[handle]--;
+    _buf_pending.clear();
+    if (not _buffSize.empty()) _buffSize[_buf_tail] = 0;
+}
+
+unsigned long long SoapySDRPlay::convertSamples(const SoapySDRPlayConvertJob &job, unsigned int from, unsigned int to)
+{
+    const short *xi = job.xi;
+    const short *xq = job.xq;
+    short *dst16 = (short *)job.dst;
+    float *dst32 = (float *)job.dst;
+    const float scale = job.scale;
+    const bool measure = job.measurePower;
+    unsigned long long energy = 0;
+    unsigned int i = from;
+
+    // 8 samples at a time: interleave, then store or widen, convert and scale in one pass;
+    // the AGC block power I*I + Q*Q is summed from the same registers
+#if defined(SDRPLAY_CONVERT_SSE2)
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i vpower = zero;
+    for (; i + 8 <= to; i += 8)
+    {
+       const __m128i vi = _mm_loadu_si128((const __m128i *)(xi + i));
+       const __m128i vq = _mm_loadu_si128((const __m128i *)(xq + i));
+       const __m128i lo = _mm_unpacklo_epi16(vi, vq);
+       const __m128i hi = _mm_unpackhi_epi16(vi, vq);
+       if (job.useShort)
+       {
+          _mm_storeu_si128((__m128i *)(dst16 + 2 * i), lo);
+          _mm_storeu_si128((__m128i *)(dst16 + 2 * i + 8), hi);
+       }
+       else
+       {
+          // duplicating each value and shifting right sign extends to 32 bits
+          float *dptr = dst32 + 2 * i;
+          _mm_storeu_ps(dptr, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16)), vscale));
+          _mm_storeu_ps(dptr + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16)), vscale));
+          _mm_storeu_ps(dptr + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16)), vscale));
+          _mm_storeu_ps(dptr + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16)), vscale));
+       }
+       if (measure)
+       {
+          // one I*I + Q*Q per lane, at most 2^31 so exact as unsigned, summed in 64 bits
+          const __m128i plo = _mm_madd_epi16(lo, lo);
+          const __m128i phi = _mm_madd_epi16(hi, hi);
+          vpower = _mm_add_epi64(vpower, _mm_unpacklo_epi32(plo, zero));
+          vpower = _mm_add_epi64(vpower, _mm_unpackhi_epi32(plo, zero));
+          vpower = _mm_add_epi64(vpower, _mm_unpacklo_epi32(phi, zero));
+          vpower = _mm_add_epi64(vpower, _mm_unpackhi_epi32(phi, zero));
+       }
+    }
+    unsigned long long lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, vpower);
+    energy += lanes[0] + lanes[1];
+#elif defined(SDRPLAY_CONVERT_NEON)
+    const float32x4_t vscale = vdupq_n_f32(scale);
+    uint64x2_t vpower = vdupq_n_u64(0);
+    for (; i + 8 <= to; i += 8)
+    {
+       const int16x8x2_t iq = vzipq_s16(vld1q_s16(xi + i), vld1q_s16(xq + i));
+       if (job.useShort)
+       {
+          vst1q_s16(dst16 + 2 * i, iq.val[0]);
+          vst1q_s16(dst16 + 2 * i + 8, iq.val[1]);
+       }
+       else
+       {
+          float *dptr = dst32 + 2 * i;
+          vst1q_f32(dptr, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(iq.val[0]))), vscale));
+          vst1q_f32(dptr + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(iq.val[0]))), vscale));
+          vst1q_f32(dptr + 8, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(iq.val[1]))), vscale));
+          vst1q_f32(dptr + 12, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(iq.val[1]))), vscale));
+       }
+       if (measure)
+       {
+          // squares fit 32 bits, pairwise added into 64 bit lanes
+          vpower = vpadalq_u32(vpower, vreinterpretq_u32_s32(vmull_s16(vget_low_s16(iq.val[0]), vget_low_s16(iq.val[0]))));
+          vpower = vpadalq_u32(vpower, vreinterpretq_u32_s32(vmull_s16(vget_high_s16(iq.val[0]), vget_high_s16(iq.val[0]))));
+          vpower = vpadalq_u32(vpower, vreinterpretq_u32_s32(vmull_s16(vget_low_s16(iq.val[1]), vget_low_s16(iq.val[1]))));
+          vpower = vpadalq_u32(vpower, vreinterpretq_u32_s32(vmull_s16(vget_high_s16(iq.val[1]), vget_high_s16(iq.val[1]))));
+       }
+    }
+    energy += vgetq_lane_u64(vpower, 0) + vgetq_lane_u64(vpower, 1);
+#endif
+
+    for (; i < to; i++)
+    {
+       if (job.useShort)
+       {
+          dst16[2 * i] = xi[i];
+          dst16[2 * i + 1] = xq[i];
+       }
+       else
+       {
+          dst32[2 * i] = (float)xi[i] * scale;
+          dst32[2 * i + 1] = (float)xq[i] * scale;
+       }
+       if (measure) energy += (unsigned int)(xi[i] * xi[i]) + (unsigned int)(xq[i] * xq[i]);
+    }
+    return energy;
+}
+
+void SoapySDRPlay::convertBlocksParallel(size_t head, size_t count)
+{
+    SoapySDRPlayTraceScope trace("convert_parallel", "blocks", (long long)count);
+
+    // reserve space in block order, so the output order matches the input order
+    std::vector<SoapySDRPlayConvertJob> jobs;
+    {
+        std::lock_guard<std::mutex> lock(_buf_mutex);
+        for (size_t k = 0; k < count; k++)
+        {
+            const auto &block = _rawBlocks[(head + k) % _rawBlocks.size()];
+            SoapySDRPlayConvertJob job;
+            if (reserveBlock(block.xi.data(), block.xq.data(), block.firstSampleNum, block.changes, block.numSamples, block.timeNs, job))
+            {
+                jobs.push_back(job);
+            }
+        }
+        _tailConverting = not jobs.empty();
+    }
+
+    // the conversion is stateless, so blocks can be split anywhere,
+    // each chunk writes its energy into its own slot, sized before any task runs
+    size_t chunks = 0;
+    for (const auto &job : jobs) chunks += (job.numSamples + DEFAULT_DSP_CHUNK_SAMPLES - 1) / DEFAULT_DSP_CHUNK_SAMPLES;
+    std::vector<unsigned long long> energies(chunks, 0);
+    std::vector<SoapySDRPlayThreadPool::Task> tasks;
+    tasks.reserve(chunks);
+    unsigned long long *energySlot = energies.data();
+    for (const auto &job : jobs)
+    {
+        for (unsigned int from = 0; from < job.numSamples; from += DEFAULT_DSP_CHUNK_SAMPLES)
+        {
+            const unsigned int to = std::min(from + DEFAULT_DSP_CHUNK_SAMPLES, job.numSamples);
+            const SoapySDRPlayConvertJob *pjob = &job;
+            tasks.push_back([pjob, from, to, energySlot]{ *energySlot = convertSamples(*pjob, from, to); });
+            energySlot++;
+        }
+    }
+    _dspPool->run(tasks);
+
+    unsigned long long energy = 0;
+    unsigned long long samples = 0;
+    for (const auto &e : energies) energy += e;
+    for (const auto &job : jobs) if (job.measurePower) samples += job.numSamples;
+    if (samples != 0)
+    {
+        _agcEnergy += energy;
+        _agcSamples += samples;
+    }
+
+    // buffers filled meanwhile are handed out only now that they are complete,
+    // a reset by the reader in between has already discarded them
+    std::lock_guard<std::mutex> lock(_buf_mutex);
+    _tailConverting = false;
+    if (not jobs.empty()) closeTailEarly(jobs.back().numSamples * elementsPerSample * shortsPerWord);
+    publishBuffers();
+}
+
+void SoapySDRPlay::gr_callback(unsigned int gRdB, unsigned int lnaGRdB)
+{
+    //Beware, lnaGRdB is really the LNA GR, NOT the LNA state !
+ 
+    mir_sdr_GainValuesT gainVals;
+
+    mir_sdr_GetCurrentGain(&gainVals);
+
+    if (gRdB < 200)
+    {
+        current_gRdB = gRdB;
+        SoapySDRPlayTrace::counter("gRdB", gRdB);
+    }
+
+    if (gRdB < mir_sdr_GAIN_MESSAGE_START_ID)
+    {
+        // gainVals.curr is a calibrated gain value
+    }
+    else if (gRdB == mir_sdr_ADC_OVERLOAD_DETECTED)
+    {
+        mir_sdr_GainChangeCallbackMessageReceived();
+        // OVERLOAD DECTECTED
+        adcOverload = true;
+        _metrics.overloads.fetch_add(1, std::memory_order_relaxed);
+        SoapySDRPlayTrace::instant("adc_overload", "detected", 1);
+    }
+    else
+    {
+        mir_sdr_GainChangeCallbackMessageReceived();
+        // OVERLOAD CORRECTED
+        adcOverload = false;
+        SoapySDRPlayTrace::instant("adc_overload", "detected", 0);
+    }
+}
+
+/*******************************************************************
+ * Ring consumers
+ ******************************************************************/
+
+void SoapySDRPlay::releaseSlot(const size_t handle)
+{
+    std::lock_guard <std::mutex> lock(_buf_mutex);
+    _buffRefs[handle]--;
+}
+
+// a consumer is destroyed outside the lock, its threads release buffers under it
+template <typename T>
+static void resetConsumer(std::mutex &bufMutex, std::unique_ptr<T> &consumer)
+{
+    std::unique_ptr<T> old;
+    {
+        std::lock_guard <std::mutex> lock(bufMutex);
+        consumer.swap(old);
+    }
+    old.reset();
+}
+
+/*******************************************************************
+ * Recorder
+ ******************************************************************/
+
+void SoapySDRPlay::startRecorder(void)
+{
+    std::string path;
+    {
+        std::lock_guard <std::mutex> lock(_sched_mutex);
+        path = recordPath;
+    }
+    if (path.empty()) return;
+
+    std::unique_ptr<SoapySDRPlayRecorder> recorder;
+    try
+    {
+        recorder.reset(new SoapySDRPlayRecorder(path, useShort ? "ci16_le" : "cf32_le",
+                                                elementsPerSample * shortsPerWord * sizeof(short),
+                                                getHardwareInfo(),
+                                                [this](size_t handle){ releaseSlot(handle); }));
+    }
+    catch (const std::exception &ex)
+    {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "Recording not started: %s", ex.what());
+        return;
+    }
+
+    std::lock_guard <std::mutex> lock(_buf_mutex);
+    _recorder.swap(recorder);
+}
+
+void SoapySDRPlay::stopRecorder(void)
+{
+    resetConsumer(_buf_mutex, _recorder);
+}
+
+/*******************************************************************
+ * Shared stream
+ ******************************************************************/
+
+void SoapySDRPlay::startSharedStream(void)
+{
+    std::string name;
+    {
+        std::lock_guard <std::mutex> lock(_sched_mutex);
+        name = shmName;
+    }
+    if (name.empty()) return;
+
+    std::unique_ptr<SoapySDRPlayShmWriter> shm;
+    try
+    {
+        shm.reset(new SoapySDRPlayShmWriter(name, useShort ? "CS16" : "CF32", bufferLength * sizeof(short),
+                                            [this](size_t handle){ releaseSlot(handle); }));
+    }
+    catch (const std::exception &ex)
+    {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "Stream sharing not started: %s", ex.what());
+        return;
+    }
+
+    std::lock_guard <std::mutex> lock(_buf_mutex);
+    _shm.swap(shm);
+}
+
+void SoapySDRPlay::stopSharedStream(void)
+{
+    resetConsumer(_buf_mutex, _shm);
+}
+
+/*******************************************************************
+ * Streaming server
+ ******************************************************************/
+
+void SoapySDRPlay::startNetServer(void)
+{
+    std::string endpoint, codec;
+    {
+        std::lock_guard <std::mutex> lock(_sched_mutex);
+        endpoint = netServer;
+        codec = netCodec;
+    }
+    if (endpoint.empty()) return;
+
+    std::unique_ptr<SoapySDRPlayNetServer> net;
+    try
+    {
+        net.reset(new SoapySDRPlayNetServer(endpoint, SoapySDRPlayNet_parseCodec(codec),
+                                            [this](size_t handle){ releaseSlot(handle); }));
+    }
+    catch (const std::exception &ex)
+    {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "Streaming server not started: %s", ex.what());
+        return;
+    }
+
+    std::lock_guard <std::mutex> lock(_buf_mutex);
+    _net.swap(net);
+}
+
+void SoapySDRPlay::stopNetServer(void)
+{
+    resetConsumer(_buf_mutex, _net);
+}
+
+/*******************************************************************
+ * Metrics exporter
+ ******************************************************************/
+
+void SoapySDRPlay::startMetricsExporter(void)
+{
+    std::lock_guard <std::mutex> lock(_metrics_mutex);
+    if (metricsServer.empty() and metricsFile.empty()) return;
+
+    // the receiver state comes from the lock-free snapshot, never a device lock
+    const auto gauges = [this]{
+        const SoapySDRPlayState state = _state.load();
+        SoapySDRPlayMetricsGauges values;
+        values.sampleRate = state.reqSampleRate;
+        values.centerFrequency = state.centerFrequency;
+        values.gRdB = current_gRdB;
+        values.lnaState = state.lnaState;
+        values.receivedSamples = _cbSamples.load(std::memory_order_relaxed);
+        return values;
+    };
+
+    try
+    {
+        _metricsExporter.reset(new SoapySDRPlayMetricsExporter(_metrics, gauges,
+            SoapySDRPlayMetricsExporter::makeLabels(serNo, getHardwareKey()),
+            metricsServer, metricsFile, metricsInterval));
+    }
+    catch (const std::exception &ex)
+    {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "Metrics exporter not started: %s", ex.what());
+    }
+}
+
+void SoapySDRPlay::stopMetricsExporter(void)
+{
+    std::unique_ptr<SoapySDRPlayMetricsExporter> exporter;
+    {
+        std::lock_guard <std::mutex> lock(_metrics_mutex);
+        _metricsExporter.swap(exporter);
+    }
+    exporter.reset();
+}
+
+/*******************************************************************
+ * Replay device
+ ******************************************************************/
+
+void SoapySDRPlay::startReplayThread(void)
+{
+    _replay->rewind();
+    replayActive = true;
+    _replay_thread = std::thread(&SoapySDRPlay::replay_thread_loop, this);
+}
+
+void SoapySDRPlay::stopReplayThread(void)
+{
+    replayActive = false;
+    if (_replay_thread.joinable()) _replay_thread.join();
+}
+
+bool SoapySDRPlay::waitReplaySpace(void)
+{
+    while (replayActive)
+    {
+        // keep the raw backlog well under one stream buffer, so once it
+        // is converted it still fits in the slot checked for below
+        bool space = not pipelineMode or (_raw_tail - _raw_head < SDRPLAY_REPLAY_RAW_BACKLOG);
+        {
+            // the next two slots free, whatever the readers' policy,
+            // so reserveBlock() has a slot to spare and never drops
+            std::lock_guard<std::mutex> lock(_buf_mutex);
+            space = space and (std::count(_buffRefs.begin(), _buffRefs.end(), 0u) >= 2);
+        }
+        if (space) return true;
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    return false;
+}
+
+void SoapySDRPlay::replay_thread_loop(void)
+{
+    std::vector<short> xi(SDRPLAY_REPLAY_BLOCK_SAMPLES);
+    std::vector<short> xq(SDRPLAY_REPLAY_BLOCK_SAMPLES);
+
+    const double rate = _replay->getSampleRate();
+    const auto start = std::chrono::steady_clock::now();
+    unsigned long long played = 0;
+    unsigned int reset = 1;
+
+    while (replayActive)
+    {
+        const size_t n = _replay->read(xi.data(), xq.data(), xi.size());
+        if (n == 0)
+        {
+            if (not replayLoop) break;
+            _replay->rewind();
+            continue;
+        }
+
+        if (replayRealtime)
+        {
+            // paced against the start time, so sleep jitter doesn't accumulate
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                  std::chrono::duration<double>(played / rate)));
+        }
+        else if (not waitReplaySpace())
+        {
+            break;
+        }
 
-SoapySDR::ArgInfoList SoapySDRPlay::getStreamArgsInfo(const int direction, const size_t channel) const 
-{
-    SoapySDR::ArgInfoList streamArgs;
+        // the same entry point as the API stream callback
+        rx_callback(xi.data(), xq.data(), (unsigned int)played, 0, 0, 0, (unsigned int)n, reset, 0);
+        reset = 0;
+        played += n;
+    }
 
-    return streamArgs;
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "Replay stopped after %llu samples", played);
 }
 
 /*******************************************************************
- * Async thread work
+ * Conversion pipeline
  ******************************************************************/
 
-static void _rx_callback(short *xi, short *xq, unsigned int firstSampleNum, int grChanged, int rfChanged, 
-                         int fsChanged, unsigned int numSamples, unsigned int reset, unsigned int hwRemoved, void *cbContext)
+void SoapySDRPlay::pushRawBlock(const short *xi, const short *xq, unsigned int firstSampleNum,
+                                unsigned int changes, unsigned int numSamples, long long timeNs)
 {
-    SoapySDRPlay *self = (SoapySDRPlay *)cbContext;
-    return self->rx_callback(xi, xq, numSamples);
+    // single producer: only the stream callback moves the tail
+    size_t tail = _raw_tail.load(std::memory_order_relaxed);
+
+    while (numSamples > 0)
+    {
+        if (tail - _raw_head.load(std::memory_order_acquire) == _rawBlocks.size())
+        {
+            _rawOverflow = true;
+            break;
+        }
+
+        // the callback only copies the I and Q planes, one memcpy each
+        auto &block = _rawBlocks[tail % _rawBlocks.size()];
+        const unsigned int n = std::min(numSamples, (unsigned int)block.xi.size());
+        std::memcpy(block.xi.data(), xi, n * sizeof(short));
+        std::memcpy(block.xq.data(), xq, n * sizeof(short));
+        block.numSamples = n;
+        block.firstSampleNum = firstSampleNum;
+        block.changes = changes;
+        block.timeNs = timeNs;
+
+        xi += n;
+        xq += n;
+        numSamples -= n;
+        firstSampleNum += n;
+        changes = 0;
+        // a later piece starts n sample periods after this one, on the callback's clock
+        timeNs += (long long)(n * 1e9 / _timeRate);
+        _raw_tail.store(++tail);
+    }
+
+    // sequentially consistent with the tail store, so a sleeping thread can't be missed
+    if (_raw_waiting)
+    {
+        { std::lock_guard <std::mutex> lock(_raw_mutex); }
+        _raw_cond.notify_one();
+    }
 }
 
-static void _gr_callback(unsigned int gRdB, unsigned int lnaGRdB, void *cbContext)
+void SoapySDRPlay::startPipelineThread(void)
 {
-    SoapySDRPlay *self = (SoapySDRPlay *)cbContext;
-    return self->gr_callback(gRdB, lnaGRdB);
+    if (not pipelineMode or _pipeline_thread.joinable()) return;
+
+    if (dspThreads > 0)
+    {
+        _dspPool.reset(new SoapySDRPlayThreadPool(dspThreads, [this]{ applyThreadScheduling("DSP"); }));
+    }
+
+    _raw_head = 0;
+    _raw_tail = 0;
+    _rawOverflow = false;
+    _pipeline_running = true;
+    _pipeline_thread = std::thread(&SoapySDRPlay::pipeline_thread_loop, this);
 }
 
-void SoapySDRPlay::rx_callback(short *xi, short *xq, unsigned int numSamples)
+void SoapySDRPlay::stopPipelineThread(void)
 {
-    std::lock_guard<std::mutex> lock(_buf_mutex);
-
-    if (_buf_count == numBuffers)
     {
-        _overflowEvent = true;
-        return;
+        std::lock_guard <std::mutex> lock(_raw_mutex);
+        _pipeline_running = false;
     }
-    
-    int spaceReqd = numSamples * elementsPerSample * shortsPerWord;
-    if ((_buffs[_buf_tail].size() + spaceReqd) >= (bufferLength / decM))
+    _raw_cond.notify_one();
+    if (_pipeline_thread.joinable()) _pipeline_thread.join();
+    _dspPool.reset();
+}
+
+void SoapySDRPlay::pipeline_thread_loop(void)
+{
+    applyThreadScheduling("pipeline");
+
+    while (true)
     {
-       // increment the tail pointer and buffer count
-       _buf_tail = (_buf_tail + 1) % numBuffers;
-       _buf_count++;
+        size_t head = _raw_head.load(std::memory_order_relaxed);
+
+        if (head == _raw_tail.load(std::memory_order_acquire))
+        {
+            std::unique_lock <std::mutex> lock(_raw_mutex);
+            _raw_waiting = true;
+            _raw_cond.wait(lock, [this, head]{
+                return not _pipeline_running or (head != _raw_tail.load());
+            });
+            _raw_waiting = false;
+            if (not _pipeline_running) break;
+        }
+
+        // blocks dropped by the callback surface as an overflow to the reader
+        if (_rawOverflow and _rawOverflow.exchange(false))
+        {
+            std::lock_guard <std::mutex> lock(_buf_mutex);
+            markOverflow();
+        }
 
-       // notify readStream()
-       _buf_cond.notify_one();
+        if (_dspPool)
+        {
+            // take the whole backlog at once and spread it over the pool
+            const size_t count = _raw_tail.load(std::memory_order_acquire) - head;
+            convertBlocksParallel(head, count);
+            _raw_head.store(head + count, std::memory_order_release);
+        }
+        else
+        {
+            const auto &block = _rawBlocks[head % _rawBlocks.size()];
+            convertBlock(block.xi.data(), block.xq.data(), block.firstSampleNum, block.changes, block.numSamples, block.timeNs);
+            _raw_head.store(head + 1, std::memory_order_release);
+        }
     }
+}
 
-    // get current fill buffer
-    auto &buff = _buffs[_buf_tail];
-    buff.resize(buff.size() + spaceReqd);
+/*******************************************************************
+ * Software AGC
+ ******************************************************************/
 
-    // copy into the buffer queue
-    unsigned int i = 0;
+void SoapySDRPlay::startAgcThread(void)
+{
+    std::lock_guard <std::mutex> lock(_agc_mutex);
+    if (_agc_running) return;
 
-    if (useShort)
+    _agcEnergy = 0;
+    _agcSamples = 0;
+    _agc_running = true;
+    _agc_thread = std::thread(&SoapySDRPlay::agc_thread_loop, this);
+}
+
+void SoapySDRPlay::stopAgcThread(void)
+{
     {
-       short *dptr = buff.data();
-       dptr += (buff.size() - spaceReqd);
-       for (i = 0; i < numSamples; i++)
-       {
-           *dptr++ = xi[i];
-           *dptr++ = xq[i];
-        }
+        std::lock_guard <std::mutex> lock(_agc_mutex);
+        _agc_running = false;
     }
-    else
+    _agc_cond.notify_one();
+    if (_agc_thread.joinable()) _agc_thread.join();
+}
+
+void SoapySDRPlay::agc_thread_loop(void)
+{
+    applyThreadScheduling("AGC");
+
+    std::unique_lock <std::mutex> lock(_agc_mutex);
+
+    while (_agc_running)
     {
-       float *dptr = (float *)buff.data();
-       dptr += ((buff.size() - spaceReqd) / shortsPerWord);
-       for (i = 0; i < numSamples; i++)
-       {
-          *dptr++ = (float)xi[i] / 32768.0f;
-          *dptr++ = (float)xq[i] / 32768.0f;
-       }
-    }
+        _agc_cond.wait_for(lock, std::chrono::milliseconds(SDRPLAY_AGC_PERIOD_MS));
+        if (not _agc_running) break;
 
-    return;
+        const unsigned long long samples = _agcSamples.exchange(0);
+        const unsigned long long energy = _agcEnergy.exchange(0);
+        if (samples == 0) continue;
+
+        // the gain update takes the general state lock, don't hold ours meanwhile
+        lock.unlock();
+        agcUpdate(10.0 * std::log10((double)energy / samples / (32768.0 * 32768.0) + 1e-20));
+        lock.lock();
+    }
 }
 
-void SoapySDRPlay::gr_callback(unsigned int gRdB, unsigned int lnaGRdB)
+void SoapySDRPlay::agcUpdate(double powerdBfs)
 {
-    //Beware, lnaGRdB is really the LNA GR, NOT the LNA state !
- 
-    mir_sdr_GainValuesT gainVals;
+    std::lock_guard <std::mutex> lock(_general_state_mutex);
 
-    mir_sdr_GetCurrentGain(&gainVals);
+    if (not streamActive or not softwareAgc or (agcMode == mir_sdr_AGC_DISABLE))
+    {
+        return;
+    }
 
-    if (gRdB < 200)
+    const double error = powerdBfs - setPoint;
+    if (std::fabs(error) <= agcHysteresis)
     {
-        current_gRdB = gRdB;
+        return;
     }
 
-    if (gRdB < mir_sdr_GAIN_MESSAGE_START_ID)
+    // reduce gain with the attack time constant, restore it with the decay one
+    const double timeConstant = (error > 0) ? agcAttackMs : agcDecayMs;
+    const double coeff = std::min(1.0, SDRPLAY_AGC_PERIOD_MS / timeConstant);
+    int step = (int)std::lround(error * coeff);
+    if (step == 0) step = (error > 0) ? 1 : -1;
+
+    int newGr = gRdB + step;
+    int newLna = lnaState;
+    const int band = getGainBand(centerFrequency);
+
+    // hand over to the LNA once the IF gain reduction runs out of range
+    if ((newGr > 59) && (newLna < getMaxLnaState()))
     {
-        // gainVals.curr is a calibrated gain value
+        newLna++;
+        newGr -= lnaGrTable[band][newLna] - lnaGrTable[band][lnaState];
     }
-    else if (gRdB == mir_sdr_ADC_OVERLOAD_DETECTED)
+    else if ((newGr < 20) && (newLna > 0))
     {
-        mir_sdr_GainChangeCallbackMessageReceived();
-        // OVERLOAD DECTECTED
+        newLna--;
+        newGr += lnaGrTable[band][lnaState] - lnaGrTable[band][newLna];
     }
-    else
+    newGr = std::min(std::max(newGr, 20), 59);
+
+    if ((newGr == gRdB) && (newLna == lnaState))
     {
-        mir_sdr_GainChangeCallbackMessageReceived();
-        // OVERLOAD CORRECTED
+        return;
     }
+
+    // one reinit per control period, whatever the size of the step
+    gRdB = newGr;
+    lnaState = newLna;
+    current_gRdB = gRdB;
+    SoapySDRPlayTraceScope trace("mir_sdr_Reinit", "reason", mir_sdr_CHANGE_GR);
+    mir_sdr_Reinit(&gRdB, 0.0, 0.0, mir_sdr_BW_Undefined, mir_sdr_IF_Undefined, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, mir_sdr_CHANGE_GR);
+    publishState();
+    _agcStep = true;
 }
 
 /*******************************************************************
@@ -160,6 +1496,25 @@ SoapySDR::Stream *SoapySDRPlay::setupStream(const int direction,
        throw std::runtime_error("setupStream invalid channel selection");
     }
     
+    if (format != "CS16" and format != "CF32")
+    {
+       throw std::runtime_error( "setupStream invalid format '" + format +
+                                  "' -- Only CS16 or CF32 are supported by the SoapySDRPlay module.");
+    }
+
+    // further readers share the ring as the first one set it up
+    {
+        std::lock_guard<std::mutex> lock(_buf_mutex);
+        if (not _streams.empty())
+        {
+            if ((format == "CS16") != useShort)
+            {
+                throw std::runtime_error("setupStream format '" + format + "' differs from the stream already set up");
+            }
+            return addStream(args);
+        }
+    }
+
     // check the format
     if (format == "CS16") 
     {
@@ -175,29 +1530,114 @@ SoapySDR::Stream *SoapySDRPlay::setupStream(const int direction,
         bufferLength = bufferElems * elementsPerSample * shortsPerWord;  // allocate enough space for floats instead of shorts
         SoapySDR_log(SOAPY_SDR_INFO, "Using format CF32.");
     } 
-    else 
+
+    for (const auto &arg : args)
     {
-       throw std::runtime_error( "setupStream invalid format '" + format +
-                                  "' -- Only CS16 or CF32 are supported by the SoapySDRPlay module.");
+        writeStreamingSetting(arg.first, arg.second);
+    }
+
+    hugePages = (args.count("huge_pages") != 0) and (args.at("huge_pages") == "true");
+    pipelineMode = (args.count("pipeline") != 0) and (args.at("pipeline") == "true");
+    dspThreads = (args.count("dsp_threads") != 0) ? std::max(std::stoi(args.at("dsp_threads")), 0) : 0;
+
+    // the parallel DSP stage runs off the pipeline thread
+    if (dspThreads > 0) pipelineMode = true;
+
+    if (pipelineMode)
+    {
+        // raw planes staged between the stream callback and the pipeline thread
+        _rawBlocks.resize(DEFAULT_NUM_RAW_BLOCKS);
+        for (auto &block : _rawBlocks)
+        {
+            block.xi.resize(DEFAULT_RAW_BLOCK_SAMPLES);
+            block.xq.resize(DEFAULT_RAW_BLOCK_SAMPLES);
+        }
     }
 
     std::lock_guard<std::mutex> lock(_buf_mutex);
 
     // clear async fifo counts
     _buf_tail = 0;
-    _buf_head = 0;
-    _buf_count = 0;
+    _buf_pending.clear();
+    _sampleCount = 0;
 
     // allocate buffers
-    _buffs.resize(numBuffers);
-    for (auto &buff : _buffs) buff.reserve(bufferLength);
-    for (auto &buff : _buffs) buff.clear();
+    std::lock_guard <std::mutex> schedLock(_sched_mutex);
+    if (memoryLock) lockRingMemory(false);
+    allocateRing(bufferLength, hugePages);
+    _buffSize.assign(numBuffers, 0);
+    _buffRefs.assign(numBuffers, 0);
+    _buffRefs[_buf_tail] = 1;
+    _buffMeta.resize(numBuffers);
+    if (memoryLock) lockRingMemory(true);
+
+    return addStream(args);
+}
+
+SoapySDR::Stream *SoapySDRPlay::addStream(const SoapySDR::Kwargs &args)
+{
+    std::unique_ptr<SoapySDRPlayStream> reader(new SoapySDRPlayStream());
+    reader->blockProducer = (args.count("backpressure") != 0) and (args.at("backpressure") == "block");
+    reader->waitPolicy = SDRPLAY_WAIT_BLOCK;
+    if (args.count("wait_policy") != 0)
+    {
+        const std::string &policy = args.at("wait_policy");
+        if (policy == "spin") reader->waitPolicy = SDRPLAY_WAIT_SPIN;
+        else if (policy == "poll") reader->waitPolicy = SDRPLAY_WAIT_POLL;
+        else if (policy != "block") SoapySDR_logf(SOAPY_SDR_WARNING, "Unknown wait_policy '%s', using block", policy.c_str());
+    }
+    reader->spinUs = (args.count("spin_us") != 0) ? std::max(std::stol(args.at("spin_us")), 0L) : DEFAULT_SPIN_US;
+    reader->hostTime = (args.count("host_time") != 0) and (args.at("host_time") == "true");
+#ifdef __linux__
+    reader->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reader->eventFd < 0)
+    {
+        SoapySDR_logf(SOAPY_SDR_WARNING, "stream eventfd unavailable: %s", strerror(errno));
+    }
+#else
+    reader->eventFd = -1;
+#endif
+    _streams.push_back(std::move(reader));
+    return (SoapySDR::Stream *) _streams.back().get();
+}
+
+bool SoapySDRPlay::detachStream(SoapySDRPlayStream *reader)
+{
+    dropQueued(reader);
+    for (const size_t handle : reader->acquired) _buffRefs[handle]--;
+    reader->acquired.clear();
+    reader->bufferedElems = 0;
+    reader->active = false;
 
-    return (SoapySDR::Stream *) this;
+    for (const auto &other : _streams)
+    {
+        if (other->active) return true;
+    }
+    return false;
 }
 
 void SoapySDRPlay::closeStream(SoapySDR::Stream *stream)
 {
+    deactivateStream(stream, 0, 0);
+    {
+        std::lock_guard <std::mutex> bufLock(_buf_mutex);
+        for (auto it = _streams.begin(); it != _streams.end(); ++it)
+        {
+            if (it->get() == (SoapySDRPlayStream *)stream)
+            {
+                closeStreamEvent(it->get());
+                _streams.erase(it);
+                break;
+            }
+        }
+        if (not _streams.empty()) return;
+    }
+
+    stopAgcThread();
+    stopRecorder();
+    stopSharedStream();
+    stopNetServer();
+    stopReplayThread();
     std::lock_guard <std::mutex> lock(_general_state_mutex);
 
     if (streamActive)
@@ -205,12 +1645,18 @@ void SoapySDRPlay::closeStream(SoapySDR::Stream *stream)
         mir_sdr_StreamUninit();
     }
     streamActive = false;
+    stopPipelineThread();
+
+    std::lock_guard <std::mutex> bufLock(_buf_mutex);
+    lockRingMemory(false);
 }
 
 size_t SoapySDRPlay::getStreamMTU(SoapySDR::Stream *stream) const
 {
-    // is a constant in practice
-    return bufferElems;
+    // the most a buffer holds at the current rate, at least one callback
+    const size_t words = elementsPerSample * shortsPerWord;
+    const size_t threshold = publishThreshold(_state.load().reqSampleRate) / words;
+    return std::min((size_t)bufferElems, std::max(threshold, (size_t)_cbMaxSamples.load()));
 }
 
 int SoapySDRPlay::activateStream(SoapySDR::Stream *stream,
@@ -222,37 +1668,99 @@ int SoapySDRPlay::activateStream(SoapySDR::Stream *stream,
     {
         return SOAPY_SDR_NOT_SUPPORTED;
     }
-   
-    resetBuffer = true;
-    bufferedElems = 0;
+    SoapySDRPlayTraceScope trace("activateStream");
+
+    SoapySDRPlayStream *reader = (SoapySDRPlayStream *)stream;
     
     mir_sdr_ErrT err;
     
     std::lock_guard <std::mutex> lock(_general_state_mutex);
 
+    {
+        std::lock_guard<std::mutex> bufLock(_buf_mutex);
+        if (reader->active) return 0;
+
+        // a reader joining a running stream starts with the next buffer
+        reader->overflow = false;
+        reader->bufferedElems = 0;
+        reader->active = true;
+        if (streamActive or replayActive) return 0;
+    }
+
+    resetBuffer = true;
+    _callbackSchedPending = true;
+
+    // first sample is timed from here by notifyStreams()
+    _activateTime = std::chrono::steady_clock::now();
+    _cbCount = 0;
+    _cbSamples = 0;
+    _cbLastSamples = 0;
+    _cbMinSamples = 0;
+    _cbMaxSamples = 0;
+    _timeRate = 0;
+    _tpTime = _activateTime;
+    _tpCount = 0;
+    _tpSamples = 0;
+    _firstSampleUs = -1;
+    _awaitFirstSample = true;
+
+    if (replayMode)
+    {
+        {
+            // drain the fifo now, a reset on the first read would drop
+            // buffers a fast replay has already filled
+            std::lock_guard<std::mutex> bufLock(_buf_mutex);
+            resetRing();
+            resetBuffer = false;
+        }
+        startPipelineThread();
+        startReplayThread();
+        startRecorder();
+        startSharedStream();
+        startNetServer();
+        _startup.activate = msSince(_activateTime);
+        return 0;
+    }
+
     //Enable (= 1) API calls tracing,
     //but only for debug purposes due to its performance impact. 
     mir_sdr_DebugEnable(0);
 
-    //temporary fix for ARM targets.
-#if defined(__arm__) || defined(__aarch64__)
-    mir_sdr_SetTransferMode(mir_sdr_BULK);
-#endif
+    startPipelineThread();
+
+    mir_sdr_SetTransferMode((transferMode == "bulk") ? mir_sdr_BULK : mir_sdr_ISOCH);
 
+    auto stepStart = std::chrono::steady_clock::now();
     err = mir_sdr_StreamInit(&gRdB, sampleRate / 1e6, centerFrequency / 1e6, bwMode,
                              ifMode, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps,
                              _rx_callback, _gr_callback, (void *)this);
+    _startup.streamInit = msSince(stepStart);
     if (err != mir_sdr_Success)
     {
+       _awaitFirstSample = false;
+       stopPipelineThread();
+       {
+           std::lock_guard<std::mutex> bufLock(_buf_mutex);
+           detachStream(reader);
+       }
        //throw std::runtime_error("StreamInit Error: " + std::to_string(err));
        return SOAPY_SDR_NOT_SUPPORTED;
     }
+    stepStart = std::chrono::steady_clock::now();
     mir_sdr_DecimateControl(decEnable, decM, 1);
+    _startup.decimateControl = msSince(stepStart);
 
+    stepStart = std::chrono::steady_clock::now();
     mir_sdr_SetDcMode(4,0);
     mir_sdr_SetDcTrackTime(63);
+    _startup.dcMode = msSince(stepStart);
     
     streamActive = true;
+    startAgcThread();
+    startRecorder();
+    startSharedStream();
+    startNetServer();
+    _startup.activate = msSince(_activateTime);
     
     return 0;
 }
@@ -263,7 +1771,16 @@ int SoapySDRPlay::deactivateStream(SoapySDR::Stream *stream, const int flags, co
     {
         return SOAPY_SDR_NOT_SUPPORTED;
     }
+    SoapySDRPlayTraceScope trace("deactivateStream");
+
+    // the receiver keeps running for the other readers
+    {
+        std::lock_guard <std::mutex> bufLock(_buf_mutex);
+        if (detachStream((SoapySDRPlayStream *)stream)) return 0;
+    }
 
+    stopAgcThread();
+    stopReplayThread();
     std::lock_guard <std::mutex> lock(_general_state_mutex);
 
     if (streamActive)
@@ -272,6 +1789,10 @@ int SoapySDRPlay::deactivateStream(SoapySDR::Stream *stream, const int flags, co
     }
 
     streamActive = false;
+    stopRecorder();
+    stopSharedStream();
+    stopNetServer();
+    stopPipelineThread();
     
     return 0;
 }
@@ -283,55 +1804,63 @@ int SoapySDRPlay::readStream(SoapySDR::Stream *stream,
                              long long &timeNs,
                              const long timeoutUs)
 {   
-    if (!streamActive) 
+    if (!streamActive and !replayActive) 
     {
         return 0;
     }
     
+    // each reader has its own position, only its own thread touches it
+    SoapySDRPlayStream *reader = (SoapySDRPlayStream *)stream;
+
     // this is the user's buffer for channel 0
     void *buff0 = buffs[0];
     
     // are elements left in the buffer? if not, do a new read.
-    if (bufferedElems == 0)
+    if (reader->bufferedElems == 0)
     {
-        int ret = this->acquireReadBuffer(stream, _currentHandle, (const void **)&_currentBuff, flags, timeNs, timeoutUs);
+        int ret = this->acquireReadBuffer(stream, reader->currentHandle, (const void **)&reader->currentBuff, flags, timeNs, timeoutUs);
   
         if (ret < 0)
         {
             return ret;
         }
-        bufferedElems = ret;
+        reader->bufferedElems = ret;
+        reader->bufferTimeNs = timeNs;
+        reader->bufferRate = this->getReadBufferMeta(stream, reader->currentHandle).sampleRate;
+        reader->bufferOffset = 0;
+    }
+    else
+    {
+        // a later fragment starts that many sample periods after the buffer
+        flags = reader->hostTime ? SOAPY_SDR_HAS_TIME : 0;
+        timeNs = reader->bufferTimeNs + (long long)(reader->bufferOffset * 1e9 / reader->bufferRate);
     }
 
-    size_t returnedElems = std::min(bufferedElems.load(), numElems);
+    size_t returnedElems = std::min(reader->bufferedElems, numElems);
 
     // copy into user's buff0
     if (useShort)
     {
-        std::memcpy(buff0, _currentBuff, returnedElems * 2 * sizeof(short));
+        std::memcpy(buff0, reader->currentBuff, returnedElems * 2 * sizeof(short));
     }
     else
     {
-        std::memcpy(buff0, (float *)_currentBuff, returnedElems * 2 * sizeof(float));
+        std::memcpy(buff0, (float *)reader->currentBuff, returnedElems * 2 * sizeof(float));
     }
     
     // bump variables for next call into readStream
-    bufferedElems -= returnedElems;
-
-    // scope lock here to update _currentBuff position
-    {
-        std::lock_guard <std::mutex> lock(_buf_mutex);
-        _currentBuff += returnedElems * elementsPerSample * shortsPerWord;
-    }
+    reader->bufferedElems -= returnedElems;
+    reader->bufferOffset += returnedElems;
+    reader->currentBuff += returnedElems * elementsPerSample * shortsPerWord;
 
     // return number of elements written to buff0
-    if (bufferedElems != 0)
+    if (reader->bufferedElems != 0)
     {
         flags |= SOAPY_SDR_MORE_FRAGMENTS;
     }
     else
     {
-        this->releaseReadBuffer(stream, _currentHandle);
+        this->releaseReadBuffer(stream, reader->currentHandle);
     }
     return (int)returnedElems;
 }
@@ -344,71 +1873,263 @@ size_t SoapySDRPlay::getNumDirectAccessBuffers(SoapySDR::Stream *stream)
 {
     std::lock_guard <std::mutex> lock(_buf_mutex);
 
-    return _buffs.size();
+    return _buffSize.size();
 }
 
 int SoapySDRPlay::getDirectAccessBufferAddrs(SoapySDR::Stream *stream, const size_t handle, void **buffs)
 {
     std::lock_guard <std::mutex> lock(_buf_mutex);
 
-    buffs[0] = (void *)_buffs[handle].data();
+    buffs[0] = (void *)getRingBuffer(handle);
     return 0;
 }
 
-int SoapySDRPlay::acquireReadBuffer(SoapySDR::Stream *stream,
-                                    size_t &handle,
-                                    const void **buffs,
-                                    int &flags,
-                                    long long &timeNs,
-                                    const long timeoutUs)
+static inline void cpuRelax(void)
 {
-    std::unique_lock <std::mutex> lock(_buf_mutex);
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
 
-    // reset is issued by various settings
-    // overflow set in the rx callback thread
-    if (resetBuffer || _overflowEvent)
+bool SoapySDRPlay::spinForPublish(const size_t seq, const std::chrono::steady_clock::time_point &deadline) const
+{
+    // only look at the clock every so often, it costs more than the pause
+    for (unsigned int n = 1; _publishSeq.load(std::memory_order_acquire) == seq; n++)
     {
-        // drain all buffers from the fifo
-        _buf_tail = 0;
-        _buf_head = 0;
-        _buf_count = 0;
-        for (auto &buff : _buffs) buff.clear();
-        _overflowEvent = false;
-        if (resetBuffer)
-        {
-           resetBuffer = false;
-        }
-        else
-        {
-           SoapySDR_log(SOAPY_SDR_SSI, "O");
-           return SOAPY_SDR_OVERFLOW;
-        }
+        cpuRelax();
+        if ((n % 64) == 0 and std::chrono::steady_clock::now() >= deadline) return false;
+    }
+    return true;
+}
+
+int SoapySDRPlay::waitReadable(SoapySDRPlayStream *reader, std::unique_lock <std::mutex> &lock, const long timeoutUs)
+{
+    // reset is issued by various settings, for all readers
+    if (resetBuffer)
+    {
+        resetBuffer = false;
+        resetRing();
+    }
+
+    // overflow set by the producer: blocks were dropped,
+    // or this reader lost its oldest buffer to keep up
+    if (reader->overflow)
+    {
+        reader->overflow = false;
+        SoapySDRPlayTrace::instant("read_overflow");
+        SoapySDR_log(SOAPY_SDR_SSI, "O");
+        return SOAPY_SDR_OVERFLOW;
     }
 
     // wait for a buffer to become available
-    if (_buf_count == 0)
+    if (reader->queue.empty())
     {
-        _buf_cond.wait_for(lock, std::chrono::microseconds(timeoutUs));
-        if (_buf_count == 0) 
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs);
+
+        // spin without the lock until something is published, then look again
+        if (reader->waitPolicy != SDRPLAY_WAIT_BLOCK and timeoutUs > 0)
+        {
+            const size_t seq = _publishSeq.load(std::memory_order_relaxed);
+            const long spinUs = (reader->waitPolicy == SDRPLAY_WAIT_POLL) ? timeoutUs : std::min(reader->spinUs, timeoutUs);
+            lock.unlock();
+            spinForPublish(seq, std::chrono::steady_clock::now() + std::chrono::microseconds(spinUs));
+            lock.lock();
+        }
+
+        if (reader->waitPolicy != SDRPLAY_WAIT_POLL)
+        {
+            _buf_waiters++;
+            _buf_cond.wait_until(lock, deadline, [reader]{
+                return not reader->queue.empty() or reader->overflow;
+            });
+            _buf_waiters--;
+        }
+        if (reader->overflow)
+        {
+            reader->overflow = false;
+            SoapySDRPlayTrace::instant("read_overflow");
+            SoapySDR_log(SOAPY_SDR_SSI, "O");
+            return SOAPY_SDR_OVERFLOW;
+        }
+        // with a latency target, whatever the producer has so far beats nothing
+        if (reader->queue.empty() and latencyUs.load(std::memory_order_relaxed) != 0 and
+            not _tailConverting and _buffSize[_buf_tail] != 0 and closeTail())
+        {
+            publishBuffers();
+        }
+        if (reader->queue.empty()) 
         {
+           clearStreamEvent(reader);
            return SOAPY_SDR_TIMEOUT;
         }
     }
+    return 0;
+}
+
+int SoapySDRPlay::acquireReadBuffer(SoapySDR::Stream *stream,
+                                    size_t &handle,
+                                    const void **buffs,
+                                    int &flags,
+                                    long long &timeNs,
+                                    const long timeoutUs)
+{
+    SoapySDRPlayStream *reader = (SoapySDRPlayStream *)stream;
+
+    std::unique_lock <std::mutex> lock(_buf_mutex);
+
+    const int ret = waitReadable(reader, lock, timeoutUs);
+    if (ret != 0) return ret;
 
     // extract handle and buffer
-    handle = _buf_head;
-    buffs[0] = (void *)_buffs[handle].data();
-    flags = 0;
+    handle = reader->queue.front();
+    buffs[0] = (void *)getRingBuffer(handle);
+    flags = reader->hostTime ? SOAPY_SDR_HAS_TIME : 0;
+    timeNs = _buffMeta[handle].timeNs;
+    _lastMeta = _buffMeta[handle];
 
-    _buf_head = (_buf_head + 1) % numBuffers;
+    reader->queue.pop_front();
+    reader->acquired.push_back(handle);
+    if (reader->queue.empty()) clearStreamEvent(reader);
+    SoapySDRPlayTrace::instant("acquire", "handle", (long long)handle);
 
     // return number available
-    return (int)(_buffs[handle].size() / (elementsPerSample * shortsPerWord));
+    return (int)(_buffSize[handle] / (elementsPerSample * shortsPerWord));
 }
 
 void SoapySDRPlay::releaseReadBuffer(SoapySDR::Stream *stream, const size_t handle)
+{
+    SoapySDRPlayStream *reader = (SoapySDRPlayStream *)stream;
+
+    std::lock_guard <std::mutex> lock(_buf_mutex);
+    auto it = std::find(reader->acquired.begin(), reader->acquired.end(), handle);
+    if (it == reader->acquired.end()) return;
+    reader->acquired.erase(it);
+    _buffRefs[handle]--;
+    SoapySDRPlayTrace::instant("release", "handle", (long long)handle);
+}
+
+int SoapySDRPlay::acquireReadBuffers(SoapySDR::Stream *stream,
+                                     size_t *handles,
+                                     const void **buffs,
+                                     size_t *numElems,
+                                     const size_t maxBuffs,
+                                     int &flags,
+                                     const long timeoutUs)
+{
+    SoapySDRPlayStream *reader = (SoapySDRPlayStream *)stream;
+
+    std::unique_lock <std::mutex> lock(_buf_mutex);
+
+    const int ret = waitReadable(reader, lock, timeoutUs);
+    if (ret != 0) return ret;
+
+    // everything queued so far, in order, under the one lock
+    size_t n = 0;
+    for (; (n < maxBuffs) and not reader->queue.empty(); n++)
+    {
+        const size_t handle = reader->queue.front();
+        reader->queue.pop_front();
+        reader->acquired.push_back(handle);
+        handles[n] = handle;
+        buffs[n] = (void *)getRingBuffer(handle);
+        numElems[n] = _buffSize[handle] / (elementsPerSample * shortsPerWord);
+    }
+    // each buffer's time is in getReadBufferMeta(handle).timeNs
+    flags = reader->hostTime ? SOAPY_SDR_HAS_TIME : 0;
+    if (n > 0) _lastMeta = _buffMeta[handles[n - 1]];
+    if (reader->queue.empty()) clearStreamEvent(reader);
+    SoapySDRPlayTrace::instant("acquire", "buffers", (long long)n);
+
+    return (int)n;
+}
+
+void SoapySDRPlay::releaseReadBuffers(SoapySDR::Stream *stream, const size_t *handles, const size_t numHandles)
+{
+    SoapySDRPlayStream *reader = (SoapySDRPlayStream *)stream;
+
+    std::lock_guard <std::mutex> lock(_buf_mutex);
+    for (size_t n = 0; n < numHandles; n++)
+    {
+        auto it = std::find(reader->acquired.begin(), reader->acquired.end(), handles[n]);
+        if (it == reader->acquired.end()) continue;
+        reader->acquired.erase(it);
+        _buffRefs[handles[n]]--;
+    }
+    SoapySDRPlayTrace::instant("release", "buffers", (long long)numHandles);
+}
+
+SoapySDRPlayBufferMeta SoapySDRPlay::getReadBufferMeta(SoapySDR::Stream *stream, const size_t handle) const
 {
     std::lock_guard <std::mutex> lock(_buf_mutex);
-    _buffs[handle].clear();
-    _buf_count--;
+    return _buffMeta.at(handle);
+}
+
+int SoapySDRPlay::getStreamFd(SoapySDR::Stream *stream) const
+{
+    // set once by setupStream(), closed by closeStream()
+    return ((const SoapySDRPlayStream *)stream)->eventFd;
+}
+
+std::string SoapySDRPlay::throughputToString(void) const
+{
+    const auto now = std::chrono::steady_clock::now();
+    const unsigned long long count = _cbCount.load(std::memory_order_relaxed);
+    const unsigned long long samples = _cbSamples.load(std::memory_order_relaxed);
+    const double seconds = std::chrono::duration<double>(now - _tpTime).count();
+
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "transfer_mode=%s, samples_per_sec=%.0f, callbacks_per_sec=%.1f, "
+                  "packet_samples=%u, min_packet_samples=%u, max_packet_samples=%u",
+                  transferMode.c_str(),
+                  (seconds > 0.0) ? (samples - _tpSamples) / seconds : 0.0,
+                  (seconds > 0.0) ? (count - _tpCount) / seconds : 0.0,
+                  _cbLastSamples.load(), _cbMinSamples.load(), _cbMaxSamples.load());
+
+    _tpTime = now;
+    _tpCount = count;
+    _tpSamples = samples;
+    return buf;
+}
+
+std::string SoapySDRPlay::startupProfileToString(void) const
+{
+    const auto ms = [](const double value) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.3fms", value);
+        return std::string(buf);
+    };
+
+    const long long firstSampleUs = _firstSampleUs;
+    return "lookup=" + ms(_startup.lookup) +
+           ", set_device_idx=" + ms(_startup.setDeviceIdx) +
+           ", construct=" + ms(_startup.construct) +
+           ", stream_init=" + ms(_startup.streamInit) +
+           ", decimate_control=" + ms(_startup.decimateControl) +
+           ", dc_mode=" + ms(_startup.dcMode) +
+           ", activate=" + ms(_startup.activate) +
+           ", first_sample=" + ((firstSampleUs < 0) ? std::string("pending") : ms(firstSampleUs / 1e3));
+}
+
+std::string SoapySDRPlay::bufferMetaToString(const SoapySDRPlayBufferMeta &meta)
+{
+    std::string changes;
+    if (meta.changes & SDRPLAY_META_GR_CHANGED) changes += "|gr";
+    if (meta.changes & SDRPLAY_META_RF_CHANGED) changes += "|rf";
+    if (meta.changes & SDRPLAY_META_FS_CHANGED) changes += "|fs";
+    if (meta.changes & SDRPLAY_META_RESET) changes += "|reset";
+    if (meta.changes & SDRPLAY_META_HW_REMOVED) changes += "|removed";
+    if (meta.changes & SDRPLAY_META_AGC_STEP) changes += "|agc";
+    if (not changes.empty()) changes.erase(0, 1);
+
+    return "frequency=" + std::to_string(meta.centerFrequency) +
+           ", rate=" + std::to_string(meta.sampleRate) +
+           ", ifgr=" + std::to_string(meta.gRdB) +
+           ", lna=" + std::to_string(meta.lnaState) +
+           ", overload=" + (meta.overload ? "true" : "false") +
+           ", changes=" + changes +
+           ", sample=" + std::to_string(meta.sampleCount);
 }
@@ -0,0 +1,138 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "ThreadPool.hpp"
+
+SoapySDRPlayThreadPool::SoapySDRPlayThreadPool(size_t numWorkers, const Task &onStart):
+    _pending(0),
+    _batch(0),
+    _running(true)
+{
+    // one more queue than workers, the last one is fed for the calling thread
+    for (size_t i = 0; i <= numWorkers; i++)
+    {
+        _queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+    for (size_t i = 0; i < numWorkers; i++)
+    {
+        _workers.push_back(std::thread(&SoapySDRPlayThreadPool::worker_loop, this, i, onStart));
+    }
+}
+
+SoapySDRPlayThreadPool::~SoapySDRPlayThreadPool(void)
+{
+    {
+        std::lock_guard <std::mutex> lock(_mutex);
+        _running = false;
+    }
+    _work_cond.notify_all();
+    for (auto &worker : _workers) worker.join();
+}
+
+void SoapySDRPlayThreadPool::run(std::vector<Task> &tasks)
+{
+    if (tasks.empty()) return;
+
+    _pending = tasks.size();
+
+    // deal the tasks round robin, stealing evens out uneven task costs
+    for (size_t i = 0; i < tasks.size(); i++)
+    {
+        auto &queue = *_queues[i % _queues.size()];
+        std::lock_guard <std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(tasks[i]));
+    }
+    {
+        std::lock_guard <std::mutex> lock(_mutex);
+        _batch++;
+    }
+    _work_cond.notify_all();
+
+    // the caller works through its own queue and steals like any worker
+    Task task;
+    while (popTask(_workers.size(), task))
+    {
+        task();
+        _pending--;
+    }
+
+    std::unique_lock <std::mutex> lock(_mutex);
+    _done_cond.wait(lock, [this]{ return _pending == 0; });
+}
+
+bool SoapySDRPlayThreadPool::popTask(size_t self, Task &task)
+{
+    // newest task from the own queue first, it is the most likely still in cache
+    {
+        auto &queue = *_queues[self];
+        std::lock_guard <std::mutex> lock(queue.mutex);
+        if (not queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // otherwise steal the oldest task of another queue
+    for (size_t i = 1; i < _queues.size(); i++)
+    {
+        auto &queue = *_queues[(self + i) % _queues.size()];
+        std::lock_guard <std::mutex> lock(queue.mutex);
+        if (not queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void SoapySDRPlayThreadPool::worker_loop(size_t self, Task onStart)
+{
+    if (onStart) onStart();
+
+    size_t batch = 0;
+    while (true)
+    {
+        {
+            std::unique_lock <std::mutex> lock(_mutex);
+            _work_cond.wait(lock, [this, batch]{ return not _running or (_batch != batch); });
+            if (not _running) return;
+            batch = _batch;
+        }
+
+        Task task;
+        while (popTask(self, task))
+        {
+            task();
+            if (--_pending == 0)
+            {
+                std::lock_guard <std::mutex> lock(_mutex);
+                _done_cond.notify_one();
+            }
+        }
+    }
+}
@@ -0,0 +1,76 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <memory>
+
+//Small work-stealing pool for the block-parallel DSP stage:
+//run() spreads a batch of tasks over per-worker queues, idle workers
+//steal from the others and the calling thread helps until the batch is done.
+class SoapySDRPlayThreadPool
+{
+public:
+    typedef std::function<void(void)> Task;
+
+    //onStart is called by every worker once, i.e. to apply thread scheduling
+    SoapySDRPlayThreadPool(size_t numWorkers, const Task &onStart = Task());
+
+    ~SoapySDRPlayThreadPool(void);
+
+    size_t size(void) const
+    {
+        return _workers.size();
+    }
+
+    //run all tasks and return once every one of them has completed
+    void run(std::vector<Task> &tasks);
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool popTask(size_t self, Task &task);
+
+    void worker_loop(size_t self, Task onStart);
+
+    std::vector<std::unique_ptr<Queue> > _queues;
+    std::vector<std::thread> _workers;
+
+    std::mutex _mutex;
+    std::condition_variable _work_cond;
+    std::condition_variable _done_cond;
+    std::atomic_size_t _pending;
+    size_t _batch;
+    bool _running;
+};
@@ -0,0 +1,230 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "Trace.hpp"
+#include <SoapySDR/Logger.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+std::atomic_bool SoapySDRPlayTrace::_enabled(false);
+std::mutex SoapySDRPlayTrace::_mutex;
+std::vector<std::unique_ptr<SoapySDRPlayTrace::ThreadEvents> > SoapySDRPlayTrace::_threads;
+unsigned int SoapySDRPlayTrace::_nextTid = 1;
+
+static thread_local const char *_threadName = nullptr;
+
+void SoapySDRPlayTrace::enable(const bool on)
+{
+    std::lock_guard <std::mutex> lock(_mutex);
+    if (on == _enabled) return;
+
+    // a new trace starts empty, buffers of exited threads are let go
+    if (on)
+    {
+        for (size_t i = 0; i < _threads.size();)
+        {
+            if (_threads[i]->retired) _threads.erase(_threads.begin() + i);
+            else _threads[i++]->head = 0;
+        }
+    }
+    _enabled = on;
+}
+
+void SoapySDRPlayTrace::begin(const char *name, const char *argName, const long long arg)
+{
+    if (enabled()) record('B', name, argName, arg);
+}
+
+void SoapySDRPlayTrace::end(const char *name)
+{
+    // also once tracing is off, so the last scopes are closed
+    record('E', name, nullptr, 0);
+}
+
+void SoapySDRPlayTrace::instant(const char *name, const char *argName, const long long arg)
+{
+    if (enabled()) record('i', name, argName, arg);
+}
+
+void SoapySDRPlayTrace::counter(const char *name, const long long value)
+{
+    if (enabled()) record('C', name, name, value);
+}
+
+void SoapySDRPlayTrace::setThreadName(const char *name)
+{
+    _threadName = name;
+}
+
+void SoapySDRPlayTrace::record(const char phase, const char *name, const char *argName, const long long arg)
+{
+    ThreadEvents *thread = threadEvents();
+    const long long nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    // only this thread writes here, dump() checks head to skip torn events
+    const unsigned long long head = thread->head.load(std::memory_order_relaxed);
+    Event &event = thread->events[head % SDRPLAY_TRACE_EVENTS];
+    event.timeNs.store(nowNs, std::memory_order_relaxed);
+    event.name.store(name, std::memory_order_relaxed);
+    event.argName.store(argName, std::memory_order_relaxed);
+    event.arg.store(arg, std::memory_order_relaxed);
+    event.phase.store(phase, std::memory_order_relaxed);
+    thread->head.store(head + 1, std::memory_order_release);
+}
+
+SoapySDRPlayTrace::ThreadEvents *SoapySDRPlayTrace::threadEvents(void)
+{
+    struct Owner
+    {
+        ThreadEvents *events = nullptr;
+        ~Owner(void)
+        {
+            if (events != nullptr) events->retired = true;
+        }
+    };
+    thread_local Owner owner;
+
+    if (owner.events == nullptr)
+    {
+        std::lock_guard <std::mutex> lock(_mutex);
+
+        // short lived threads, i.e. DSP pools rebuilt by setupStream(), must not grow the trace forever
+        ThreadEvents *events = nullptr;
+        if (_threads.size() >= SDRPLAY_TRACE_MAX_THREADS)
+        {
+            for (const auto &thread : _threads)
+            {
+                if (thread->retired) events = thread.get();
+                if (events != nullptr) break;
+            }
+        }
+        if (events == nullptr)
+        {
+            _threads.push_back(std::unique_ptr<ThreadEvents>(new ThreadEvents()));
+            events = _threads.back().get();
+        }
+        events->tid = _nextTid++;
+        events->retired = false;
+        events->head = 0;
+        owner.events = events;
+    }
+
+    if (owner.events->name.load(std::memory_order_relaxed) != _threadName)
+    {
+        owner.events->name.store(_threadName, std::memory_order_relaxed);
+    }
+    return owner.events;
+}
+
+bool SoapySDRPlayTrace::dump(const std::string &path)
+{
+    FILE *fp = std::fopen(path.c_str(), "w");
+    if (fp == nullptr)
+    {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "trace_dump: cannot open %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    const int pid = (int)getpid();
+    size_t numEvents = 0;
+    bool first = true;
+    std::fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    std::lock_guard <std::mutex> lock(_mutex);
+    for (const auto &thread : _threads)
+    {
+        const char *threadName = thread->name.load(std::memory_order_relaxed);
+        std::fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"",
+            first ? "" : ",\n", pid, thread->tid);
+        if (threadName != nullptr) std::fprintf(fp, "%s\"}}", threadName);
+        else std::fprintf(fp, "thread %u\"}}", thread->tid);
+        first = false;
+
+        // copy out first: the thread may still be recording over the oldest events
+        const unsigned long long head = thread->head.load(std::memory_order_acquire);
+        const unsigned long long start = (head > SDRPLAY_TRACE_EVENTS) ? head - SDRPLAY_TRACE_EVENTS : 0;
+        std::vector<Event> events(head - start);
+        for (unsigned long long i = start; i < head; i++)
+        {
+            const Event &src = thread->events[i % SDRPLAY_TRACE_EVENTS];
+            Event &dst = events[i - start];
+            dst.timeNs.store(src.timeNs.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            dst.name.store(src.name.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            dst.argName.store(src.argName.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            dst.arg.store(src.arg.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            dst.phase.store(src.phase.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const unsigned long long after = thread->head.load(std::memory_order_relaxed);
+        const unsigned long long valid = (after + 1 > SDRPLAY_TRACE_EVENTS) ? after + 1 - SDRPLAY_TRACE_EVENTS : 0;
+
+        for (unsigned long long i = std::max(start, valid); i < head; i++)
+        {
+            const Event &event = events[i - start];
+            const long long timeNs = event.timeNs.load(std::memory_order_relaxed);
+            const char phase = event.phase.load(std::memory_order_relaxed);
+            const char *argName = event.argName.load(std::memory_order_relaxed);
+            std::fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld.%03lld,\"pid\":%d,\"tid\":%u",
+                event.name.load(std::memory_order_relaxed), phase, timeNs / 1000, timeNs % 1000, pid, thread->tid);
+            if (phase == 'i') std::fprintf(fp, ",\"s\":\"t\"");
+            if (argName != nullptr) std::fprintf(fp, ",\"args\":{\"%s\":%lld}", argName, event.arg.load(std::memory_order_relaxed));
+            std::fprintf(fp, "}");
+            numEvents++;
+        }
+    }
+
+    std::fprintf(fp, "\n]}\n");
+    const bool ok = (std::ferror(fp) == 0);
+    if (std::fclose(fp) != 0 or not ok)
+    {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "trace_dump: write to %s failed", path.c_str());
+        return false;
+    }
+    SoapySDR_logf(SOAPY_SDR_INFO, "trace_dump: %zu events from %zu threads written to %s", numEvents, _threads.size(), path.c_str());
+    return true;
+}
+
+std::string SoapySDRPlayTrace::getStatus(void)
+{
+    std::lock_guard <std::mutex> lock(_mutex);
+    unsigned long long numEvents = 0;
+    for (const auto &thread : _threads)
+    {
+        numEvents += std::min(thread->head.load(std::memory_order_relaxed), (unsigned long long)SDRPLAY_TRACE_EVENTS);
+    }
+    return "enabled=" + std::string(enabled() ? "true" : "false") +
+           ", threads=" + std::to_string(_threads.size()) +
+           ", events=" + std::to_string(numEvents);
+}
@@ -0,0 +1,113 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define SDRPLAY_TRACE_EVENTS 16384      //events kept per thread, the oldest ones are overwritten
+#define SDRPLAY_TRACE_MAX_THREADS 64    //past this, buffers of exited threads are reused
+
+//Process wide event tracer for the control and data paths: every thread
+//records into its own event ring without locking, dump() writes them all
+//out as Chrome trace JSON for chrome://tracing or ui.perfetto.dev.
+//Event and argument names are kept by pointer and must be string literals.
+class SoapySDRPlayTrace
+{
+public:
+    static bool enabled(void)
+    {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+
+    //recorded events are kept when tracing is turned off, until the next enable
+    static void enable(const bool on);
+
+    static void begin(const char *name, const char *argName = nullptr, const long long arg = 0);
+
+    static void end(const char *name);
+
+    static void instant(const char *name, const char *argName = nullptr, const long long arg = 0);
+
+    static void counter(const char *name, const long long value);
+
+    //label of the calling thread in the dump
+    static void setThreadName(const char *name);
+
+    //write every recorded event as Chrome trace JSON, false on I/O errors
+    static bool dump(const std::string &path);
+
+    static std::string getStatus(void);
+
+private:
+    struct Event
+    {
+        std::atomic<long long> timeNs;
+        std::atomic<const char *> name;
+        std::atomic<const char *> argName;
+        std::atomic<long long> arg;
+        std::atomic<char> phase;
+    };
+
+    struct ThreadEvents
+    {
+        unsigned int tid;
+        std::atomic<const char *> name;
+        std::atomic_bool retired;
+        std::atomic<unsigned long long> head;
+        Event events[SDRPLAY_TRACE_EVENTS];
+    };
+
+    static void record(const char phase, const char *name, const char *argName, const long long arg);
+
+    static ThreadEvents *threadEvents(void);
+
+    static std::atomic_bool _enabled;
+    static std::mutex _mutex;
+    static std::vector<std::unique_ptr<ThreadEvents> > _threads;
+    static unsigned int _nextTid;
+};
+
+//begin/end pair around a scope, the end is recorded if the begin was
+class SoapySDRPlayTraceScope
+{
+public:
+    SoapySDRPlayTraceScope(const char *name, const char *argName = nullptr, const long long arg = 0):
+        _name(SoapySDRPlayTrace::enabled() ? name : nullptr)
+    {
+        if (_name != nullptr) SoapySDRPlayTrace::begin(_name, argName, arg);
+    }
+
+    ~SoapySDRPlayTraceScope(void)
+    {
+        if (_name != nullptr) SoapySDRPlayTrace::end(_name);
+    }
+
+private:
+    const char *_name;
+};
@@ -0,0 +1,214 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+//Aggregation worker: owns one RSP in its own process (mir_sdr API v2 can
+//only stream one device per process) and broadcasts its stream into a
+//shared memory ring the aggregate device reads. Started by the aggregate
+//device with the device arguments on the command line, it is then driven
+//by one command per line on stdin and answers each one with a line on
+//stdout: "ok [value]" or "error <message>". It exits when stdin closes.
+//
+//  SoapySDRPlayWorker serial=<serial> shm_name=<name> [key=value ...]
+//
+//  commands: frequency|rate|bandwidth|gain|gain_mode|antenna [value]
+//            gain_element <name> [value]
+//            setting <key> [value]
+//  queries:  antennas, gains, rates (comma separated lists)
+//            gain_range [name], frequency_range ("min,max" ranges, ';' separated)
+
+#include <SoapySDR/Device.hpp>
+#include <SoapySDR/Formats.hpp>
+#include <SoapySDR/Errors.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+
+static std::string toString(const double value)
+{
+    std::ostringstream ss;
+    ss.precision(12);
+    ss << value;
+    return ss.str();
+}
+
+static std::string join(const std::vector<std::string> &values)
+{
+    std::string out;
+    for (const auto &value : values) out += (out.empty() ? "" : ",") + value;
+    return out;
+}
+
+static std::string toString(const SoapySDR::RangeList &ranges)
+{
+    std::string out;
+    for (const auto &range : ranges)
+    {
+        out += (out.empty() ? "" : ";") + toString(range.minimum()) + "," + toString(range.maximum());
+    }
+    return out;
+}
+
+//a missing value reads the current one back
+static std::string command(SoapySDR::Device *device, const std::string &line)
+{
+    std::istringstream ss(line);
+    std::string cmd, arg, value;
+    ss >> cmd;
+
+    if (cmd == "gain_element" or cmd == "setting" or cmd == "gain_range") ss >> arg;
+    std::getline(ss >> std::ws, value);
+    const bool set = not value.empty();
+
+    if (cmd == "frequency")
+    {
+        if (set) device->setFrequency(SOAPY_SDR_RX, 0, std::stod(value));
+        return toString(device->getFrequency(SOAPY_SDR_RX, 0));
+    }
+    if (cmd == "rate")
+    {
+        if (set) device->setSampleRate(SOAPY_SDR_RX, 0, std::stod(value));
+        return toString(device->getSampleRate(SOAPY_SDR_RX, 0));
+    }
+    if (cmd == "bandwidth")
+    {
+        if (set) device->setBandwidth(SOAPY_SDR_RX, 0, std::stod(value));
+        return toString(device->getBandwidth(SOAPY_SDR_RX, 0));
+    }
+    if (cmd == "gain")
+    {
+        if (set) device->setGain(SOAPY_SDR_RX, 0, std::stod(value));
+        return toString(device->getGain(SOAPY_SDR_RX, 0));
+    }
+    if (cmd == "gain_mode")
+    {
+        if (set) device->setGainMode(SOAPY_SDR_RX, 0, value == "true");
+        return device->getGainMode(SOAPY_SDR_RX, 0) ? "true" : "false";
+    }
+    if (cmd == "antenna")
+    {
+        if (set) device->setAntenna(SOAPY_SDR_RX, 0, value);
+        return device->getAntenna(SOAPY_SDR_RX, 0);
+    }
+    if (cmd == "gain_element" and not arg.empty())
+    {
+        if (set) device->setGain(SOAPY_SDR_RX, 0, arg, std::stod(value));
+        return toString(device->getGain(SOAPY_SDR_RX, 0, arg));
+    }
+    if (cmd == "setting" and not arg.empty())
+    {
+        if (set) device->writeSetting(arg, value);
+        return device->readSetting(arg);
+    }
+    if (cmd == "antennas") return join(device->listAntennas(SOAPY_SDR_RX, 0));
+    if (cmd == "gains") return join(device->listGains(SOAPY_SDR_RX, 0));
+    if (cmd == "rates")
+    {
+        std::vector<std::string> rates;
+        for (const double rate : device->listSampleRates(SOAPY_SDR_RX, 0)) rates.push_back(toString(rate));
+        return join(rates);
+    }
+    if (cmd == "gain_range")
+    {
+        const SoapySDR::Range range = arg.empty() ? device->getGainRange(SOAPY_SDR_RX, 0) : device->getGainRange(SOAPY_SDR_RX, 0, arg);
+        return toString(SoapySDR::RangeList(1, range));
+    }
+    if (cmd == "frequency_range") return toString(device->getFrequencyRange(SOAPY_SDR_RX, 0));
+    throw std::runtime_error("unknown command '" + line + "'");
+}
+
+int main(int argc, char *argv[])
+{
+    SoapySDR::Kwargs devArgs, streamArgs;
+    devArgs["driver"] = "sdrplay";
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg(argv[i]);
+        const size_t eq = arg.find('=');
+        if (eq == std::string::npos) continue;
+        const std::string key = arg.substr(0, eq);
+        if (key == "shm_name") streamArgs[key] = arg.substr(eq + 1);
+        else devArgs[key] = arg.substr(eq + 1);
+    }
+    if (streamArgs.count("shm_name") == 0 or devArgs.count("serial") == 0)
+    {
+        std::cout << "error usage: SoapySDRPlayWorker serial=<serial> shm_name=<name> [key=value ...]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    SoapySDR::Device *device = nullptr;
+    SoapySDR::Stream *stream = nullptr;
+    try
+    {
+        device = SoapySDR::Device::make(devArgs);
+        stream = device->setupStream(SOAPY_SDR_RX, SOAPY_SDR_CS16, std::vector<size_t>(), streamArgs);
+        if (device->activateStream(stream) != 0) throw std::runtime_error("activateStream failed");
+    }
+    catch (const std::exception &ex)
+    {
+        std::cout << "error " << ex.what() << std::endl;
+        if (device != nullptr) SoapySDR::Device::unmake(device);
+        return EXIT_FAILURE;
+    }
+    std::cout << "ready" << std::endl;
+
+    //the ring is published by the driver, this reader only keeps it moving
+    std::atomic<bool> running(true);
+    std::thread drain([&]{
+        while (running)
+        {
+            size_t handle;
+            const void *buffs[1];
+            int flags = 0;
+            long long timeNs = 0;
+            if (device->acquireReadBuffer(stream, handle, buffs, flags, timeNs, 100000) >= 0)
+            {
+                device->releaseReadBuffer(stream, handle);
+            }
+        }
+    });
+
+    std::string line;
+    while (std::getline(std::cin, line))
+    {
+        if (line.empty()) continue;
+        try
+        {
+            std::cout << "ok " << command(device, line) << std::endl;
+        }
+        catch (const std::exception &ex)
+        {
+            std::cout << "error " << ex.what() << std::endl;
+        }
+    }
+
+    running = false;
+    drain.join();
+    device->deactivateStream(stream);
+    device->closeStream(stream);
+    SoapySDR::Device::unmake(device);
+    return EXIT_SUCCESS;
+}
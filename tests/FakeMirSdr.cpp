@@ -0,0 +1,178 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "FakeMirSdr.hpp"
+#include <mirsdrapi-rsp.h>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <cstring>
+
+static std::thread streamThread;
+static std::atomic<bool> streaming(false);
+static std::atomic<double> sampleRateMHz(2.0);
+static std::atomic<unsigned int> decimation(1);
+static std::atomic<int> samplesPerPacket(1008);
+static std::atomic<int> rfChanged(0);
+static std::atomic<int> grChanged(0);
+
+static char serial[] = FAKE_MIR_SDR_SERIAL;
+static char deviceName[] = "FakeRSP";
+
+void fakeMirSdrSetSamplesPerPacket(const int sps)
+{
+    samplesPerPacket = sps;
+}
+
+static void stream_loop(const int sps, mir_sdr_StreamCallback_t streamCb, mir_sdr_GainChangeCallback_t gainCb, void *ctx)
+{
+    std::vector<short> xi(sps), xq(sps);
+    unsigned int first = 0;
+    uint64_t n = 0;
+
+    //like USB, the first packet arrives one packet period after the start,
+    //by then the driver has set the decimation that follows mir_sdr_StreamInit()
+    auto next = std::chrono::steady_clock::now() + std::chrono::nanoseconds((long long)(sps * 1000.0 / sampleRateMHz));
+    std::this_thread::sleep_until(next);
+    while (streaming)
+    {
+        //decimation hands out fewer samples per packet at the same packet rate
+        const unsigned int numSamples = sps / decimation;
+        for (unsigned int i = 0; i < numSamples; i++)
+        {
+            xi[i] = fakeMirSdrI(n + i);
+            xq[i] = fakeMirSdrQ(n + i);
+        }
+
+        const int gr = grChanged.exchange(0);
+        if (gr != 0) gainCb((unsigned int)gr, 0, ctx);
+        streamCb(xi.data(), xq.data(), first, gr != 0, rfChanged.exchange(0), 0, numSamples, n == 0, 0, ctx);
+        first += numSamples;
+        n += numSamples;
+
+        next += std::chrono::nanoseconds((long long)(sps * 1000.0 / sampleRateMHz));
+        std::this_thread::sleep_until(next);
+    }
+}
+
+extern "C" {
+
+mir_sdr_ErrT mir_sdr_StreamInit(int *gRdB, double fsMHz, double rfMHz, mir_sdr_Bw_MHzT bwType, mir_sdr_If_kHzT ifType,
+                                int LNAstate, int *gRdBsystem, mir_sdr_SetGrModeT setGrMode, int *sps,
+                                mir_sdr_StreamCallback_t StreamCbFn, mir_sdr_GainChangeCallback_t GainChangeCbFn, void *cbContext)
+{
+    if (streaming) return mir_sdr_AlreadyInitialised;
+    sampleRateMHz = fsMHz;
+    *sps = samplesPerPacket;
+    *gRdBsystem = *gRdB;
+    streaming = true;
+    streamThread = std::thread(stream_loop, *sps, StreamCbFn, GainChangeCbFn, cbContext);
+    return mir_sdr_Success;
+}
+
+mir_sdr_ErrT mir_sdr_Reinit(int *gRdB, double fsMHz, double rfMHz, mir_sdr_Bw_MHzT bwType, mir_sdr_If_kHzT ifType,
+                            mir_sdr_LoModeT loMode, int LNAstate, int *gRdBsystem, mir_sdr_SetGrModeT setGrMode,
+                            int *sps, mir_sdr_ReasonForReinitT reasonForReinit)
+{
+    if (fsMHz > 0) sampleRateMHz = fsMHz;
+    if (reasonForReinit & mir_sdr_CHANGE_RF_FREQ) rfChanged = 1;
+    if (reasonForReinit & mir_sdr_CHANGE_GR) grChanged = *gRdB;
+    return mir_sdr_Success;
+}
+
+mir_sdr_ErrT mir_sdr_StreamUninit(void)
+{
+    streaming = false;
+    if (streamThread.joinable()) streamThread.join();
+    return mir_sdr_Success;
+}
+
+mir_sdr_ErrT mir_sdr_GetDevices(mir_sdr_DeviceT *devices, unsigned int *numDevs, unsigned int maxDevs)
+{
+    *numDevs = 0;
+    if (maxDevs == 0) return mir_sdr_Success;
+    devices[0].SerNo = serial;
+    devices[0].DevNm = deviceName;
+    devices[0].hwVer = 255;
+    devices[0].devAvail = 1;
+    *numDevs = 1;
+    return mir_sdr_Success;
+}
+
+mir_sdr_ErrT mir_sdr_DecimateControl(unsigned int enable, unsigned int decimationFactor, unsigned int wideBandSignal)
+{
+    decimation = enable ? decimationFactor : 1;
+    return mir_sdr_Success;
+}
+
+mir_sdr_ErrT mir_sdr_GetCurrentGain(mir_sdr_GainValuesT *gainVals)
+{
+    gainVals->curr = 40;
+    gainVals->max = 59;
+    gainVals->min = 20;
+    return mir_sdr_Success;
+}
+
+mir_sdr_ErrT mir_sdr_GetGrByFreq(double rfMHz, mir_sdr_BandT *band, int *gRdB, int LNAstate, int *gRdBsystem, mir_sdr_SetGrModeT setGrMode)
+{
+    *band = (rfMHz < 60) ? mir_sdr_BAND_AM_HI : mir_sdr_BAND_VHF;
+    *gRdBsystem = *gRdB + LNAstate * 6;
+    return mir_sdr_Success;
+}
+
+mir_sdr_ErrT mir_sdr_ApiVersion(float *version)
+{
+    *version = MIR_SDR_API_VERSION;
+    return mir_sdr_Success;
+}
+
+//everything else only has to succeed
+mir_sdr_ErrT mir_sdr_DebugEnable(unsigned int enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_SetDeviceIdx(unsigned int idx) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_ReleaseDeviceIdx(void) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_SetDcMode(int dcCal, int speedUp) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_SetDcTrackTime(int trackTime) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_SetTransferMode(mir_sdr_TransferModeT mode) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_AgcControl(mir_sdr_AgcControlT enable, int setPoint_dBfs, int knee_dBfs, unsigned int decay_ms,
+                                unsigned int hang_ms, int syncUpdate, int LNAstate) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_GainChangeCallbackMessageReceived(void) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_SetPpm(double ppm) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_AmPortSelect(int port) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_DCoffsetIQimbalanceControl(unsigned int DCenable, unsigned int IQenable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_RSPII_AntennaControl(mir_sdr_RSPII_AntennaSelectT select) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_RSPII_ExternalReferenceControl(unsigned int output_enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_RSPII_BiasTControl(unsigned int enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_RSPII_RfNotchEnable(unsigned int enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_rspDuo_TunerSel(mir_sdr_rspDuo_TunerSelT tuner) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_rspDuo_ExtRef(int output_enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_rspDuo_BiasT(int enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_rspDuo_Tuner1AmNotch(int enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_rspDuo_BroadcastNotch(int enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_rspDuo_DabNotch(int enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_rsp1a_BiasT(int enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_rsp1a_BroadcastNotch(int enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_rsp1a_DabNotch(int enable) { return mir_sdr_Success; }
+
+}
@@ -0,0 +1,57 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+//Simulated mir_sdr API v2 backend for the driver tests: one RSP1A with
+//serial FAKE0001 whose stream thread calls the stream callback in real
+//time with a known pattern. Sample n (counted at the output rate) is
+//
+//  I = fakeMirSdrI(n), Q = fakeMirSdrQ(n)
+//
+//so a reader can tell which sample it got from I alone.
+
+#include <cstdint>
+
+#define FAKE_MIR_SDR_SERIAL  "FAKE0001"
+
+inline short fakeMirSdrI(const uint64_t n)
+{
+    return (short)(uint16_t)(n * 3);
+}
+
+inline short fakeMirSdrQ(const uint64_t n)
+{
+    return (short)(uint16_t)~(n * 5);
+}
+
+//the sample number an I value belongs to, modulo 65536
+inline uint16_t fakeMirSdrIndex(const short i)
+{
+    //43691 is the inverse of 3 modulo 65536
+    return (uint16_t)((uint16_t)i * 43691u);
+}
+
+//samples per callback before decimation, takes effect with the next mir_sdr_StreamInit()
+void fakeMirSdrSetSamplesPerPacket(const int samplesPerPacket);
@@ -0,0 +1,134 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+//Sample conversion on the simulated API: CS16 and CF32 streams, converted
+//on the callback thread, by the pipeline thread and by the DSP workers,
+//hand out every source value exactly and keep each I/Q pair together and
+//in order.
+
+#include "SoapySDRPlay.hpp"
+#include "FakeMirSdr.hpp"
+#include <SoapySDR/Formats.hpp>
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+
+#define TEST_RATE     (2e6)
+#define TEST_SAMPLES  (400000)
+
+static bool convertStream(const std::string &format, const std::string &mode, SoapySDR::Kwargs streamArgs)
+{
+    const std::string name = format + " " + mode;
+    SoapySDR::Kwargs args;
+    args["serial"] = FAKE_MIR_SDR_SERIAL;
+    SoapySDRPlay device(args);
+    device.setSampleRate(SOAPY_SDR_RX, 0, TEST_RATE);
+
+    SoapySDR::Stream *stream = device.setupStream(SOAPY_SDR_RX, format, std::vector<size_t>(), streamArgs);
+    device.activateStream(stream);
+
+    const bool isFloat = (format == SOAPY_SDR_CF32);
+    const size_t mtu = device.getStreamMTU(stream);
+    std::vector<short> buff16(2 * mtu);
+    std::vector<float> buff32(2 * mtu);
+    void *buffs[1] = {isFloat ? (void *)buff32.data() : (void *)buff16.data()};
+
+    size_t samples = 0;
+    size_t failures = 0;
+    size_t overflows = 0;
+    bool haveLast = false;
+    uint16_t last = 0;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (samples < TEST_SAMPLES and std::chrono::steady_clock::now() < deadline)
+    {
+        int flags = 0;
+        long long timeNs = 0;
+        const int ret = device.readStream(stream, buffs, mtu, flags, timeNs, 100000);
+        if (ret == SOAPY_SDR_OVERFLOW)
+        {
+            //samples went missing on purpose, start over from the next read
+            overflows++;
+            haveLast = false;
+            continue;
+        }
+        if (ret <= 0) continue;
+
+        for (int k = 0; k < ret; k++)
+        {
+            short i, q;
+            if (isFloat)
+            {
+                //the 1/32768 scale is exact, so the source integer comes back
+                const float fi = buff32[2 * k] * 32768.0f;
+                const float fq = buff32[2 * k + 1] * 32768.0f;
+                i = (short)fi;
+                q = (short)fq;
+                if ((float)i != fi or (float)q != fq) failures++;
+            }
+            else
+            {
+                i = buff16[2 * k];
+                q = buff16[2 * k + 1];
+            }
+
+            //I names the sample, Q has to belong to the same one
+            const uint16_t index = fakeMirSdrIndex(i);
+            if (q != fakeMirSdrQ(index)) failures++;
+            if (haveLast and index != (uint16_t)(last + 1)) failures++;
+            last = index;
+            haveLast = true;
+        }
+        samples += ret;
+    }
+
+    device.deactivateStream(stream);
+    device.closeStream(stream);
+
+    std::cout << name << ": " << samples << " samples, " << overflows << " overflows, " << failures << " failures" << std::endl;
+    if (samples < TEST_SAMPLES)
+    {
+        std::cerr << name << ": the stream stalled" << std::endl;
+        return false;
+    }
+    return failures == 0;
+}
+
+int main(void)
+{
+    bool ok = true;
+    for (const std::string format : {SOAPY_SDR_CS16, SOAPY_SDR_CF32})
+    {
+        SoapySDR::Kwargs serial;
+        ok = convertStream(format, "callback", serial) and ok;
+
+        SoapySDR::Kwargs pipeline;
+        pipeline["pipeline"] = "true";
+        ok = convertStream(format, "pipeline", pipeline) and ok;
+
+        SoapySDR::Kwargs parallel;
+        parallel["dsp_threads"] = "2";
+        ok = convertStream(format, "dsp_threads=2", parallel) and ok;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,114 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+//Host timestamps on the simulated API: a reader asking for host_time=true
+//gets SOAPY_SDR_HAS_TIME, and the time of each buffer follows the previous
+//one by its length in sample periods, also when callbacks larger than a
+//raw block are split for the pipeline. Other readers get no time flag.
+
+#include "SoapySDRPlay.hpp"
+#include "FakeMirSdr.hpp"
+#include <SoapySDR/Formats.hpp>
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+
+#define TEST_RATE       (2e6)
+#define TEST_READS      (60)
+
+//callbacks of 10000 samples, split in three raw blocks in pipeline mode
+#define TEST_PACKET     (10000)
+
+//a piece stamped with the time of the previous one is off by milliseconds
+#define TEST_MAX_ERROR_NS  (500000)
+
+static bool timeStream(const std::string &mode, SoapySDR::Kwargs streamArgs, const bool hostTime)
+{
+    SoapySDR::Kwargs args;
+    args["serial"] = FAKE_MIR_SDR_SERIAL;
+    SoapySDRPlay device(args);
+    device.setSampleRate(SOAPY_SDR_RX, 0, TEST_RATE);
+
+    if (hostTime) streamArgs["host_time"] = "true";
+    SoapySDR::Stream *stream = device.setupStream(SOAPY_SDR_RX, SOAPY_SDR_CS16, std::vector<size_t>(), streamArgs);
+    device.activateStream(stream);
+
+    const size_t mtu = device.getStreamMTU(stream);
+    std::vector<short> buff(2 * mtu);
+    void *buffs[1] = {buff.data()};
+
+    int reads = 0;
+    size_t failures = 0;
+    long long worst = 0;
+    long long next = 0;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (reads < TEST_READS and std::chrono::steady_clock::now() < deadline)
+    {
+        int flags = 0;
+        long long timeNs = 0;
+        const int ret = device.readStream(stream, buffs, mtu, flags, timeNs, 100000);
+        if (ret == SOAPY_SDR_OVERFLOW) next = 0;
+        if (ret <= 0) continue;
+
+        if (((flags & SOAPY_SDR_HAS_TIME) != 0) != hostTime) failures++;
+
+        //the clock settles on the earliest callbacks first
+        if (hostTime and next != 0 and reads > 4)
+        {
+            const long long error = std::llabs(timeNs - next);
+            worst = std::max(worst, error);
+            if (error > TEST_MAX_ERROR_NS) failures++;
+        }
+        next = timeNs + (long long)(ret * 1e9 / TEST_RATE);
+        reads++;
+    }
+
+    device.deactivateStream(stream);
+    device.closeStream(stream);
+
+    std::cout << mode << (hostTime ? " host_time" : "") << ": " << reads << " reads, worst time step error " << worst << " ns, " << failures << " failures" << std::endl;
+    if (reads < TEST_READS)
+    {
+        std::cerr << mode << ": the stream stalled" << std::endl;
+        return false;
+    }
+    return failures == 0;
+}
+
+int main(void)
+{
+    fakeMirSdrSetSamplesPerPacket(TEST_PACKET);
+
+    bool ok = true;
+    for (const bool hostTime : {false, true})
+    {
+        SoapySDR::Kwargs serial;
+        ok = timeStream("callback", serial, hostTime) and ok;
+
+        SoapySDR::Kwargs pipeline;
+        pipeline["pipeline"] = "true";
+        ok = timeStream("pipeline", pipeline, hostTime) and ok;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
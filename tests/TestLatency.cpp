@@ -0,0 +1,128 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+//Latency target on the simulated API: with latency_ms the MTU follows the
+//sample rate, no read hands out an empty buffer, the first sample of a
+//buffer is about latency_ms old when it is read, and a read timeout flushes
+//a partial buffer instead of waiting for the target.
+
+#include "SoapySDRPlay.hpp"
+#include "FakeMirSdr.hpp"
+#include <SoapySDR/Formats.hpp>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+#define TEST_RATE     (250e3)
+#define TEST_READS    (200)
+
+static long long steadyNowNs(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//reads with the given latency target and read timeout, returns the median
+//first sample age and the largest buffer, or false when something broke
+static bool latencyStream(const std::string &latencyMs, const long timeoutUs, long long &medianAgeNs, size_t &mtu, size_t &largest)
+{
+    SoapySDR::Kwargs args;
+    args["serial"] = FAKE_MIR_SDR_SERIAL;
+    SoapySDRPlay device(args);
+    device.setSampleRate(SOAPY_SDR_RX, 0, TEST_RATE);
+
+    SoapySDR::Kwargs streamArgs;
+    streamArgs["latency_ms"] = latencyMs;
+    streamArgs["host_time"] = "true";
+    SoapySDR::Stream *stream = device.setupStream(SOAPY_SDR_RX, SOAPY_SDR_CS16, std::vector<size_t>(), streamArgs);
+    device.activateStream(stream);
+
+    std::vector<short> buff(2 * 65536);
+    void *buffs[1] = {buff.data()};
+
+    std::vector<long long> ages;
+    size_t empty = 0;
+    largest = 0;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (ages.size() < TEST_READS and std::chrono::steady_clock::now() < deadline)
+    {
+        int flags = 0;
+        long long timeNs = 0;
+        const int ret = device.readStream(stream, buffs, buff.size() / 2, flags, timeNs, timeoutUs);
+        if (ret == 0) empty++;
+        if (ret <= 0) continue;
+
+        ages.push_back(steadyNowNs() - timeNs);
+        largest = std::max(largest, (size_t)ret);
+    }
+    mtu = device.getStreamMTU(stream);
+
+    device.deactivateStream(stream);
+    device.closeStream(stream);
+
+    if (ages.size() < TEST_READS or empty != 0)
+    {
+        std::cerr << "latency_ms=" << latencyMs << ": " << ages.size() << " reads, " << empty << " empty" << std::endl;
+        return false;
+    }
+    std::sort(ages.begin(), ages.end());
+    medianAgeNs = ages[ages.size() / 2];
+    std::cout << "latency_ms=" << latencyMs << " timeout=" << timeoutUs << "us: mtu " << mtu << ", largest read " << largest
+        << ", median first sample age " << medianAgeNs / 1000 << " us" << std::endl;
+    return true;
+}
+
+int main(void)
+{
+    bool ok = true;
+    long long age = 0;
+    size_t mtu = 0, largest = 0;
+
+    //a target of 2 ms is 500 samples, several callbacks go into one buffer
+    if (not latencyStream("2", 100000, age, mtu, largest)) ok = false;
+    else if (mtu != 500 or largest > mtu or age > 10000000)
+    {
+        std::cerr << "latency_ms=2: buffers are not bounded by the target" << std::endl;
+        ok = false;
+    }
+
+    //a target below one callback (126 samples here) hands out every callback alone
+    if (not latencyStream("0.2", 100000, age, mtu, largest)) ok = false;
+    else if (mtu != 126 or largest > mtu)
+    {
+        std::cerr << "latency_ms=0.2: buffers are not one callback each" << std::endl;
+        ok = false;
+    }
+
+    //a 50 ms target with 5 ms read timeouts flushes partial buffers
+    if (not latencyStream("50", 5000, age, mtu, largest)) ok = false;
+    else if (largest >= mtu or age > 25000000)
+    {
+        std::cerr << "latency_ms=50: a read timeout did not flush the partial buffer" << std::endl;
+        ok = false;
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,122 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+//SoapySDRPlayNet_encode()/SoapySDRPlayNet_decode() round trip: the lossless
+//codecs must give back every block exactly, CS8 the upper 8 bits.
+
+#include "Network.hpp"
+#include <iostream>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+
+static bool roundTrip(const SoapySDRPlayNetCodec codec, const std::vector<short> &in, const std::string &what)
+{
+    std::vector<unsigned char> payload(SoapySDRPlayNet_maxPayload(in.size()));
+    const size_t bytes = SoapySDRPlayNet_encode(codec, in.data(), in.size(), payload.data());
+    if (bytes > payload.size())
+    {
+        std::cerr << SoapySDRPlayNet_codecName(codec) << " " << what << ": " << bytes << " bytes overrun the bound" << std::endl;
+        return false;
+    }
+
+    std::vector<short> out(in.size());
+    SoapySDRPlayNet_decode(codec, payload.data(), bytes, out.size(), out.data());
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        const short expected = (codec == SDRPLAY_NET_CS8) ? (short)((in[i] >> 8) * 256) : in[i];
+        if (out[i] != expected)
+        {
+            std::cerr << SoapySDRPlayNet_codecName(codec) << " " << what << ": value " << i
+                      << " is " << out[i] << ", expected " << expected << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(void)
+{
+    std::mt19937 rng(1);
+    size_t failures = 0;
+    size_t blocks = 0;
+
+    for (int k = 0; k < 2000; k++)
+    {
+        //odd lengths too, so partial groups are covered
+        const size_t numValues = 2 * (1 + rng() % 4096);
+        std::vector<short> block(numValues);
+        std::string what;
+        switch (k % 4)
+        {
+        case 0:
+            what = "random";
+            for (auto &v : block) v = (short)rng();
+            break;
+        case 1:
+        {
+            what = "tone";
+            const double amplitude = 1 + rng() % 32767;
+            const double step = 0.001 + (rng() % 1000) / 1000.0;
+            for (size_t i = 0; i < numValues / 2; i++)
+            {
+                block[2 * i] = (short)std::lround(amplitude * std::cos(step * i));
+                block[2 * i + 1] = (short)std::lround(amplitude * std::sin(step * i));
+            }
+            break;
+        }
+        case 2:
+            what = "low level";
+            for (auto &v : block) v = (short)((int)(rng() % 9) - 4);
+            break;
+        default:
+            what = "full scale";
+            for (auto &v : block) v = (rng() & 1) ? 32767 : -32768;
+            break;
+        }
+
+        for (const auto codec : {SDRPLAY_NET_CS16, SDRPLAY_NET_CS8, SDRPLAY_NET_DELTA})
+        {
+            if (not roundTrip(codec, block, what)) failures++;
+        }
+        blocks++;
+    }
+
+    //a truncated delta payload is refused, not read past its end
+    std::vector<short> block(1024, 1000);
+    std::vector<unsigned char> payload(SoapySDRPlayNet_maxPayload(block.size()));
+    const size_t bytes = SoapySDRPlayNet_encode(SDRPLAY_NET_DELTA, block.data(), block.size(), payload.data());
+    try
+    {
+        SoapySDRPlayNet_decode(SDRPLAY_NET_DELTA, payload.data(), bytes / 2, block.size(), block.data());
+        std::cerr << "truncated delta payload was accepted" << std::endl;
+        failures++;
+    }
+    catch (const std::exception &)
+    {
+    }
+
+    std::cout << blocks << " blocks, " << failures << " failures" << std::endl;
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,251 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+//Streaming server to net= client over loopback: every codec delivers the
+//pushed buffers in order with their metadata, every buffer goes back
+//through the release callback, and a client refuses frames whose sizes
+//would make it allocate more than any ring buffer holds.
+
+#include "Network.hpp"
+#include <SoapySDR/Errors.h>
+#include <SoapySDR/Formats.hpp>
+#include <iostream>
+#include <random>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <mutex>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define TEST_BLOCKS   (64)
+#define TEST_SAMPLES  (8192)
+#define TEST_HANDLES  (4)
+
+//a free loopback port, the server binds it again right after
+static std::string loopbackEndpoint(void)
+{
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 or getsockname(fd, (struct sockaddr *)&addr, &len) != 0)
+    {
+        throw std::runtime_error("no loopback port");
+    }
+    close(fd);
+    return "127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+}
+
+static short sampleValue(const unsigned long long n)
+{
+    //a slow ramp with a little noise, so the delta codec has work to do
+    return (short)((n * 7) ^ (n >> 3));
+}
+
+static bool streamCodec(const SoapySDRPlayNetCodec codec)
+{
+    const std::string name = SoapySDRPlayNet_codecName(codec);
+    const std::string endpoint = loopbackEndpoint();
+
+    std::vector<std::vector<short>> slots(TEST_HANDLES, std::vector<short>(2 * TEST_SAMPLES));
+    std::vector<int> held(TEST_HANDLES, 0);
+    std::mutex mutex;
+    size_t released = 0;
+
+    size_t pushed = 0;
+    size_t failures = 0;
+    {
+        SoapySDRPlayNetServer server(endpoint, codec, [&](size_t handle){
+            std::lock_guard<std::mutex> lock(mutex);
+            held[handle]--;
+            released++;
+        });
+
+        SoapySDR::Kwargs args;
+        args["net"] = endpoint;
+        SoapySDRPlayNetDevice client(args);
+        SoapySDR::Stream *stream = client.setupStream(SOAPY_SDR_RX, SOAPY_SDR_CS16);
+        client.activateStream(stream);
+
+        //reads one buffer and checks its samples and time against the pushed ones
+        std::vector<short> buff(2 * TEST_SAMPLES);
+        void *buffs[1] = {buff.data()};
+        unsigned long long nextRead = 0;
+        const auto readNext = [&](void) -> bool
+        {
+            int flags = 0;
+            long long timeNs = 0;
+            const int ret = client.readStream(stream, buffs, TEST_SAMPLES, flags, timeNs, 1000000);
+            if (ret <= 0)
+            {
+                std::cerr << name << ": readStream returned " << ret << " at sample " << nextRead << std::endl;
+                return false;
+            }
+            for (int i = 0; i < 2 * ret; i++)
+            {
+                const short expected = sampleValue(2 * nextRead + i);
+                const short wanted = (codec == SDRPLAY_NET_CS8) ? (short)((expected >> 8) * 256) : expected;
+                if (buff[i] != wanted) failures++;
+            }
+            if (timeNs != (long long)nextRead * 1000) failures++;
+            nextRead += ret;
+            return true;
+        };
+
+        for (size_t k = 0; k < TEST_BLOCKS; k++)
+        {
+            //a slot the server no longer holds, refilled with the next samples
+            const size_t handle = k % TEST_HANDLES;
+            for (;;)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (held[handle] == 0) break;
+                }
+                usleep(1000);
+            }
+            const unsigned long long first = (unsigned long long)k * TEST_SAMPLES;
+            for (size_t i = 0; i < 2 * TEST_SAMPLES; i++) slots[handle][i] = sampleValue(2 * first + i);
+
+            SoapySDRPlayNetServer::Block block;
+            block.handle = handle;
+            block.data = slots[handle].data();
+            block.numSamples = TEST_SAMPLES;
+            block.isFloat = false;
+            block.sampleCount = first;
+            block.timeNs = (long long)first * 1000;
+            block.centerFrequency = 100000000;
+            block.sampleRate = 1000000;
+            block.overload = false;
+
+            //refused until the client is connected or while the server is busy
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                held[handle]++;
+            }
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (not server.push(block))
+            {
+                if (std::chrono::steady_clock::now() > deadline)
+                {
+                    std::cerr << name << ": the server never took block " << k << std::endl;
+                    return false;
+                }
+                usleep(1000);
+            }
+            pushed++;
+
+            //keep the socket drained, all but the buffers the server may still hold
+            const size_t sent = (k + 1 > SDRPLAY_NET_MAX_BLOCKS) ? k + 1 - SDRPLAY_NET_MAX_BLOCKS : 0;
+            while (nextRead < (unsigned long long)sent * TEST_SAMPLES)
+            {
+                if (not readNext()) return false;
+            }
+        }
+        while (nextRead < (unsigned long long)TEST_BLOCKS * TEST_SAMPLES)
+        {
+            if (not readNext()) return false;
+        }
+
+        std::cout << name << ": " << server.getStatus() << std::endl;
+        client.deactivateStream(stream);
+        client.closeStream(stream);
+    }
+
+    if (released != pushed)
+    {
+        std::cerr << name << ": " << pushed << " buffers pushed, " << released << " released" << std::endl;
+        return false;
+    }
+    if (failures != 0)
+    {
+        std::cerr << name << ": " << failures << " mismatched values or times" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//a server announcing a frame far larger than any ring buffer
+static bool refuseFrame(const uint32_t numSamples, const uint32_t payloadBytes)
+{
+    const int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    bind(listenFd, (struct sockaddr *)&addr, sizeof(addr));
+    listen(listenFd, 1);
+    getsockname(listenFd, (struct sockaddr *)&addr, &len);
+
+    SoapySDR::Kwargs args;
+    args["net"] = "127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+    SoapySDRPlayNetDevice client(args);
+    const int fd = accept(listenFd, nullptr, nullptr);
+
+    SoapySDRPlayNetFrame frame;
+    std::memset(&frame, 0, sizeof(frame));
+    frame.magic = SDRPLAY_NET_MAGIC;
+    frame.codec = SDRPLAY_NET_CS16;
+    frame.numSamples = numSamples;
+    frame.payloadBytes = payloadBytes;
+    send(fd, &frame, sizeof(frame), 0);
+
+    SoapySDR::Stream *stream = client.setupStream(SOAPY_SDR_RX, SOAPY_SDR_CS16);
+    client.activateStream(stream);
+    std::vector<short> buff(2 * 1024);
+    void *buffs[1] = {buff.data()};
+    int flags = 0;
+    long long timeNs = 0;
+    const int ret = client.readStream(stream, buffs, 1024, flags, timeNs, 1000000);
+    client.closeStream(stream);
+    close(fd);
+    close(listenFd);
+
+    if (ret != SOAPY_SDR_STREAM_ERROR)
+    {
+        std::cerr << "frame of " << numSamples << " samples in " << payloadBytes << " bytes: readStream returned " << ret << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(void)
+{
+    bool ok = true;
+    for (const auto codec : {SDRPLAY_NET_CS16, SDRPLAY_NET_CS8, SDRPLAY_NET_DELTA})
+    {
+        ok = streamCodec(codec) and ok;
+    }
+    ok = refuseFrame(0xffffffffu, 16) and ok;
+    ok = refuseFrame(1024, 0xfffffff0u) and ok;
+
+    std::cout << (ok ? "passed" : "FAILED") << std::endl;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}